@@ -0,0 +1,324 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "thread.h"
+
+// Frame arenas, fixed size object pools and a heap allocation counter.
+//
+//   mat4_t *models = ARENA_ARRAY(arena_frame(), mat4_t, count);
+//   ...
+//   arena_reset(&frame_arena);   // once nothing from this frame is in use
+//
+// An arena hands out memory by bumping an offset and frees all of it at
+// once. It belongs to one thread; arena_bind() makes it that thread's
+// arena_frame(). A frame that needs more than the arena holds gets the rest
+// from the heap in overflow blocks, and the next reset grows the arena to
+// the high water mark, so after the first frames nothing touches the heap.
+//
+// Build with ALLOC_COUNT_ENABLED defined to route malloc, calloc and realloc
+// in every later header through a counter, the same way glstats.h counts GL
+// calls. Only threads that called alloc_count_thread() are counted, so
+// loaders and watchers in the background do not show up.
+#define ARENA_ALIGN      16
+#define ARENA_GROW_ROUND (64 * 1024)
+
+typedef struct arena_block_t arena_block_t;
+
+typedef struct
+{
+    unsigned char *base;
+    size_t         size;
+    size_t         used;
+    size_t         overflow_bytes;   // this frame
+    size_t         high_water;       // largest frame so far, overflow included
+    long           overflows;        // allocations that did not fit, in total
+    arena_block_t *overflow;
+} arena_t;
+
+// Recycles objects of one size out of a block reserved up front. Not thread
+// safe; give each thread its own or lock around it.
+typedef struct
+{
+    unsigned char *slots;
+    unsigned char *taken;            // one flag per slot, to catch double frees
+    void          *free_list;
+    size_t         object_size;
+    int            capacity;
+    int            used;
+    int            high_water;
+} pool_t;
+
+bool      arena_init(arena_t *arena, size_t size);
+void     *arena_alloc(arena_t *arena, size_t size);
+void      arena_reset(arena_t *arena);
+void      arena_destroy(arena_t *arena);
+void      arena_bind(arena_t *arena);
+arena_t  *arena_frame(void);
+
+bool      pool_init(pool_t *pool, size_t object_size, int capacity);
+void     *pool_alloc(pool_t *pool);
+bool      pool_free(pool_t *pool, void *object);
+void      pool_destroy(pool_t *pool);
+
+void      alloc_count_thread(bool counted);
+long long alloc_heap_count(void);
+void     *alloc_counted_malloc(size_t size);
+void     *alloc_counted_calloc(size_t count, size_t size);
+void     *alloc_counted_realloc(void *p, size_t size);
+
+#define ARENA_ARRAY(arena, type, count) ((type *) arena_alloc((arena), (size_t) (count) * sizeof(type)))
+
+#ifdef ALLOC_COUNT_ENABLED
+    #define malloc(size)        alloc_counted_malloc(size)
+    #define calloc(count, size) alloc_counted_calloc(count, size)
+    #define realloc(p, size)    alloc_counted_realloc(p, size)
+#endif
+
+#ifdef ALLOC_IMPLEMENTATION
+
+#include <stdio.h>
+#include <string.h>
+
+// The parentheses keep the counting macros off the real functions.
+#define ALLOC_MALLOC(size)     (malloc)(size)
+#define ALLOC_REALLOC(p, size) (realloc)(p, size)
+#define ALLOC_FREE(p)          (free)(p)
+
+struct arena_block_t
+{
+    arena_block_t *next;
+    size_t         pad;   // keeps the memory after the header aligned
+};
+
+static volatile long long    alloc_heap_total = 0;
+static THREAD_LOCAL bool     alloc_thread_counted = false;
+static THREAD_LOCAL arena_t *arena_current = NULL;
+
+static void alloc_counted(void)
+{
+    if (alloc_thread_counted)
+        atomic_add_i64(&alloc_heap_total, 1);
+
+    return;
+}
+
+void alloc_count_thread(bool counted)
+{
+    alloc_thread_counted = counted;
+
+    return;
+}
+
+long long alloc_heap_count(void)
+{
+    return atomic_load_i64(&alloc_heap_total);
+}
+
+void *alloc_counted_malloc(size_t size)
+{
+    alloc_counted();
+
+    return ALLOC_MALLOC(size);
+}
+
+void *alloc_counted_calloc(size_t count, size_t size)
+{
+    alloc_counted();
+
+    return (calloc)(count, size);
+}
+
+void *alloc_counted_realloc(void *p, size_t size)
+{
+    alloc_counted();
+
+    return ALLOC_REALLOC(p, size);
+}
+
+bool arena_init(arena_t *arena, size_t size)
+{
+    memset(arena, 0, sizeof(*arena));
+    arena->base = (unsigned char *) ALLOC_MALLOC(size);
+    if (arena->base == NULL)
+    {
+        fprintf(stderr, "alloc.h::error: out of memory for a %zu byte arena\n", size);
+        return false;
+    }
+    arena->size = size;
+
+    return true;
+}
+
+// Memory is aligned for any type and lasts until the next arena_reset().
+void *arena_alloc(arena_t *arena, size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+
+    if (arena->size - arena->used >= size)
+    {
+        void *p = arena->base + arena->used;
+        arena->used += size;
+
+        return p;
+    }
+
+    alloc_counted();
+    arena_block_t *block = (arena_block_t *) ALLOC_MALLOC(sizeof(arena_block_t) + size);
+    if (block == NULL)
+        return NULL;
+
+    block->next = arena->overflow;
+    arena->overflow = block;
+    arena->overflow_bytes += size;
+    arena->overflows++;
+
+    return block + 1;
+}
+
+static void arena_free_overflow(arena_t *arena)
+{
+    while (arena->overflow)
+    {
+        arena_block_t *next = arena->overflow->next;
+        ALLOC_FREE(arena->overflow);
+        arena->overflow = next;
+    }
+
+    return;
+}
+
+void arena_reset(arena_t *arena)
+{
+    size_t frame = arena->used + arena->overflow_bytes;
+    if (frame > arena->high_water)
+        arena->high_water = frame;
+
+    arena_free_overflow(arena);
+
+    // a frame spilled over, so make room for one like it
+    if (arena->high_water > arena->size)
+    {
+        size_t size = (arena->high_water + ARENA_GROW_ROUND - 1) / ARENA_GROW_ROUND * ARENA_GROW_ROUND;
+        unsigned char *base = (unsigned char *) ALLOC_REALLOC(arena->base, size);
+
+        alloc_counted();
+        if (base)
+        {
+            arena->base = base;
+            arena->size = size;
+        }
+    }
+
+    arena->used = 0;
+    arena->overflow_bytes = 0;
+
+    return;
+}
+
+void arena_destroy(arena_t *arena)
+{
+    arena_free_overflow(arena);
+    ALLOC_FREE(arena->base);
+    if (arena_current == arena)
+        arena_current = NULL;
+    memset(arena, 0, sizeof(*arena));
+
+    return;
+}
+
+void arena_bind(arena_t *arena)
+{
+    arena_current = arena;
+
+    return;
+}
+
+// NULL on threads that have not bound one.
+arena_t *arena_frame(void)
+{
+    return arena_current;
+}
+
+bool pool_init(pool_t *pool, size_t object_size, int capacity)
+{
+    memset(pool, 0, sizeof(*pool));
+
+    // every free slot holds the link to the next one
+    if (object_size < sizeof(void *))
+        object_size = sizeof(void *);
+    pool->object_size = (object_size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+    pool->capacity = capacity;
+
+    pool->slots = (unsigned char *) ALLOC_MALLOC((pool->object_size + 1) * capacity);
+    if (pool->slots == NULL)
+    {
+        fprintf(stderr, "alloc.h::error: out of memory for a pool of %d objects\n", capacity);
+        return false;
+    }
+    pool->taken = pool->slots + pool->object_size * capacity;
+    memset(pool->taken, 0, capacity);
+
+    for (int i = capacity - 1; i >= 0; i--)
+    {
+        void *slot = pool->slots + i * pool->object_size;
+        *(void **) slot = pool->free_list;
+        pool->free_list = slot;
+    }
+
+    return true;
+}
+
+// NULL once all capacity objects are in use.
+void *pool_alloc(pool_t *pool)
+{
+    void *object = pool->free_list;
+    if (object == NULL)
+        return NULL;
+
+    pool->free_list = *(void **) object;
+    pool->taken[((unsigned char *) object - pool->slots) / pool->object_size] = 1;
+    if (++pool->used > pool->high_water)
+        pool->high_water = pool->used;
+
+    return object;
+}
+
+// False, leaving the pool as it was, for an object this pool did not hand
+// out or one that is already free.
+bool pool_free(pool_t *pool, void *object)
+{
+    if (object == NULL)
+        return true;
+
+    size_t offset = (size_t) ((unsigned char *) object - pool->slots);
+    if ((unsigned char *) object < pool->slots || offset >= pool->object_size * pool->capacity || offset % pool->object_size != 0)
+    {
+        fprintf(stderr, "alloc.h::error: %p is not an object of this pool\n", object);
+        return false;
+    }
+
+    size_t slot = offset / pool->object_size;
+    if (!pool->taken[slot])
+    {
+        fprintf(stderr, "alloc.h::error: %p is freed twice\n", object);
+        return false;
+    }
+
+    pool->taken[slot] = 0;
+    *(void **) object = pool->free_list;
+    pool->free_list = object;
+    pool->used--;
+
+    return true;
+}
+
+void pool_destroy(pool_t *pool)
+{
+    ALLOC_FREE(pool->slots);
+    memset(pool, 0, sizeof(*pool));
+
+    return;
+}
+
+#endif
@@ -0,0 +1,285 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <glad/glad.h>
+
+// Frame timing, golden image checks and JSON results for benchmark runs.
+// Golden images are uncompressed 32 bit TGA files stored bottom row first,
+// the order glReadPixels() returns, so a capture is written without a flip.
+
+typedef struct
+{
+    int width;
+    int height;
+    int cubes;
+    int textures;
+    int frames;
+} bench_scene_t;
+
+typedef struct
+{
+    double   *frame_ms;
+    int       count;
+    int       capacity;
+    long long heap_allocs;   // in steady state frames, -1 when not counted
+} bench_t;
+
+typedef struct
+{
+    const char *path;
+    bool        checked;     // compared against an existing image
+    bool        written;     // recorded as the new reference
+    bool        passed;
+    int         tolerance;   // per channel difference still counted as equal
+    int         max_error;
+    long        differing;   // pixels with a channel beyond tolerance
+    double      max_differing_fraction;
+} bench_golden_t;
+
+void         bench_init(bench_t *bench, int frame_count);
+void         bench_frame(bench_t *bench, double frame_ms);
+double       bench_percentile(const bench_t *bench, double percentile);
+void         bench_free(bench_t *bench);
+unsigned int bench_checker_texture(int index);
+bool         bench_write_golden(const char *path, const unsigned char *rgba, int width, int height);
+bool         bench_compare_golden(bench_golden_t *golden, const unsigned char *rgba, int width, int height);
+void         bench_write_json(FILE *fp, const bench_scene_t *scene, const bench_t *bench, const bench_golden_t *golden);
+
+#ifdef BENCH_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+    #include "stb_image.h"
+#endif
+
+void bench_init(bench_t *bench, int frame_count)
+{
+    bench->count = 0;
+    bench->heap_allocs = -1;
+    bench->capacity = frame_count > 0 ? frame_count : 1;
+    bench->frame_ms = (double *) malloc(bench->capacity * sizeof(double));
+    if (bench->frame_ms == NULL)
+    {
+        fprintf(stderr, "bench.h::error: out of memory for %d frames\n", frame_count);
+        exit(EXIT_FAILURE);
+    }
+
+    return;
+}
+
+void bench_frame(bench_t *bench, double frame_ms)
+{
+    if (bench->count < bench->capacity)
+        bench->frame_ms[bench->count++] = frame_ms;
+
+    return;
+}
+
+static int bench_compare_ms(const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+// Nearest rank, so every reported value is a frame time that was measured.
+double bench_percentile(const bench_t *bench, double percentile)
+{
+    if (bench->count == 0)
+        return 0.0;
+
+    double *sorted = (double *) malloc(bench->count * sizeof(double));
+    memcpy(sorted, bench->frame_ms, bench->count * sizeof(double));
+    qsort(sorted, bench->count, sizeof(double), bench_compare_ms);
+
+    int rank = (int) (percentile / 100.0 * bench->count + 0.999999);
+    if (rank < 1)
+        rank = 1;
+    if (rank > bench->count)
+        rank = bench->count;
+
+    double value = sorted[rank - 1];
+    free(sorted);
+
+    return value;
+}
+
+void bench_free(bench_t *bench)
+{
+    free(bench->frame_ms);
+    bench->frame_ms = NULL;
+    bench->count = 0;
+    bench->capacity = 0;
+
+    return;
+}
+
+// Extra textures for scenes that ask for more than the stock one: 64x64
+// checkers in a different colour each, generated so no assets are needed.
+unsigned int bench_checker_texture(int index)
+{
+    unsigned char pixels[64 * 64 * 4];
+    unsigned char r = (unsigned char) (64 + 97 * index), g = (unsigned char) (160 + 53 * index), b = (unsigned char) (32 + 151 * index);
+
+    for (int y = 0; y < 64; y++)
+    {
+        for (int x = 0; x < 64; x++)
+        {
+            bool dark = ((x >> 3) ^ (y >> 3)) & 1;
+            unsigned char *p = pixels + (y * 64 + x) * 4;
+            p[0] = dark ? r / 4 : r;
+            p[1] = dark ? g / 4 : g;
+            p[2] = dark ? b / 4 : b;
+            p[3] = 255;
+        }
+    }
+
+    unsigned int tex = 0;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 64, 64, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    return tex;
+}
+
+bool bench_write_golden(const char *path, const unsigned char *rgba, int width, int height)
+{
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL)
+        return false;
+
+    // type 2 is uncompressed true colour; descriptor 8 means 8 alpha bits, origin bottom left
+    unsigned char header[18] = { 0, 0, 2 };
+    header[12] = (unsigned char) width;
+    header[13] = (unsigned char) (width >> 8);
+    header[14] = (unsigned char) height;
+    header[15] = (unsigned char) (height >> 8);
+    header[16] = 32;
+    header[17] = 8;
+    fwrite(header, sizeof(header), 1, fp);
+
+    size_t count = (size_t) width * height;
+    for (size_t i = 0; i < count; i++)
+    {
+        unsigned char bgra[4] = { rgba[i * 4 + 2], rgba[i * 4 + 1], rgba[i * 4 + 0], rgba[i * 4 + 3] };
+        fwrite(bgra, 4, 1, fp);
+    }
+
+    return fclose(fp) == 0;
+}
+
+bool bench_compare_golden(bench_golden_t *golden, const unsigned char *rgba, int width, int height)
+{
+    stbi_load_options options = { 0 };
+    options.flip_vertically = 1;
+
+    int golden_width, golden_height, channel;
+    unsigned char *reference = stbi_load_ex(golden->path, &golden_width, &golden_height, &channel, 4, &options);
+
+    golden->checked = true;
+    golden->passed = false;
+    golden->max_error = 255;
+    golden->differing = (long) width * height;
+
+    if (reference == NULL || golden_width != width || golden_height != height)
+    {
+        fprintf(stderr, "bench.h::error: golden image \"%s\" is missing or not %dx%d\n", golden->path, width, height);
+        stbi_image_free(reference);
+        return false;
+    }
+
+    golden->max_error = 0;
+    golden->differing = 0;
+
+    size_t count = (size_t) width * height;
+    for (size_t i = 0; i < count; i++)
+    {
+        int worst = 0;
+        for (int c = 0; c < 4; c++)
+        {
+            int error = abs((int) rgba[i * 4 + c] - (int) reference[i * 4 + c]);
+            if (error > worst)
+                worst = error;
+        }
+
+        if (worst > golden->max_error)
+            golden->max_error = worst;
+        if (worst > golden->tolerance)
+            golden->differing++;
+    }
+
+    stbi_image_free(reference);
+
+    golden->passed = golden->differing <= golden->max_differing_fraction * count;
+
+    return golden->passed;
+}
+
+static void bench_write_json_string(FILE *fp, const char *text)
+{
+    fputc('"', fp);
+    for (; *text; text++)
+    {
+        if (*text == '"' || *text == '\\')
+            fprintf(fp, "\\%c", *text);
+        else if ((unsigned char) *text < 0x20)
+            fprintf(fp, "\\u%04x", *text);
+        else
+            fputc(*text, fp);
+    }
+    fputc('"', fp);
+
+    return;
+}
+
+void bench_write_json(FILE *fp, const bench_scene_t *scene, const bench_t *bench, const bench_golden_t *golden)
+{
+    double total = 0.0, max = 0.0;
+    for (int i = 0; i < bench->count; i++)
+    {
+        total += bench->frame_ms[i];
+        if (bench->frame_ms[i] > max)
+            max = bench->frame_ms[i];
+    }
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"scene\": { \"width\": %d, \"height\": %d, \"cubes\": %d, \"textures\": %d, \"frames\": %d },\n",
+            scene->width, scene->height, scene->cubes, scene->textures, scene->frames);
+    fprintf(fp, "  \"frame_ms\": { \"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n",
+            bench->count ? total / bench->count : 0.0, bench_percentile(bench, 50.0), bench_percentile(bench, 90.0),
+            bench_percentile(bench, 99.0), max);
+    fprintf(fp, "  \"total_ms\": %.3f,\n", total);
+    if (bench->heap_allocs >= 0)
+        fprintf(fp, "  \"heap_allocs\": %lld,\n", bench->heap_allocs);
+    else
+        fprintf(fp, "  \"heap_allocs\": null,\n");
+
+    fprintf(fp, "  \"golden\": ");
+    if (golden->path == NULL)
+        fprintf(fp, "null\n");
+    else
+    {
+        fprintf(fp, "{ \"path\": ");
+        bench_write_json_string(fp, golden->path);
+        if (golden->written)
+            fprintf(fp, ", \"written\": true }\n");
+        else
+            fprintf(fp, ", \"passed\": %s, \"max_error\": %d, \"tolerance\": %d, \"differing_pixels\": %ld }\n",
+                    golden->passed ? "true" : "false", golden->max_error, golden->tolerance, golden->differing);
+    }
+    fprintf(fp, "}\n");
+
+    return;
+}
+
+#endif
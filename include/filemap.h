@@ -0,0 +1,224 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+    #undef near
+    #undef far
+#endif
+
+#define FILE_MAP_MAX_MOUNTS 8
+
+typedef enum
+{
+    FILE_MAP_HEAP,      // read into a buffer that close frees
+    FILE_MAP_MAPPED,    // mapped from the file system
+    FILE_MAP_BORROWED,  // owned by the mount that served it
+} file_map_kind_t;
+
+// A read only view of a whole file. The file is mapped when the platform
+// allows it and read into a heap buffer otherwise; either way data stays
+// valid until file_map_close(). It is not NUL terminated.
+typedef struct
+{
+    const unsigned char *data;
+    size_t               size;
+    file_map_kind_t      kind;
+} file_map_t;
+
+// A mount answers file_map_open() ahead of the file system, for paths it
+// holds, by filling in map and returning true.
+typedef bool (*file_map_source_t)(void *source, const char *path, file_map_t *map);
+
+bool file_map_open(file_map_t *map, const char *path);
+bool file_map_open_direct(file_map_t *map, const char *path);
+void file_map_close(file_map_t *map);
+void file_map_mount(file_map_source_t open, void *source);
+void file_map_unmount(void *source);
+
+#ifdef FILEMAP_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+// Mounts are set up at startup, before any loading threads run.
+static struct
+{
+    file_map_source_t open;
+    void             *source;
+} file_map_mounts[FILE_MAP_MAX_MOUNTS];
+static int file_map_mount_count = 0;
+
+static bool file_map_read(file_map_t *map, const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return false;
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    unsigned char *data = (unsigned char *) malloc(size > 0 ? size : 1);
+    if (size < 0 || data == NULL || fread(data, 1, size, fp) != (size_t) size)
+    {
+        free(data);
+        fclose(fp);
+        return false;
+    }
+
+    fclose(fp);
+
+    map->data = data;
+    map->size = (size_t) size;
+    map->kind = FILE_MAP_HEAP;
+
+    return true;
+}
+
+#ifdef _WIN32
+static bool file_map_view(file_map_t *map, const char *path)
+{
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0 && (unsigned long long) size.QuadPart <= (size_t) -1)
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+
+    // the view keeps both objects alive on its own
+    void *data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (mapping)
+        CloseHandle(mapping);
+    CloseHandle(file);
+
+    if (data == NULL)
+        return false;
+
+    map->data = (const unsigned char *) data;
+    map->size = (size_t) size.QuadPart;
+    map->kind = FILE_MAP_MAPPED;
+
+    return true;
+}
+#else
+static bool file_map_view(file_map_t *map, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+        data = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // the mapping holds its own reference to the file
+    close(fd);
+
+    if (data == MAP_FAILED)
+        return false;
+
+    map->data = (const unsigned char *) data;
+    map->size = (size_t) info.st_size;
+    map->kind = FILE_MAP_MAPPED;
+
+    return true;
+}
+#endif
+
+// Empty files and files on filesystems that cannot be mapped take the
+// buffered path, which is also the only one left when mapping is unavailable.
+bool file_map_open(file_map_t *map, const char *path)
+{
+    map->data = NULL;
+    map->size = 0;
+    map->kind = FILE_MAP_HEAP;
+
+    // the most recent mount wins
+    for (int i = file_map_mount_count - 1; i >= 0; i--)
+        if (file_map_mounts[i].open(file_map_mounts[i].source, path, map))
+            return true;
+
+    return file_map_open_direct(map, path);
+}
+
+// Skips the mounts, for readers that need the file as it is on disk now,
+// like a watcher reloading what it saw change.
+bool file_map_open_direct(file_map_t *map, const char *path)
+{
+    map->data = NULL;
+    map->size = 0;
+    map->kind = FILE_MAP_HEAP;
+
+    return file_map_view(map, path) || file_map_read(map, path);
+}
+
+void file_map_close(file_map_t *map)
+{
+    if (map->kind == FILE_MAP_MAPPED)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(map->data);
+#else
+        munmap((void *) map->data, map->size);
+#endif
+    } else if (map->kind == FILE_MAP_HEAP)
+        free((void *) map->data);
+
+    map->data = NULL;
+    map->size = 0;
+    map->kind = FILE_MAP_HEAP;
+
+    return;
+}
+
+void file_map_mount(file_map_source_t open, void *source)
+{
+    if (file_map_mount_count == FILE_MAP_MAX_MOUNTS)
+    {
+        fprintf(stderr, "filemap.h::error: more than %d mounts\n", FILE_MAP_MAX_MOUNTS);
+        exit(EXIT_FAILURE);
+    }
+
+    file_map_mounts[file_map_mount_count].open = open;
+    file_map_mounts[file_map_mount_count].source = source;
+    file_map_mount_count++;
+
+    return;
+}
+
+void file_map_unmount(void *source)
+{
+    for (int i = 0; i < file_map_mount_count; i++)
+    {
+        if (file_map_mounts[i].source == source)
+        {
+            memmove(&file_map_mounts[i], &file_map_mounts[i + 1], (file_map_mount_count - i - 1) * sizeof(file_map_mounts[0]));
+            file_map_mount_count--;
+            i--;
+        }
+    }
+
+    return;
+}
+
+#endif
@@ -0,0 +1,338 @@
+#pragma once
+
+#include <stdbool.h>
+#include <glad/glad.h>
+
+// Per frame counts of GL calls by kind and of bytes handed to the driver.
+// Build with GLSTATS_ENABLED defined (-DGLSTATS_ENABLED) to route the GL
+// functions below through counting macros; include this header right after
+// glad so every later header is instrumented. Without the flag nothing is
+// wrapped and the counters simply stay at zero.
+//
+// Counting is not thread safe; like the GL calls themselves it belongs to
+// the thread that owns the context. GLSTATS_CALLS counts wrapped calls only.
+typedef enum
+{
+    GLSTATS_CALLS,
+    GLSTATS_DRAWS,
+    GLSTATS_PROGRAM_BINDS,
+    GLSTATS_TEXTURE_BINDS,
+    GLSTATS_BUFFER_BINDS,        // buffers and vertex arrays
+    GLSTATS_UNIFORMS,
+    GLSTATS_UNIFORM_LOOKUPS,
+    GLSTATS_STATE_CHANGES,
+    GLSTATS_GETS,                // state queries, which can stall the pipeline
+    GLSTATS_BUFFER_BYTES,
+    GLSTATS_TEXTURE_BYTES,
+    GLSTATS_COUNTER_COUNT
+} glstats_counter_t;
+
+#define GLSTATS_UNLIMITED ((unsigned long long) -1)
+
+typedef struct
+{
+    long               index;
+    unsigned long long counters[GLSTATS_COUNTER_COUNT];
+} glstats_frame_t;
+
+// Called from glstats_frame_end() for a frame that went over budget; bit n
+// of over is set when counter n did.
+typedef void (*glstats_budget_fn)(const glstats_frame_t *frame, unsigned int over, void *user);
+
+extern glstats_frame_t glstats_current;
+
+void                   glstats_frame_end(void);
+const glstats_frame_t *glstats_last_frame(void);
+void                   glstats_budget(glstats_counter_t counter, unsigned long long limit);
+void                   glstats_on_budget(glstats_budget_fn fn, void *user);
+const char            *glstats_counter_name(glstats_counter_t counter);
+void                   glstats_summary(char *buffer, size_t size, const glstats_frame_t *frame);
+size_t                 glstats_pixel_bytes(GLsizei width, GLsizei height, GLenum format, GLenum type);
+
+#ifdef GLSTATS_ENABLED
+
+static inline void glstats_add(glstats_counter_t counter, unsigned long long amount)
+{
+    glstats_current.counters[GLSTATS_CALLS]++;
+    glstats_current.counters[counter] += amount;
+
+    return;
+}
+
+static inline unsigned long long glstats_upload(const void *data, unsigned long long size)
+{
+    return data ? size : 0;
+}
+
+// glad names its entry points glad_glFoo and maps glFoo onto them; with plain
+// prototypes the inner glFoo is not expanded again and calls the function.
+#ifdef __glad_h_
+    #define GLSTATS_GL(name) glad_##name
+#else
+    #define GLSTATS_GL(name) name
+#endif
+
+#define GLSTATS_WRAP(counter, amount, call) (glstats_add(counter, amount), call)
+
+#undef glDrawArrays
+#undef glDrawElements
+#undef glDrawArraysInstanced
+#undef glDrawElementsInstanced
+#define glDrawArrays(mode, first, count)                             GLSTATS_WRAP(GLSTATS_DRAWS, 1, GLSTATS_GL(glDrawArrays)(mode, first, count))
+#define glDrawElements(mode, count, type, indices)                   GLSTATS_WRAP(GLSTATS_DRAWS, 1, GLSTATS_GL(glDrawElements)(mode, count, type, indices))
+#define glDrawArraysInstanced(mode, first, count, instances)         GLSTATS_WRAP(GLSTATS_DRAWS, 1, GLSTATS_GL(glDrawArraysInstanced)(mode, first, count, instances))
+#define glDrawElementsInstanced(mode, count, type, indices, instances) GLSTATS_WRAP(GLSTATS_DRAWS, 1, GLSTATS_GL(glDrawElementsInstanced)(mode, count, type, indices, instances))
+
+#undef glUseProgram
+#undef glBindTexture
+#undef glBindBuffer
+#undef glBindVertexArray
+#define glUseProgram(program)                                        GLSTATS_WRAP(GLSTATS_PROGRAM_BINDS, 1, GLSTATS_GL(glUseProgram)(program))
+#define glBindTexture(target, texture)                               GLSTATS_WRAP(GLSTATS_TEXTURE_BINDS, 1, GLSTATS_GL(glBindTexture)(target, texture))
+#define glBindBuffer(target, buffer)                                 GLSTATS_WRAP(GLSTATS_BUFFER_BINDS, 1, GLSTATS_GL(glBindBuffer)(target, buffer))
+#define glBindVertexArray(array)                                     GLSTATS_WRAP(GLSTATS_BUFFER_BINDS, 1, GLSTATS_GL(glBindVertexArray)(array))
+
+#undef glUniform1i
+#undef glUniform1f
+#undef glUniform2f
+#undef glUniform3f
+#undef glUniform4f
+#undef glUniform3fv
+#undef glUniform4fv
+#undef glUniformMatrix3fv
+#undef glUniformMatrix4fv
+#undef glGetUniformLocation
+#define glUniform1i(location, x)                                     GLSTATS_WRAP(GLSTATS_UNIFORMS, 1, GLSTATS_GL(glUniform1i)(location, x))
+#define glUniform1f(location, x)                                     GLSTATS_WRAP(GLSTATS_UNIFORMS, 1, GLSTATS_GL(glUniform1f)(location, x))
+#define glUniform2f(location, x, y)                                  GLSTATS_WRAP(GLSTATS_UNIFORMS, 1, GLSTATS_GL(glUniform2f)(location, x, y))
+#define glUniform3f(location, x, y, z)                               GLSTATS_WRAP(GLSTATS_UNIFORMS, 1, GLSTATS_GL(glUniform3f)(location, x, y, z))
+#define glUniform4f(location, x, y, z, w)                            GLSTATS_WRAP(GLSTATS_UNIFORMS, 1, GLSTATS_GL(glUniform4f)(location, x, y, z, w))
+#define glUniform3fv(location, count, value)                         GLSTATS_WRAP(GLSTATS_UNIFORMS, 1, GLSTATS_GL(glUniform3fv)(location, count, value))
+#define glUniform4fv(location, count, value)                         GLSTATS_WRAP(GLSTATS_UNIFORMS, 1, GLSTATS_GL(glUniform4fv)(location, count, value))
+#define glUniformMatrix3fv(location, count, transpose, value)        GLSTATS_WRAP(GLSTATS_UNIFORMS, 1, GLSTATS_GL(glUniformMatrix3fv)(location, count, transpose, value))
+#define glUniformMatrix4fv(location, count, transpose, value)        GLSTATS_WRAP(GLSTATS_UNIFORMS, 1, GLSTATS_GL(glUniformMatrix4fv)(location, count, transpose, value))
+#define glGetUniformLocation(program, name)                          GLSTATS_WRAP(GLSTATS_UNIFORM_LOOKUPS, 1, GLSTATS_GL(glGetUniformLocation)(program, name))
+
+#undef glEnable
+#undef glDisable
+#undef glViewport
+#undef glClearColor
+#undef glPolygonMode
+#undef glPixelStorei
+#undef glTexParameteri
+#undef glTexParameteriv
+#define glEnable(cap)                                                GLSTATS_WRAP(GLSTATS_STATE_CHANGES, 1, GLSTATS_GL(glEnable)(cap))
+#define glDisable(cap)                                               GLSTATS_WRAP(GLSTATS_STATE_CHANGES, 1, GLSTATS_GL(glDisable)(cap))
+#define glViewport(x, y, width, height)                              GLSTATS_WRAP(GLSTATS_STATE_CHANGES, 1, GLSTATS_GL(glViewport)(x, y, width, height))
+#define glClearColor(r, g, b, a)                                     GLSTATS_WRAP(GLSTATS_STATE_CHANGES, 1, GLSTATS_GL(glClearColor)(r, g, b, a))
+#define glPolygonMode(face, mode)                                    GLSTATS_WRAP(GLSTATS_STATE_CHANGES, 1, GLSTATS_GL(glPolygonMode)(face, mode))
+#define glPixelStorei(name, param)                                   GLSTATS_WRAP(GLSTATS_STATE_CHANGES, 1, GLSTATS_GL(glPixelStorei)(name, param))
+#define glTexParameteri(target, name, param)                         GLSTATS_WRAP(GLSTATS_STATE_CHANGES, 1, GLSTATS_GL(glTexParameteri)(target, name, param))
+#define glTexParameteriv(target, name, params)                       GLSTATS_WRAP(GLSTATS_STATE_CHANGES, 1, GLSTATS_GL(glTexParameteriv)(target, name, params))
+
+#undef glGetIntegerv
+#undef glGetProgramiv
+#undef glGetShaderiv
+#define glGetIntegerv(name, data)                                    GLSTATS_WRAP(GLSTATS_GETS, 1, GLSTATS_GL(glGetIntegerv)(name, data))
+#define glGetProgramiv(program, name, params)                        GLSTATS_WRAP(GLSTATS_GETS, 1, GLSTATS_GL(glGetProgramiv)(program, name, params))
+#define glGetShaderiv(shader, name, params)                          GLSTATS_WRAP(GLSTATS_GETS, 1, GLSTATS_GL(glGetShaderiv)(shader, name, params))
+
+// Bytes count what the caller hands over, ignoring unpack row padding. A
+// NULL pixel pointer only allocates storage and counts nothing; a mapped
+// range counts its length when it is mapped for writing.
+#undef glBufferData
+#undef glBufferSubData
+#undef glMapBufferRange
+#undef glTexImage2D
+#undef glTexSubImage2D
+#undef glCompressedTexImage2D
+#undef glCompressedTexSubImage2D
+#define glBufferData(target, size, data, usage)                      GLSTATS_WRAP(GLSTATS_BUFFER_BYTES, glstats_upload(data, (unsigned long long) (size)), GLSTATS_GL(glBufferData)(target, size, data, usage))
+#define glBufferSubData(target, offset, size, data)                  GLSTATS_WRAP(GLSTATS_BUFFER_BYTES, (unsigned long long) (size), GLSTATS_GL(glBufferSubData)(target, offset, size, data))
+#define glMapBufferRange(target, offset, length, access)             GLSTATS_WRAP(GLSTATS_BUFFER_BYTES, ((access) & GL_MAP_WRITE_BIT) ? (unsigned long long) (length) : 0, GLSTATS_GL(glMapBufferRange)(target, offset, length, access))
+#define glTexImage2D(target, level, internal_format, width, height, border, format, type, pixels) \
+    GLSTATS_WRAP(GLSTATS_TEXTURE_BYTES, glstats_upload(pixels, glstats_pixel_bytes(width, height, format, type)), \
+                 GLSTATS_GL(glTexImage2D)(target, level, internal_format, width, height, border, format, type, pixels))
+#define glTexSubImage2D(target, level, x, y, width, height, format, type, pixels) \
+    GLSTATS_WRAP(GLSTATS_TEXTURE_BYTES, glstats_upload(pixels, glstats_pixel_bytes(width, height, format, type)), \
+                 GLSTATS_GL(glTexSubImage2D)(target, level, x, y, width, height, format, type, pixels))
+#define glCompressedTexImage2D(target, level, internal_format, width, height, border, size, data) \
+    GLSTATS_WRAP(GLSTATS_TEXTURE_BYTES, glstats_upload(data, (unsigned long long) (size)), \
+                 GLSTATS_GL(glCompressedTexImage2D)(target, level, internal_format, width, height, border, size, data))
+#define glCompressedTexSubImage2D(target, level, x, y, width, height, format, size, data) \
+    GLSTATS_WRAP(GLSTATS_TEXTURE_BYTES, (unsigned long long) (size), \
+                 GLSTATS_GL(glCompressedTexSubImage2D)(target, level, x, y, width, height, format, size, data))
+
+#endif
+
+#ifdef GLSTATS_IMPLEMENTATION
+
+#include <stdio.h>
+#include <string.h>
+
+glstats_frame_t glstats_current;
+
+static glstats_frame_t    glstats_last;
+static unsigned long long glstats_limits[GLSTATS_COUNTER_COUNT] =
+{
+    GLSTATS_UNLIMITED, GLSTATS_UNLIMITED, GLSTATS_UNLIMITED, GLSTATS_UNLIMITED,
+    GLSTATS_UNLIMITED, GLSTATS_UNLIMITED, GLSTATS_UNLIMITED, GLSTATS_UNLIMITED,
+    GLSTATS_UNLIMITED, GLSTATS_UNLIMITED, GLSTATS_UNLIMITED,
+};
+
+static const char *glstats_names[GLSTATS_COUNTER_COUNT] =
+{
+    "calls", "draws", "program binds", "texture binds", "buffer binds", "uniforms",
+    "uniform lookups", "state changes", "gets", "buffer bytes", "texture bytes",
+};
+
+// Warns once when a counter goes over budget and again only after it has
+// been back under, so a steady overrun does not flood stderr.
+static void glstats_warn(const glstats_frame_t *frame, unsigned int over, void *user)
+{
+    unsigned int *reported = (unsigned int *) user;
+
+    for (int i = 0; i < GLSTATS_COUNTER_COUNT; i++)
+        if ((over & ~*reported) & (1u << i))
+            fprintf(stderr, "glstats.h::warning: frame %ld: %llu %s, budget is %llu\n",
+                    frame->index, frame->counters[i], glstats_names[i], glstats_limits[i]);
+
+    *reported = over;
+
+    return;
+}
+
+static unsigned int      glstats_reported = 0;
+static glstats_budget_fn glstats_hook = glstats_warn;
+static void             *glstats_hook_user = &glstats_reported;
+
+void glstats_frame_end(void)
+{
+    unsigned int over = 0;
+    for (int i = 0; i < GLSTATS_COUNTER_COUNT; i++)
+        if (glstats_current.counters[i] > glstats_limits[i])
+            over |= 1u << i;
+
+    // the default hook also needs to hear about frames back under budget
+    if (over || (glstats_hook == glstats_warn && glstats_reported))
+        glstats_hook(&glstats_current, over, glstats_hook_user);
+
+    glstats_last = glstats_current;
+    memset(glstats_current.counters, 0, sizeof(glstats_current.counters));
+    glstats_current.index++;
+
+    return;
+}
+
+const glstats_frame_t *glstats_last_frame(void)
+{
+    return &glstats_last;
+}
+
+void glstats_budget(glstats_counter_t counter, unsigned long long limit)
+{
+    glstats_limits[counter] = limit;
+
+    return;
+}
+
+// NULL restores the default, a warning on stderr.
+void glstats_on_budget(glstats_budget_fn fn, void *user)
+{
+    glstats_hook = fn ? fn : glstats_warn;
+    glstats_hook_user = fn ? user : &glstats_reported;
+
+    return;
+}
+
+const char *glstats_counter_name(glstats_counter_t counter)
+{
+    return glstats_names[counter];
+}
+
+// The non-zero counters of a frame, "draws 16 | uniforms 17 | ...".
+void glstats_summary(char *buffer, size_t size, const glstats_frame_t *frame)
+{
+    size_t length = 0;
+    buffer[0] = '\0';
+
+    for (int i = 0; i < GLSTATS_COUNTER_COUNT && length < size; i++)
+    {
+        if (frame->counters[i] == 0)
+            continue;
+
+        int written = snprintf(buffer + length, size - length, "%s%s %llu", length ? " | " : "", glstats_names[i], frame->counters[i]);
+        if (written < 0)
+            break;
+        length += (size_t) written;
+    }
+
+    return;
+}
+
+size_t glstats_pixel_bytes(GLsizei width, GLsizei height, GLenum format, GLenum type)
+{
+    size_t components, size;
+
+    switch (format)
+    {
+    case GL_RG:
+    case GL_RG_INTEGER:
+        components = 2;
+        break;
+    case GL_RGB:
+    case GL_BGR:
+    case GL_RGB_INTEGER:
+        components = 3;
+        break;
+    case GL_RGBA:
+    case GL_BGRA:
+    case GL_RGBA_INTEGER:
+        components = 4;
+        break;
+    default:
+        components = 1;
+        break;
+    }
+
+    switch (type)
+    {
+    case GL_UNSIGNED_BYTE:
+    case GL_BYTE:
+        size = components;
+        break;
+    case GL_UNSIGNED_SHORT:
+    case GL_SHORT:
+    case GL_HALF_FLOAT:
+        size = components * 2;
+        break;
+    case GL_UNSIGNED_INT:
+    case GL_INT:
+    case GL_FLOAT:
+        size = components * 4;
+        break;
+    case GL_UNSIGNED_BYTE_3_3_2:
+    case GL_UNSIGNED_BYTE_2_3_3_REV:
+        size = 1;
+        break;
+    case GL_UNSIGNED_SHORT_5_6_5:
+    case GL_UNSIGNED_SHORT_5_6_5_REV:
+    case GL_UNSIGNED_SHORT_4_4_4_4:
+    case GL_UNSIGNED_SHORT_4_4_4_4_REV:
+    case GL_UNSIGNED_SHORT_5_5_5_1:
+    case GL_UNSIGNED_SHORT_1_5_5_5_REV:
+        size = 2;
+        break;
+    case GL_FLOAT_32_UNSIGNED_INT_24_8_REV:
+        size = 8;
+        break;
+    default:
+        // the remaining packed types hold a whole pixel in 32 bits
+        size = 4;
+        break;
+    }
+
+    return (size_t) width * height * size;
+}
+
+#endif
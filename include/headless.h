@@ -0,0 +1,216 @@
+#pragma once
+
+#include <stdbool.h>
+#include <glad/glad.h>
+
+// EGL is the only headless backend for now. Mesa's surfaceless platform runs
+// on llvmpipe with no GPU and no display server; define HEADLESS_NO_EGL to
+// build without libEGL, in which case headless_init() always fails.
+#if defined(__linux__) && !defined(HEADLESS_NO_EGL)
+    #define HEADLESS_EGL
+    #include <EGL/egl.h>
+    #include <EGL/eglext.h>
+#endif
+
+// An OpenGL 3.3 core context with no window. Frames are drawn into an
+// offscreen framebuffer that stays bound, so the usual render loop works
+// unchanged and headless_read_pixels() returns what a window would show.
+typedef struct
+{
+    int          width;
+    int          height;
+    unsigned int framebuffer;
+    unsigned int color;
+    unsigned int depth;
+#ifdef HEADLESS_EGL
+    EGLDisplay   display;
+    EGLContext   context;
+    EGLSurface   surface;
+#endif
+} headless_t;
+
+bool headless_init(headless_t *headless, int width, int height);
+bool headless_make_current(headless_t *headless, bool current);
+void headless_read_pixels(const headless_t *headless, unsigned char *rgba);
+void headless_destroy(headless_t *headless);
+
+#ifdef HEADLESS_IMPLEMENTATION
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HEADLESS_EGL
+static bool headless_has_extension(const char *extensions, const char *name)
+{
+    size_t length = strlen(name);
+
+    for (const char *p = extensions; p && (p = strstr(p, name)) != NULL; p += length)
+        if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0'))
+            return true;
+
+    return false;
+}
+
+// Prefers the surfaceless platform, which needs neither X nor a render node
+// the user can open, and falls back to the default display with a pbuffer.
+static bool headless_create_context(headless_t *headless)
+{
+    const char *client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    headless->display = EGL_NO_DISPLAY;
+
+    if (headless_has_extension(client_extensions, "EGL_MESA_platform_surfaceless"))
+    {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (get_platform_display)
+            headless->display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+
+    if (headless->display == EGL_NO_DISPLAY)
+        headless->display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major, minor;
+    if (headless->display == EGL_NO_DISPLAY || !eglInitialize(headless->display, &major, &minor) || !eglBindAPI(EGL_OPENGL_API))
+        return false;
+
+    bool surfaceless = headless_has_extension(eglQueryString(headless->display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+
+    const EGLint config_attributes[] =
+    {
+        EGL_SURFACE_TYPE,    surfaceless ? 0 : EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE,        8,
+        EGL_GREEN_SIZE,      8,
+        EGL_BLUE_SIZE,       8,
+        EGL_NONE
+    };
+
+    EGLConfig config;
+    EGLint config_count = 0;
+    if (!eglChooseConfig(headless->display, config_attributes, &config, 1, &config_count) || config_count == 0)
+        return false;
+
+    const EGLint context_attributes[] =
+    {
+        EGL_CONTEXT_MAJOR_VERSION,       3,
+        EGL_CONTEXT_MINOR_VERSION,       3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+
+    headless->context = eglCreateContext(headless->display, config, EGL_NO_CONTEXT, context_attributes);
+    if (headless->context == EGL_NO_CONTEXT)
+        return false;
+
+    headless->surface = EGL_NO_SURFACE;
+    if (!surfaceless)
+    {
+        const EGLint pbuffer_attributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+        headless->surface = eglCreatePbufferSurface(headless->display, config, pbuffer_attributes);
+        if (headless->surface == EGL_NO_SURFACE)
+            return false;
+    }
+
+    return eglMakeCurrent(headless->display, headless->surface, headless->surface, headless->context)
+        && gladLoadGLLoader((GLADloadproc) eglGetProcAddress);
+}
+#endif
+
+bool headless_init(headless_t *headless, int width, int height)
+{
+    memset(headless, 0, sizeof(*headless));
+    headless->width = width;
+    headless->height = height;
+
+#ifdef HEADLESS_EGL
+    if (!headless_create_context(headless))
+    {
+        fprintf(stderr, "headless.h::error: cannot create an EGL context (0x%x)\n", eglGetError());
+        headless_destroy(headless);
+        return false;
+    }
+#else
+    fprintf(stderr, "headless.h::error: no headless backend in this build\n");
+    return false;
+#endif
+
+    glGenRenderbuffers(1, &headless->color);
+    glBindRenderbuffer(GL_RENDERBUFFER, headless->color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+    glGenRenderbuffers(1, &headless->depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, headless->depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+
+    glGenFramebuffers(1, &headless->framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, headless->framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, headless->color);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, headless->depth);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        fprintf(stderr, "headless.h::error: offscreen framebuffer is incomplete\n");
+        headless_destroy(headless);
+        return false;
+    }
+
+    glViewport(0, 0, width, height);
+
+    return true;
+}
+
+// Binds the context to the calling thread, or releases it so another thread
+// can take it over. A context is current on at most one thread at a time.
+bool headless_make_current(headless_t *headless, bool current)
+{
+#ifdef HEADLESS_EGL
+    // the bound API is per thread, and new threads start out on GLES
+    if (current)
+        return eglBindAPI(EGL_OPENGL_API) && eglMakeCurrent(headless->display, headless->surface, headless->surface, headless->context);
+
+    return eglMakeCurrent(headless->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+#else
+    (void) headless;
+    (void) current;
+
+    return false;
+#endif
+}
+
+// Rows come back bottom first, as glReadPixels returns them.
+void headless_read_pixels(const headless_t *headless, unsigned char *rgba)
+{
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, headless->framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, headless->width, headless->height, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+
+    return;
+}
+
+void headless_destroy(headless_t *headless)
+{
+    // names only exist once the context is current and GL is loaded
+    if (headless->color)
+    {
+        glDeleteFramebuffers(1, &headless->framebuffer);
+        glDeleteRenderbuffers(1, &headless->color);
+        glDeleteRenderbuffers(1, &headless->depth);
+    }
+
+#ifdef HEADLESS_EGL
+    if (headless->display != EGL_NO_DISPLAY)
+    {
+        eglMakeCurrent(headless->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (headless->surface != EGL_NO_SURFACE)
+            eglDestroySurface(headless->display, headless->surface);
+        if (headless->context != EGL_NO_CONTEXT)
+            eglDestroyContext(headless->display, headless->context);
+        eglTerminate(headless->display);
+    }
+#endif
+
+    memset(headless, 0, sizeof(*headless));
+
+    return;
+}
+
+#endif
@@ -0,0 +1,496 @@
+#pragma once
+
+#include <stdbool.h>
+#include "thread.h"
+#include "alloc.h"
+
+// A fixed set of worker threads sharing small jobs through work stealing.
+// Every thread in the system, the one that called job_system_init() plus
+// the workers, owns a deque: it pushes and pops its own jobs at the bottom
+// while idle threads steal from the top of the others, so related work stays
+// on one core until someone runs dry.
+//
+//   job_counter_t done = { 0 };
+//   job_run(&jobs, decode, &image, &done);
+//   job_run_after(&jobs, &done, upload, &image, NULL);
+//   job_wait(&jobs, &done);
+//
+// Counters track how many jobs are outstanding; waiting on one runs other
+// jobs meanwhile rather than blocking. Jobs queued after a counter start the
+// first time it drains. Jobs can only be queued from threads of the system;
+// from any other thread they run inline. The workers count toward alloc.h's
+// heap counter, since their jobs are part of the frame.
+#define JOB_DEQUE_SIZE        4096  // a power of two
+#define JOB_POOL_SIZE         4096  // jobs a thread can have in flight
+#define JOB_RANGES_PER_THREAD 4     // parallel-for pieces per thread, for balance
+#define JOB_SPINS             64    // empty looks before an idle worker sleeps
+
+// Single jobs are called with begin 0 and end 1.
+typedef void (*job_fn_t)(void *data, int begin, int end);
+
+typedef struct job_t job_t;
+
+typedef struct
+{
+    volatile int pending;
+    job_t       *waiters;   // jobs queued with job_run_after() on this counter
+} job_counter_t;
+
+struct job_t
+{
+    job_fn_t       fn;
+    void          *data;
+    int            begin;
+    int            end;
+    job_counter_t *counter;
+    job_t         *next;
+    volatile int   live;      // allocated and not yet started
+};
+
+typedef struct job_system_t job_system_t;
+
+typedef struct
+{
+    volatile long long top;
+    volatile long long bottom;
+    job_t *volatile    slots[JOB_DEQUE_SIZE];
+    job_t              jobs[JOB_POOL_SIZE];
+    unsigned int       next_job;
+    unsigned int       seed;
+    int                index;
+    job_system_t      *system;
+} job_queue_t;
+
+struct job_system_t
+{
+    job_queue_t  *queues;       // [0] belongs to the thread that called job_system_init()
+    thread_t     *workers;
+    int           worker_count;
+
+    volatile int  queued;       // jobs pushed and not yet taken
+    volatile int  idle;         // workers asleep or about to be
+    volatile int  quit;
+    mutex_t       lock;
+    cond_t        wake;
+    mutex_t       dependency_lock;
+};
+
+void job_system_init(job_system_t *system, int worker_count);
+void job_system_destroy(job_system_t *system);
+void job_run(job_system_t *system, job_fn_t fn, void *data, job_counter_t *counter);
+void job_run_after(job_system_t *system, job_counter_t *after, job_fn_t fn, void *data, job_counter_t *counter);
+void job_wait(job_system_t *system, job_counter_t *counter);
+void job_parallel_for(job_system_t *system, int count, int grain, job_fn_t fn, void *data);
+
+#ifdef JOB_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static THREAD_LOCAL job_system_t *job_current_system = NULL;
+static THREAD_LOCAL job_queue_t  *job_current_queue = NULL;
+
+static job_queue_t *job_own_queue(job_system_t *system)
+{
+    return job_current_system == system ? job_current_queue : NULL;
+}
+
+// The pool is a ring. Nothing bounds how many jobs are in flight, since
+// jobs parked on a counter sit outside the deques, so a slot that comes
+// round again may still be taken; then there is no job and the caller runs
+// the work itself. Only the owning thread allocates, and a slot is handed
+// back by whichever thread starts its job.
+static job_t *job_alloc(job_queue_t *queue)
+{
+    job_t *job = &queue->jobs[queue->next_job & (JOB_POOL_SIZE - 1)];
+    if (atomic_load_acquire_i32(&job->live))
+        return NULL;
+
+    queue->next_job++;
+    memset(job, 0, sizeof(*job));
+    job->live = 1;
+
+    return job;
+}
+
+static void job_execute(job_system_t *system, job_queue_t *queue, job_t *job);
+
+// Chase-Lev deque over a fixed ring, with the sequentially consistent
+// atomics from thread.h standing in for the fences the algorithm needs.
+static void job_push(job_system_t *system, job_queue_t *queue, job_t *job)
+{
+    long long bottom = queue->bottom;
+    long long top = atomic_load_i64(&queue->top);
+
+    // full: doing the job now is slower than queueing it but still correct
+    if (bottom - top >= JOB_DEQUE_SIZE)
+    {
+        job_execute(system, queue, job);
+        return;
+    }
+
+    queue->slots[bottom & (JOB_DEQUE_SIZE - 1)] = job;
+    atomic_add_i32(&system->queued, 1);
+    atomic_store_i64(&queue->bottom, bottom + 1);
+
+    if (atomic_load_i32(&system->idle) > 0)
+    {
+        mutex_lock(&system->lock);
+        cond_signal(&system->wake);
+        mutex_unlock(&system->lock);
+    }
+
+    return;
+}
+
+static job_t *job_pop(job_system_t *system, job_queue_t *queue)
+{
+    long long bottom = queue->bottom - 1;
+    atomic_store_i64(&queue->bottom, bottom);
+    long long top = atomic_load_i64(&queue->top);
+
+    if (top > bottom)
+    {
+        atomic_store_i64(&queue->bottom, bottom + 1);
+        return NULL;
+    }
+
+    job_t *job = queue->slots[bottom & (JOB_DEQUE_SIZE - 1)];
+    if (top == bottom)
+    {
+        // the last job: race the thieves for it
+        if (!atomic_cas_i64(&queue->top, top, top + 1))
+            job = NULL;
+        atomic_store_i64(&queue->bottom, bottom + 1);
+    }
+
+    if (job)
+        atomic_add_i32(&system->queued, -1);
+
+    return job;
+}
+
+static job_t *job_steal(job_system_t *system, job_queue_t *queue)
+{
+    long long top = atomic_load_i64(&queue->top);
+    long long bottom = atomic_load_i64(&queue->bottom);
+
+    if (top >= bottom)
+        return NULL;
+
+    job_t *job = queue->slots[top & (JOB_DEQUE_SIZE - 1)];
+    if (!atomic_cas_i64(&queue->top, top, top + 1))
+        return NULL;
+
+    atomic_add_i32(&system->queued, -1);
+
+    return job;
+}
+
+static job_t *job_next(job_system_t *system, job_queue_t *queue)
+{
+    job_t *job = job_pop(system, queue);
+    if (job)
+        return job;
+
+    // xorshift picks where to start so thieves spread over the victims
+    int count = system->worker_count + 1;
+    queue->seed ^= queue->seed << 13;
+    queue->seed ^= queue->seed >> 17;
+    queue->seed ^= queue->seed << 5;
+
+    int start = (int) (queue->seed % (unsigned int) count);
+    for (int i = 0; i < count; i++)
+    {
+        job_queue_t *victim = &system->queues[(start + i) % count];
+        if (victim != queue && (job = job_steal(system, victim)) != NULL)
+            return job;
+    }
+
+    return NULL;
+}
+
+// The last job of a counter releases whatever was waiting on it onto the
+// finishing thread's deque. Counters often live on the stack of whoever
+// waits on them and may be gone the moment pending reads zero, so clearing
+// pending is the last thing done to one.
+static void job_counter_done(job_system_t *system, job_queue_t *queue, job_counter_t *counter)
+{
+    for (;;)
+    {
+        int pending = atomic_load_i32(&counter->pending);
+        if (pending <= 1)
+            break;
+        if (atomic_cas_i32(&counter->pending, pending, pending - 1))
+            return;
+    }
+
+    mutex_lock(&system->dependency_lock);
+    job_t *waiters = counter->waiters;
+    counter->waiters = NULL;
+    atomic_add_i32(&counter->pending, -1);
+    mutex_unlock(&system->dependency_lock);
+
+    while (waiters)
+    {
+        job_t *next = waiters->next;
+        job_push(system, queue, waiters);
+        waiters = next;
+    }
+
+    return;
+}
+
+// The slot is free again as soon as its fields are read, before the work.
+static void job_execute(job_system_t *system, job_queue_t *queue, job_t *job)
+{
+    job_fn_t fn = job->fn;
+    void *data = job->data;
+    int begin = job->begin, end = job->end;
+    job_counter_t *counter = job->counter;
+    atomic_store_release_i32(&job->live, 0);
+
+    fn(data, begin, end);
+
+    if (counter)
+        job_counter_done(system, queue, counter);
+
+    return;
+}
+
+static void *job_worker(void *arg)
+{
+    job_queue_t *queue = (job_queue_t *) arg;
+    job_system_t *system = queue->system;
+    job_current_system = system;
+    job_current_queue = queue;
+    alloc_count_thread(true);
+
+    int spins = 0;
+    while (!atomic_load_i32(&system->quit))
+    {
+        job_t *job = job_next(system, queue);
+        if (job)
+        {
+            job_execute(system, queue, job);
+            spins = 0;
+            continue;
+        }
+
+        if (++spins < JOB_SPINS)
+        {
+            thread_yield();
+            continue;
+        }
+
+        // queued is checked after idle is raised and job_push() checks idle
+        // after raising queued, so one of the two always sees the other
+        mutex_lock(&system->lock);
+        atomic_add_i32(&system->idle, 1);
+        while (!atomic_load_i32(&system->quit) && atomic_load_i32(&system->queued) <= 0)
+            cond_wait(&system->wake, &system->lock);
+        atomic_add_i32(&system->idle, -1);
+        mutex_unlock(&system->lock);
+
+        spins = 0;
+    }
+
+    job_current_system = NULL;
+    job_current_queue = NULL;
+
+    return NULL;
+}
+
+// A negative worker_count takes one worker per core beyond the caller's.
+void job_system_init(job_system_t *system, int worker_count)
+{
+    if (worker_count < 0)
+        worker_count = thread_hardware_concurrency() - 1;
+    if (worker_count < 0)
+        worker_count = 0;
+
+    memset(system, 0, sizeof(*system));
+    system->worker_count = worker_count;
+    system->queues = (job_queue_t *) calloc(worker_count + 1, sizeof(job_queue_t));
+    system->workers = worker_count ? (thread_t *) malloc(worker_count * sizeof(thread_t)) : NULL;
+    if (system->queues == NULL || (worker_count && system->workers == NULL))
+    {
+        fprintf(stderr, "job.h::error: out of memory for %d workers\n", worker_count);
+        exit(EXIT_FAILURE);
+    }
+
+    mutex_init(&system->lock);
+    cond_init(&system->wake);
+    mutex_init(&system->dependency_lock);
+
+    for (int i = 0; i <= worker_count; i++)
+    {
+        system->queues[i].index = i;
+        system->queues[i].system = system;
+        system->queues[i].seed = 0x9e3779b9u * (unsigned int) (i + 1);
+    }
+
+    job_current_system = system;
+    job_current_queue = &system->queues[0];
+
+    for (int i = 0; i < worker_count; i++)
+    {
+        if (!thread_create(&system->workers[i], job_worker, &system->queues[i + 1]))
+        {
+            fprintf(stderr, "job.h::error: failed to start worker %d\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return;
+}
+
+// Jobs still queued are dropped; wait on their counters first.
+void job_system_destroy(job_system_t *system)
+{
+    mutex_lock(&system->lock);
+    atomic_store_i32(&system->quit, 1);
+    cond_broadcast(&system->wake);
+    mutex_unlock(&system->lock);
+
+    for (int i = 0; i < system->worker_count; i++)
+        thread_join(&system->workers[i]);
+
+    if (job_current_system == system)
+    {
+        job_current_system = NULL;
+        job_current_queue = NULL;
+    }
+
+    cond_destroy(&system->wake);
+    mutex_destroy(&system->lock);
+    mutex_destroy(&system->dependency_lock);
+    free(system->workers);
+    free(system->queues);
+    memset(system, 0, sizeof(*system));
+
+    return;
+}
+
+static void job_run_range(job_system_t *system, job_fn_t fn, void *data, int begin, int end, job_counter_t *counter)
+{
+    job_queue_t *queue = job_own_queue(system);
+    job_t *job = queue ? job_alloc(queue) : NULL;
+    if (job == NULL)
+    {
+        fn(data, begin, end);
+        return;
+    }
+
+    job->fn = fn;
+    job->data = data;
+    job->begin = begin;
+    job->end = end;
+    job->counter = counter;
+
+    if (counter)
+        atomic_add_i32(&counter->pending, 1);
+
+    job_push(system, queue, job);
+
+    return;
+}
+
+// counter may be NULL when nobody needs to know the job finished.
+void job_run(job_system_t *system, job_fn_t fn, void *data, job_counter_t *counter)
+{
+    job_run_range(system, fn, data, 0, 1, counter);
+
+    return;
+}
+
+// Queues the job once after has dropped to zero, straight away if it
+// already has.
+void job_run_after(job_system_t *system, job_counter_t *after, job_fn_t fn, void *data, job_counter_t *counter)
+{
+    job_queue_t *queue = job_own_queue(system);
+    job_t *job = queue ? job_alloc(queue) : NULL;
+    if (job == NULL)
+    {
+        job_wait(system, after);
+        fn(data, 0, 1);
+        return;
+    }
+
+    job->fn = fn;
+    job->data = data;
+    job->begin = 0;
+    job->end = 1;
+    job->counter = counter;
+
+    if (counter)
+        atomic_add_i32(&counter->pending, 1);
+
+    // the last job of after takes this lock before it reads the waiters,
+    // so a job added here is either seen there or sees pending at zero
+    mutex_lock(&system->dependency_lock);
+    bool ready = atomic_load_i32(&after->pending) == 0;
+    if (!ready)
+    {
+        job->next = after->waiters;
+        after->waiters = job;
+    }
+    mutex_unlock(&system->dependency_lock);
+
+    if (ready)
+        job_push(system, queue, job);
+
+    return;
+}
+
+void job_wait(job_system_t *system, job_counter_t *counter)
+{
+    job_queue_t *queue = job_own_queue(system);
+
+    while (atomic_load_i32(&counter->pending) > 0)
+    {
+        job_t *job = queue ? job_next(system, queue) : NULL;
+        if (job)
+            job_execute(system, queue, job);
+        else
+            thread_yield();
+    }
+
+    return;
+}
+
+// Calls fn over [0, count) in pieces of at least grain items and returns
+// once all of them are done, the calling thread working along.
+void job_parallel_for(job_system_t *system, int count, int grain, job_fn_t fn, void *data)
+{
+    if (count <= 0)
+        return;
+    if (grain < 1)
+        grain = 1;
+
+    int ranges = (count + grain - 1) / grain;
+    int max_ranges = (system->worker_count + 1) * JOB_RANGES_PER_THREAD;
+    if (ranges > max_ranges)
+        ranges = max_ranges;
+
+    if (ranges == 1 || system->worker_count == 0 || job_own_queue(system) == NULL)
+    {
+        fn(data, 0, count);
+        return;
+    }
+
+    job_counter_t counter = { 0 };
+    for (int i = 0; i < ranges; i++)
+    {
+        int begin = (int) ((long long) count * i / ranges);
+        int end = (int) ((long long) count * (i + 1) / ranges);
+        job_run_range(system, fn, data, begin, end, &counter);
+    }
+
+    job_wait(system, &counter);
+
+    return;
+}
+
+#endif
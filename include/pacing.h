@@ -0,0 +1,232 @@
+#pragma once
+
+// nanosleep() is POSIX rather than C11. The macro only counts ahead of the
+// first system header, so a file that includes others before this one has to
+// define it itself.
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+    #define _POSIX_C_SOURCE 199309L
+#endif
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <GLFW/glfw3.h>
+#include "thread.h"
+
+// Frame pacing: the swap interval, a frame limiter and input to present
+// latency. Even frame times matter more here than the highest rate.
+//
+//   pacing_wait(&pacing);
+//   double input = pacing_now();   // right after polling events
+//   ...
+//   pacing_presented(&pacing, input, present);
+//
+// where present is pacing_now() once the swap returned. All of it belongs
+// to one thread; with a render thread, that thread only takes the present
+// time and the main thread passes it on once the frame is done.
+//
+// The limiter sleeps for most of the wait and spins the rest, since a sleep
+// can overshoot by a scheduler tick. The spin margin follows the worst
+// overshoot seen, so it stays short where sleeps are accurate. A frame that
+// comes in late starts a new schedule rather than rushing to catch up.
+#define PACING_HISTORY      120     // frames the stats cover
+#define PACING_SPIN_DEFAULT 0.001   // seconds spun before the deadline at first
+#define PACING_SPIN_MAX     0.004
+
+// Swap intervals: 0 off, N every Nth vblank, PACING_ADAPTIVE syncs unless
+// the frame is late, in which case it swaps at once and tears rather than
+// waiting a whole extra vblank.
+#define PACING_ADAPTIVE     -1
+
+typedef struct
+{
+    double interval_avg;   // ms between frames leaving pacing_wait()
+    double interval_dev;   // standard deviation of that, the jitter
+    double latency_avg;    // ms from input to present
+    double latency_max;
+    int    late;           // frames that missed their deadline
+} pacing_stats_t;
+
+typedef struct
+{
+    double target;         // seconds per frame, 0 for no limit
+    double deadline;
+    double spin;
+    double last;
+    float  interval_ms[PACING_HISTORY];
+    int    intervals;
+    int    late;
+    float  latency_ms[PACING_HISTORY];
+    int    latencies;
+} pacing_t;
+
+void   pacing_init(pacing_t *pacing, double fps);
+void   pacing_destroy(pacing_t *pacing);
+double pacing_now(void);
+int    pacing_swap_interval(int interval);
+void   pacing_wait(pacing_t *pacing);
+void   pacing_presented(pacing_t *pacing, double input_time, double present_time);
+void   pacing_stats(const pacing_t *pacing, pacing_stats_t *stats);
+void   pacing_summary(const pacing_t *pacing, char *buffer, size_t size);
+
+#ifdef PACING_IMPLEMENTATION
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #pragma comment(lib, "winmm.lib")
+#else
+    #include <time.h>
+#endif
+
+// The frame clock is the shared one, so pacing and profile times line up.
+double pacing_now(void)
+{
+    return thread_now();
+}
+
+static void pacing_sleep(double seconds)
+{
+#ifdef _WIN32
+    Sleep((DWORD) (seconds * 1000.0));
+#else
+    struct timespec ts;
+    ts.tv_sec = (time_t) seconds;
+    ts.tv_nsec = (long) ((seconds - (double) ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+#endif
+
+    return;
+}
+
+// fps of 0 or less leaves the rate to the swap interval.
+void pacing_init(pacing_t *pacing, double fps)
+{
+    memset(pacing, 0, sizeof(*pacing));
+    pacing->target = fps > 0.0 ? 1.0 / fps : 0.0;
+    pacing->spin = PACING_SPIN_DEFAULT;
+
+#ifdef _WIN32
+    // the default timer resolution turns a 1 ms sleep into 15
+    timeBeginPeriod(1);
+#endif
+
+    return;
+}
+
+void pacing_destroy(pacing_t *pacing)
+{
+#ifdef _WIN32
+    // each timeBeginPeriod() needs its own timeEndPeriod()
+    timeEndPeriod(1);
+#endif
+    memset(pacing, 0, sizeof(*pacing));
+
+    return;
+}
+
+// Needs the context current on the calling thread. Falls back from adaptive
+// to plain vsync where the driver has no late swap tearing. Returns the
+// interval that was set.
+int pacing_swap_interval(int interval)
+{
+    if (interval == PACING_ADAPTIVE && !glfwExtensionSupported("WGL_EXT_swap_control_tear") && !glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+    {
+        fprintf(stderr, "pacing.h::warning: no adaptive vsync here, using a swap interval of 1\n");
+        interval = 1;
+    }
+
+    glfwSwapInterval(interval);
+
+    return interval;
+}
+
+void pacing_wait(pacing_t *pacing)
+{
+    double now = pacing_now();
+
+    if (pacing->target > 0.0)
+    {
+        if (pacing->deadline != 0.0 && now > pacing->deadline)
+            pacing->late++;
+
+        if (pacing->deadline == 0.0 || now > pacing->deadline + pacing->target)
+            pacing->deadline = now;
+        else if (now < pacing->deadline)
+        {
+            double remaining = pacing->deadline - now;
+            if (remaining > pacing->spin)
+            {
+                double before = pacing_now();
+                pacing_sleep(remaining - pacing->spin);
+                double overshoot = (pacing_now() - before) - (remaining - pacing->spin);
+
+                if (overshoot > pacing->spin)
+                    pacing->spin = overshoot < PACING_SPIN_MAX ? overshoot : PACING_SPIN_MAX;
+            }
+
+            while ((now = pacing_now()) < pacing->deadline)
+                ;
+        }
+
+        pacing->deadline += pacing->target;
+    }
+
+    if (pacing->last > 0.0)
+        pacing->interval_ms[pacing->intervals++ % PACING_HISTORY] = (float) ((now - pacing->last) * 1e3);
+    pacing->last = now;
+
+    return;
+}
+
+// Both times are pacing_now() values: when the frame's input was polled and
+// when its swap returned.
+void pacing_presented(pacing_t *pacing, double input_time, double present_time)
+{
+    pacing->latency_ms[pacing->latencies++ % PACING_HISTORY] = (float) ((present_time - input_time) * 1e3);
+
+    return;
+}
+
+void pacing_stats(const pacing_t *pacing, pacing_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->late = pacing->late;
+
+    int intervals = pacing->intervals < PACING_HISTORY ? pacing->intervals : PACING_HISTORY;
+    for (int i = 0; i < intervals; i++)
+        stats->interval_avg += pacing->interval_ms[i];
+    if (intervals > 0)
+        stats->interval_avg /= intervals;
+
+    for (int i = 0; i < intervals; i++)
+        stats->interval_dev += (pacing->interval_ms[i] - stats->interval_avg) * (pacing->interval_ms[i] - stats->interval_avg);
+    if (intervals > 0)
+        stats->interval_dev = sqrt(stats->interval_dev / intervals);
+
+    int latencies = pacing->latencies < PACING_HISTORY ? pacing->latencies : PACING_HISTORY;
+    for (int i = 0; i < latencies; i++)
+    {
+        stats->latency_avg += pacing->latency_ms[i];
+        if (pacing->latency_ms[i] > stats->latency_max)
+            stats->latency_max = pacing->latency_ms[i];
+    }
+    if (latencies > 0)
+        stats->latency_avg /= latencies;
+
+    return;
+}
+
+void pacing_summary(const pacing_t *pacing, char *buffer, size_t size)
+{
+    pacing_stats_t stats;
+    pacing_stats(pacing, &stats);
+
+    snprintf(buffer, size, "pace %.2f~%.2f ms | latency %.2f/%.2f ms | late %d", stats.interval_avg, stats.interval_dev, stats.latency_avg, stats.latency_max, stats.late);
+
+    return;
+}
+
+#endif
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "filemap.h"
+
+// One file holding many assets, written by tools/assetpack.c and mapped once.
+//
+//   pack_header_t
+//   pack_entry_t[entry_count]   sorted by hash
+//   path table                  NUL terminated, '/' separated
+//   entry data                  each entry starts on a PACK_ALIGNMENT boundary
+//
+// All fields are little endian. Paths are stored as given to the packer, so
+// they match the relative paths the loaders already use.
+#define PACK_MAGIC     0x314B4150u  // "PAK1"
+#define PACK_ALIGNMENT 64
+
+typedef enum
+{
+    PACK_STORED,
+    PACK_ZLIB,    // zlib stream, inflated by stb_image's decoder
+} pack_compression_t;
+
+typedef struct
+{
+    unsigned int       magic;
+    unsigned int       entry_count;
+    unsigned long long paths_offset;
+    unsigned long long paths_size;
+} pack_header_t;
+
+typedef struct
+{
+    unsigned long long hash;
+    unsigned long long offset;
+    unsigned long long size;      // bytes in the pack
+    unsigned long long raw_size;  // bytes once inflated
+    unsigned int       path;      // offset into the path table
+    unsigned int       compression;
+} pack_entry_t;
+
+typedef struct
+{
+    file_map_t          file;
+    const pack_entry_t *entries;
+    unsigned int        entry_count;
+    const char         *paths;
+} pack_t;
+
+unsigned long long  pack_hash_path(const char *path);
+bool                pack_validate(const unsigned char *data, size_t size);
+bool                pack_open(pack_t *pack, const char *path);
+void                pack_close(pack_t *pack);
+const pack_entry_t *pack_find(const pack_t *pack, const char *path);
+bool                pack_read(const pack_t *pack, const pack_entry_t *entry, file_map_t *map);
+void                pack_mount(pack_t *pack);
+
+#ifdef PACK_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// only the zlib decoder is needed; whoever included it first owns the implementation
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+    #include "stb_image.h"
+#endif
+
+// FNV-1a over the path with '\' read as '/' and any leading "./" dropped, so
+// both spellings of a path find the same entry.
+unsigned long long pack_hash_path(const char *path)
+{
+    while (path[0] == '.' && (path[1] == '/' || path[1] == '\\'))
+        path += 2;
+
+    unsigned long long hash = 14695981039346656037ull;
+    for (; *path; path++)
+    {
+        hash ^= (unsigned char) (*path == '\\' ? '/' : *path);
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+static bool pack_same_path(const char *a, const char *b)
+{
+    while (a[0] == '.' && (a[1] == '/' || a[1] == '\\'))
+        a += 2;
+    while (b[0] == '.' && (b[1] == '/' || b[1] == '\\'))
+        b += 2;
+
+    for (; *a && *b; a++, b++)
+        if ((*a == '\\' ? '/' : *a) != (*b == '\\' ? '/' : *b))
+            return false;
+
+    return *a == *b;
+}
+
+// Everything the lookups rely on is checked here, once, so a truncated or
+// foreign file is refused instead of read out of bounds later.
+bool pack_validate(const unsigned char *data, size_t size)
+{
+    pack_header_t header = { 0 };
+    if (size >= sizeof(header))
+        memcpy(&header, data, sizeof(header));
+
+    size_t index_end = sizeof(header) + (size_t) header.entry_count * sizeof(pack_entry_t);
+    bool valid = header.magic == PACK_MAGIC && index_end <= size
+              && header.paths_offset >= index_end && header.paths_offset <= size
+              && header.paths_size <= size - header.paths_offset
+              && header.paths_size > 0 && data[header.paths_offset + header.paths_size - 1] == '\0';
+
+    const pack_entry_t *entries = (const pack_entry_t *) (data + sizeof(header));
+    for (unsigned int i = 0; valid && i < header.entry_count; i++)
+    {
+        valid = entries[i].offset <= size && entries[i].size <= size - entries[i].offset
+             && entries[i].path < header.paths_size && entries[i].compression <= PACK_ZLIB
+             && (i == 0 || entries[i].hash >= entries[i - 1].hash);
+    }
+
+    return valid;
+}
+
+bool pack_open(pack_t *pack, const char *path)
+{
+    memset(pack, 0, sizeof(*pack));
+
+    if (!file_map_open(&pack->file, path))
+        return false;
+
+    const unsigned char *data = pack->file.data;
+    if (!pack_validate(data, pack->file.size))
+    {
+        fprintf(stderr, "pack.h::error: \"%s\" is not a valid pack\n", path);
+        pack_close(pack);
+        return false;
+    }
+
+    pack_header_t header;
+    memcpy(&header, data, sizeof(header));
+    pack->entries = (const pack_entry_t *) (data + sizeof(header));
+    pack->entry_count = header.entry_count;
+    pack->paths = (const char *) (data + header.paths_offset);
+
+    return true;
+}
+
+void pack_close(pack_t *pack)
+{
+    file_map_unmount(pack);
+    file_map_close(&pack->file);
+    memset(pack, 0, sizeof(*pack));
+
+    return;
+}
+
+const pack_entry_t *pack_find(const pack_t *pack, const char *path)
+{
+    unsigned long long hash = pack_hash_path(path);
+
+    unsigned int lo = 0, hi = pack->entry_count;
+    while (lo < hi)
+    {
+        unsigned int mid = lo + (hi - lo) / 2;
+        if (pack->entries[mid].hash < hash)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    // equal hashes sit next to each other; the path settles collisions
+    for (; lo < pack->entry_count && pack->entries[lo].hash == hash; lo++)
+        if (pack_same_path(pack->paths + pack->entries[lo].path, path))
+            return &pack->entries[lo];
+
+    return NULL;
+}
+
+// Stored entries are served straight out of the mapping; compressed ones
+// are inflated into a buffer the caller releases with file_map_close().
+bool pack_read(const pack_t *pack, const pack_entry_t *entry, file_map_t *map)
+{
+    const unsigned char *data = pack->file.data + entry->offset;
+
+    if (entry->compression == PACK_STORED)
+    {
+        map->data = data;
+        map->size = (size_t) entry->size;
+        map->kind = FILE_MAP_BORROWED;
+
+        return true;
+    }
+
+    if (entry->size > 0x7fffffff || entry->raw_size > 0x7fffffff)
+        return false;
+
+    char *raw = (char *) malloc(entry->raw_size > 0 ? (size_t) entry->raw_size : 1);
+    if (raw == NULL)
+        return false;
+
+    int length = stbi_zlib_decode_buffer(raw, (int) entry->raw_size, (const char *) data, (int) entry->size);
+    if (length != (int) entry->raw_size)
+    {
+        free(raw);
+        return false;
+    }
+
+    map->data = (const unsigned char *) raw;
+    map->size = (size_t) length;
+    map->kind = FILE_MAP_HEAP;
+
+    return true;
+}
+
+static bool pack_mount_open(void *source, const char *path, file_map_t *map)
+{
+    const pack_t *pack = (const pack_t *) source;
+    const pack_entry_t *entry = pack_find(pack, path);
+
+    if (entry && !pack_read(pack, entry, map))
+    {
+        fprintf(stderr, "pack.h::error: cannot inflate \"%s\"\n", path);
+        return false;
+    }
+
+    return entry != NULL;
+}
+
+// Routes file_map_open(), and with it every shader and texture load, through
+// the pack first. pack_close() takes the mount down again.
+void pack_mount(pack_t *pack)
+{
+    file_map_mount(pack_mount_open, pack);
+
+    return;
+}
+
+#endif
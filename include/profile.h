@@ -0,0 +1,696 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <glad/glad.h>
+#include "thread.h"
+
+// Named CPU and GPU timing scopes for the render thread.
+//
+//   profile_frame_begin();
+//   profile_begin("draw");
+//   ... GL calls ...
+//   profile_end();
+//   profile_frame_end();
+//
+// GPU times come from GL_TIMESTAMP queries issued around each scope. Every
+// frame writes its own set of queries out of a ring of PROFILE_LATENCY sets
+// and a set is only read back when its slot comes round again, by which time
+// the GPU has long finished with it, so reading never stalls the pipeline.
+// Timestamps rather than GL_TIME_ELAPSED let scopes nest.
+//
+// Any thread can time CPU work with zones:
+//
+//   PROFILE_ZONE_BEGIN("decode");
+//   ...
+//   PROFILE_ZONE_END();
+//
+// A zone costs two cycle counter reads and one slot in a ring owned by the
+// calling thread; nothing is shared with other threads but the ring's head
+// and tail. profile_frame_end() drains every ring into the stats and the
+// trace, one row per thread. A thread that outruns the ring between two
+// frames loses whole zones, never half of one. Define PROFILE_DISABLED to
+// compile the zones out altogether.
+#define PROFILE_LATENCY     4     // frames between issuing a query and reading it
+#define PROFILE_MAX_SCOPES  64    // per frame
+#define PROFILE_MAX_DEPTH   16
+#define PROFILE_MAX_NAMES   64
+#define PROFILE_HISTORY     120   // frames the rolling stats cover
+#define PROFILE_MAX_THREADS 64
+#define PROFILE_RING_SIZE   4096  // zones per thread per frame, a power of two
+
+#ifdef PROFILE_DISABLED
+    #define PROFILE_ZONE_BEGIN(name)
+    #define PROFILE_ZONE_END()
+    #define PROFILE_THREAD_NAME(name)
+#else
+    #define PROFILE_ZONE_BEGIN(name)  profile_zone_begin(name)
+    #define PROFILE_ZONE_END()        profile_zone_end()
+    #define PROFILE_THREAD_NAME(name) profile_thread_name(name)
+#endif
+
+// Averages and peaks over the last PROFILE_HISTORY frames a scope ran in,
+// summing repeated scopes of one name within a frame. GPU values stay at
+// zero where timer queries are unsupported.
+typedef struct
+{
+    double cpu_avg;
+    double cpu_max;
+    double gpu_avg;
+    double gpu_max;
+    int    samples;
+} profile_stats_t;
+
+void profile_init(const char *trace_path);
+void profile_frame_begin(void);
+void profile_frame_end(void);
+void profile_begin(const char *name);
+void profile_end(void);
+bool profile_stats(const char *name, profile_stats_t *stats);
+void profile_summary(char *buffer, size_t size);
+void profile_shutdown(void);
+void profile_zone_begin(const char *name);
+void profile_zone_end(void);
+void profile_thread_name(const char *name);
+
+#ifdef PROFILE_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    #define PROFILE_RDTSC
+    #ifndef _MSC_VER
+        #include <x86intrin.h>
+    #endif
+#endif
+
+typedef struct
+{
+    int          name;
+    double       cpu_begin;   // seconds since profile_init()
+    double       cpu_end;
+    unsigned int query[2];    // GL_TIMESTAMP at begin and end
+} profile_scope_t;
+
+typedef struct
+{
+    profile_scope_t scopes[PROFILE_MAX_SCOPES];
+    int             count;
+    bool            pending;  // recorded but not read back yet
+} profile_frame_t;
+
+typedef struct
+{
+    const char *name;
+    bool        gpu;          // timed by profile_begin() rather than a zone only
+    float       cpu_ms[PROFILE_HISTORY];
+    float       gpu_ms[PROFILE_HISTORY];
+    int         next;
+    int         samples;
+} profile_name_t;
+
+typedef struct
+{
+    int    name;
+    int    row;               // 0 render thread scopes, 1 GPU, then one per zone thread
+    double begin_us;
+    double duration_us;
+} profile_event_t;
+
+typedef struct
+{
+    const char        *name;
+    unsigned long long begin;
+    unsigned long long end;
+} profile_zone_t;
+
+// Written only by its thread, except tail, which the render thread advances
+// as it drains.
+typedef struct
+{
+    profile_zone_t     ring[PROFILE_RING_SIZE];
+    volatile int       head;
+    volatile int       tail;
+    volatile int       dropped;
+    int                depth;
+    profile_zone_t     stack[PROFILE_MAX_DEPTH];
+    char               name[32];
+} profile_thread_t;
+
+// profile_epoch is what other threads look at: the current profile_init()
+// generation, or 0 while stopped, so a thread notices a restart and
+// registers again.
+static volatile int profile_epoch = 0;
+static int          profile_epochs = 0;
+static THREAD_LOCAL profile_thread_t *profile_local = NULL;
+static THREAD_LOCAL int               profile_local_epoch = 0;
+static THREAD_LOCAL const char       *profile_local_name = NULL;
+
+// Only the thread that owns the GL context records scopes and drains zones;
+// other threads touch nothing here but the thread registry.
+static struct
+{
+    bool             enabled;
+    bool             gpu;
+    double           origin;
+    long long        gpu_origin;   // GL_TIMESTAMP nanoseconds at profile_init()
+    long             frame;
+
+    profile_frame_t  frames[PROFILE_LATENCY];
+    unsigned int     queries[PROFILE_LATENCY * PROFILE_MAX_SCOPES * 2];
+    int              stack[PROFILE_MAX_DEPTH];
+    int              depth;
+
+    profile_name_t   names[PROFILE_MAX_NAMES];
+    int              name_count;
+
+    profile_thread_t *threads[PROFILE_MAX_THREADS];
+    volatile int      thread_ready[PROFILE_MAX_THREADS];
+    volatile int      thread_count;
+
+    unsigned long long tick_origin;
+    double             tick_origin_seconds;
+    double             ticks_per_second;
+
+    const char      *trace_path;
+    profile_event_t *events;
+    size_t           event_count;
+    size_t           event_capacity;
+} profile;
+
+// Seconds since profile_init() on the shared monotonic clock.
+static double profile_now(void)
+{
+    return thread_now() - profile.origin;
+}
+
+// The cycle counter where there is one: it is invariant and synchronised
+// across cores on anything this runs on, and far cheaper than a clock call.
+static inline unsigned long long profile_ticks(void)
+{
+#if defined(PROFILE_RDTSC)
+    return __rdtsc();
+#elif defined(_WIN32)
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+
+    return (unsigned long long) counter.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (unsigned long long) ts.tv_sec * 1000000000ull + (unsigned long long) ts.tv_nsec;
+#endif
+}
+
+// Ticks are matched against profile_now() over a couple of milliseconds at
+// startup and the match is stretched out every frame after that.
+static void profile_calibrate(void)
+{
+    unsigned long long ticks = profile_ticks();
+    double seconds = profile_now() - profile.tick_origin_seconds;
+
+    if (seconds > 0.0 && ticks > profile.tick_origin)
+        profile.ticks_per_second = (double) (ticks - profile.tick_origin) / seconds;
+
+    return;
+}
+
+static double profile_tick_seconds(unsigned long long ticks)
+{
+    return profile.tick_origin_seconds + ((double) ticks - (double) profile.tick_origin) / profile.ticks_per_second;
+}
+
+// trace_path may be NULL; with one, every resolved scope is kept and written
+// out as a Chrome trace (chrome://tracing, Perfetto) by profile_shutdown().
+void profile_init(const char *trace_path)
+{
+    memset(&profile, 0, sizeof(profile));
+    profile.origin = profile_now();
+    profile.trace_path = trace_path;
+    profile.enabled = true;
+
+    profile.tick_origin = profile_ticks();
+    profile.tick_origin_seconds = profile_now();
+    while (profile_now() - profile.tick_origin_seconds < 0.002)
+        ;
+    profile_calibrate();
+
+    GLint bits = 0;
+    glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+    profile.gpu = bits > 0;
+
+    if (profile.gpu)
+    {
+        glGenQueries(PROFILE_LATENCY * PROFILE_MAX_SCOPES * 2, profile.queries);
+
+        // the GPU clock has its own epoch, so pin it to the CPU one here
+        GLint64 gpu_now = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+        profile.gpu_origin = (long long) gpu_now - (long long) (profile_now() * 1e9);
+    }
+
+    for (int i = 0; i < PROFILE_LATENCY; i++)
+        for (int j = 0; j < PROFILE_MAX_SCOPES; j++)
+            for (int k = 0; k < 2; k++)
+                profile.frames[i].scopes[j].query[k] = profile.queries[(i * PROFILE_MAX_SCOPES + j) * 2 + k];
+
+    atomic_store_i32(&profile_epoch, ++profile_epochs);
+
+    return;
+}
+
+static int profile_intern(const char *name)
+{
+    // names are usually literals, so the pointer compare almost always hits
+    for (int i = 0; i < profile.name_count; i++)
+        if (profile.names[i].name == name || strcmp(profile.names[i].name, name) == 0)
+            return i;
+
+    if (profile.name_count == PROFILE_MAX_NAMES)
+    {
+        fprintf(stderr, "profile.h::error: more than %d scope names\n", PROFILE_MAX_NAMES);
+        exit(EXIT_FAILURE);
+    }
+
+    profile.names[profile.name_count].name = name;
+
+    return profile.name_count++;
+}
+
+static void profile_trace(int name, int row, double begin, double end)
+{
+    if (profile.trace_path == NULL)
+        return;
+
+    if (profile.event_count == profile.event_capacity)
+    {
+        size_t capacity = profile.event_capacity ? profile.event_capacity * 2 : 4096;
+        profile_event_t *events = (profile_event_t *) realloc(profile.events, capacity * sizeof(profile_event_t));
+        if (events == NULL)
+        {
+            fprintf(stderr, "profile.h::error: out of memory for trace events\n");
+            exit(EXIT_FAILURE);
+        }
+
+        profile.events = events;
+        profile.event_capacity = capacity;
+    }
+
+    profile_event_t *event = &profile.events[profile.event_count++];
+    event->name = name;
+    event->row = row;
+    event->begin_us = begin * 1e6;
+    event->duration_us = (end - begin) * 1e6;
+
+    return;
+}
+
+static void profile_record(const double *cpu_ms, const double *gpu_ms, const bool *seen)
+{
+    for (int i = 0; i < profile.name_count; i++)
+    {
+        if (!seen[i])
+            continue;
+
+        profile_name_t *name = &profile.names[i];
+        name->cpu_ms[name->next] = (float) cpu_ms[i];
+        name->gpu_ms[name->next] = (float) gpu_ms[i];
+        name->next = (name->next + 1) % PROFILE_HISTORY;
+        if (name->samples < PROFILE_HISTORY)
+            name->samples++;
+    }
+
+    return;
+}
+
+// Folds a frame's scopes into the rolling stats and the trace. The results
+// are normally long available; if the GPU is more than PROFILE_LATENCY
+// frames behind, GL_QUERY_RESULT waits for it.
+static void profile_resolve(profile_frame_t *frame)
+{
+    double cpu_ms[PROFILE_MAX_NAMES] = { 0 };
+    double gpu_ms[PROFILE_MAX_NAMES] = { 0 };
+    bool seen[PROFILE_MAX_NAMES] = { 0 };
+
+    for (int i = 0; i < frame->count; i++)
+    {
+        profile_scope_t *scope = &frame->scopes[i];
+
+        seen[scope->name] = true;
+        cpu_ms[scope->name] += (scope->cpu_end - scope->cpu_begin) * 1e3;
+        profile_trace(scope->name, 0, scope->cpu_begin, scope->cpu_end);
+
+        if (profile.gpu)
+        {
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(scope->query[0], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(scope->query[1], GL_QUERY_RESULT, &end);
+
+            gpu_ms[scope->name] += (double) (end - begin) * 1e-6;
+            profile_trace(scope->name, 1, ((long long) begin - profile.gpu_origin) * 1e-9, ((long long) end - profile.gpu_origin) * 1e-9);
+        }
+    }
+
+    profile_record(cpu_ms, gpu_ms, seen);
+
+    frame->count = 0;
+    frame->pending = false;
+
+    return;
+}
+
+void profile_frame_begin(void)
+{
+    if (!profile.enabled)
+        return;
+
+    profile_frame_t *frame = &profile.frames[profile.frame % PROFILE_LATENCY];
+    if (frame->pending)
+        profile_resolve(frame);
+
+    profile.depth = 0;
+
+    return;
+}
+
+// Empties every zone ring. Only the render thread consumes, so the tail
+// needs no more than a release store to hand the slots back.
+static void profile_drain(void)
+{
+    double cpu_ms[PROFILE_MAX_NAMES] = { 0 };
+    double gpu_ms[PROFILE_MAX_NAMES] = { 0 };
+    bool seen[PROFILE_MAX_NAMES] = { 0 };
+
+    profile_calibrate();
+
+    int thread_count = atomic_load_i32(&profile.thread_count);
+    for (int i = 0; i < thread_count && i < PROFILE_MAX_THREADS; i++)
+    {
+        if (!atomic_load_i32(&profile.thread_ready[i]))
+            continue;
+
+        profile_thread_t *thread = profile.threads[i];
+        unsigned int tail = (unsigned int) thread->tail;
+        unsigned int head = (unsigned int) atomic_load_acquire_i32(&thread->head);
+
+        for (; tail != head; tail++)
+        {
+            profile_zone_t *zone = &thread->ring[tail & (PROFILE_RING_SIZE - 1)];
+            int name = profile_intern(zone->name);
+            double begin = profile_tick_seconds(zone->begin);
+            double end = profile_tick_seconds(zone->end);
+
+            seen[name] = true;
+            cpu_ms[name] += (end - begin) * 1e3;
+            profile_trace(name, 2 + i, begin, end);
+        }
+
+        atomic_store_release_i32(&thread->tail, (int) tail);
+    }
+
+    profile_record(cpu_ms, gpu_ms, seen);
+
+    return;
+}
+
+void profile_frame_end(void)
+{
+    if (!profile.enabled)
+        return;
+
+    if (profile.depth != 0)
+    {
+        fprintf(stderr, "profile.h::error: \"%s\" is still open at the end of the frame\n", profile.names[profile.frames[profile.frame % PROFILE_LATENCY].scopes[profile.stack[profile.depth - 1]].name].name);
+        exit(EXIT_FAILURE);
+    }
+
+    profile.frames[profile.frame % PROFILE_LATENCY].pending = true;
+    profile.frame++;
+
+    profile_drain();
+
+    return;
+}
+
+void profile_begin(const char *name)
+{
+    if (!profile.enabled)
+        return;
+
+    profile_frame_t *frame = &profile.frames[profile.frame % PROFILE_LATENCY];
+    if (frame->count == PROFILE_MAX_SCOPES || profile.depth == PROFILE_MAX_DEPTH)
+    {
+        fprintf(stderr, "profile.h::error: more than %d scopes or %d levels in a frame\n", PROFILE_MAX_SCOPES, PROFILE_MAX_DEPTH);
+        exit(EXIT_FAILURE);
+    }
+
+    profile_scope_t *scope = &frame->scopes[frame->count];
+    scope->name = profile_intern(name);
+    profile.names[scope->name].gpu = true;
+    profile.stack[profile.depth++] = frame->count++;
+
+    if (profile.gpu)
+        glQueryCounter(scope->query[0], GL_TIMESTAMP);
+    scope->cpu_begin = profile_now();
+
+    return;
+}
+
+void profile_end(void)
+{
+    if (!profile.enabled)
+        return;
+
+    if (profile.depth == 0)
+    {
+        fprintf(stderr, "profile.h::error: profile_end() without profile_begin()\n");
+        exit(EXIT_FAILURE);
+    }
+
+    profile_scope_t *scope = &profile.frames[profile.frame % PROFILE_LATENCY].scopes[profile.stack[--profile.depth]];
+    scope->cpu_end = profile_now();
+    if (profile.gpu)
+        glQueryCounter(scope->query[1], GL_TIMESTAMP);
+
+    return;
+}
+
+bool profile_stats(const char *name, profile_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    for (int i = 0; i < profile.name_count; i++)
+    {
+        profile_name_t *entry = &profile.names[i];
+        if (strcmp(entry->name, name) != 0)
+            continue;
+
+        for (int j = 0; j < entry->samples; j++)
+        {
+            stats->cpu_avg += entry->cpu_ms[j];
+            stats->gpu_avg += entry->gpu_ms[j];
+            if (entry->cpu_ms[j] > stats->cpu_max)
+                stats->cpu_max = entry->cpu_ms[j];
+            if (entry->gpu_ms[j] > stats->gpu_max)
+                stats->gpu_max = entry->gpu_ms[j];
+        }
+
+        stats->samples = entry->samples;
+        if (entry->samples > 0)
+        {
+            stats->cpu_avg /= entry->samples;
+            stats->gpu_avg /= entry->samples;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+// One line, "name cpu/gpu ms" per scope in first seen order, short enough
+// for a window title.
+void profile_summary(char *buffer, size_t size)
+{
+    size_t length = 0;
+    buffer[0] = '\0';
+
+    for (int i = 0; i < profile.name_count && length < size; i++)
+    {
+        profile_stats_t stats;
+        profile_stats(profile.names[i].name, &stats);
+
+        int written;
+        if (profile.gpu && profile.names[i].gpu)
+            written = snprintf(buffer + length, size - length, "%s%s %.2f/%.2f ms", i ? " | " : "", profile.names[i].name, stats.cpu_avg, stats.gpu_avg);
+        else
+            written = snprintf(buffer + length, size - length, "%s%s %.2f ms", i ? " | " : "", profile.names[i].name, stats.cpu_avg);
+
+        if (written < 0)
+            break;
+        length += (size_t) written;
+    }
+
+    return;
+}
+
+static bool profile_write_trace(const char *path)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+        return false;
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"render\"}},\n");
+    fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"GPU\"}}");
+
+    // scope and thread names are identifiers chosen in code, so they need no escaping
+    for (int i = 0; i < profile.thread_count && i < PROFILE_MAX_THREADS; i++)
+        if (profile.thread_ready[i])
+            fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", 2 + i, profile.threads[i]->name);
+
+    for (size_t i = 0; i < profile.event_count; i++)
+    {
+        profile_event_t *event = &profile.events[i];
+        fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                profile.names[event->name].name, event->row == 1 ? "gpu" : "cpu", event->row, event->begin_us, event->duration_us);
+    }
+
+    fprintf(fp, "\n]}\n");
+
+    return fclose(fp) == 0;
+}
+
+// Reads back the frames still in flight, writes the trace if one was asked
+// for and releases the queries. Needs the GL context to still be current,
+// and every thread that records zones to be done with them.
+void profile_shutdown(void)
+{
+    if (!profile.enabled)
+        return;
+
+    atomic_store_i32(&profile_epoch, 0);
+    profile_drain();
+
+    for (int i = 0; i < PROFILE_LATENCY; i++)
+    {
+        profile_frame_t *frame = &profile.frames[(profile.frame + i) % PROFILE_LATENCY];
+        if (frame->pending)
+            profile_resolve(frame);
+    }
+
+    if (profile.trace_path && !profile_write_trace(profile.trace_path))
+        fprintf(stderr, "profile.h::error: cannot write trace \"%s\"\n", profile.trace_path);
+
+    if (profile.gpu)
+        glDeleteQueries(PROFILE_LATENCY * PROFILE_MAX_SCOPES * 2, profile.queries);
+
+    for (int i = 0; i < profile.thread_count && i < PROFILE_MAX_THREADS; i++)
+    {
+        if (profile.thread_ready[i] && profile.threads[i]->dropped)
+            fprintf(stderr, "profile.h::warning: %s dropped %d zones, raise PROFILE_RING_SIZE\n", profile.threads[i]->name, profile.threads[i]->dropped);
+        free(profile.threads[i]);
+    }
+
+    free(profile.events);
+    memset(&profile, 0, sizeof(profile));
+
+    return;
+}
+
+// First zone on a thread since profile_init(): give it a ring. Threads past
+// PROFILE_MAX_THREADS go untimed rather than stall anyone.
+static profile_thread_t *profile_register(int epoch)
+{
+    profile_local = NULL;
+    profile_local_epoch = epoch;
+
+    int index = atomic_add_i32(&profile.thread_count, 1);
+    if (index >= PROFILE_MAX_THREADS)
+        return NULL;
+
+    profile_thread_t *thread = (profile_thread_t *) calloc(1, sizeof(profile_thread_t));
+    if (thread == NULL)
+        return NULL;
+
+    if (profile_local_name)
+        snprintf(thread->name, sizeof(thread->name), "%s", profile_local_name);
+    else
+        snprintf(thread->name, sizeof(thread->name), "thread %d", index);
+    profile.threads[index] = thread;
+    atomic_store_i32(&profile.thread_ready[index], 1);
+
+    profile_local = thread;
+
+    return thread;
+}
+
+static inline profile_thread_t *profile_thread(void)
+{
+    int epoch = atomic_load_acquire_i32(&profile_epoch);
+    if (epoch == 0)
+        return NULL;
+    if (profile_local_epoch == epoch)
+        return profile_local;
+
+    return profile_register(epoch);
+}
+
+void profile_zone_begin(const char *name)
+{
+    profile_thread_t *thread = profile_thread();
+    if (thread == NULL)
+        return;
+
+    if (thread->depth < PROFILE_MAX_DEPTH)
+    {
+        thread->stack[thread->depth].name = name;
+        thread->stack[thread->depth].begin = profile_ticks();
+    }
+    thread->depth++;
+
+    return;
+}
+
+void profile_zone_end(void)
+{
+    profile_thread_t *thread = profile_thread();
+    if (thread == NULL || thread->depth == 0)
+        return;
+
+    unsigned long long end = profile_ticks();
+    if (--thread->depth >= PROFILE_MAX_DEPTH)
+        return;
+
+    unsigned int head = (unsigned int) thread->head;
+    if (head - (unsigned int) atomic_load_acquire_i32(&thread->tail) == PROFILE_RING_SIZE)
+    {
+        atomic_store_release_i32(&thread->dropped, thread->dropped + 1);
+        return;
+    }
+
+    profile_zone_t *zone = &thread->ring[head & (PROFILE_RING_SIZE - 1)];
+    *zone = thread->stack[thread->depth];
+    zone->end = end;
+    atomic_store_release_i32(&thread->head, (int) (head + 1));
+
+    return;
+}
+
+// Labels the calling thread's row in the trace. The name is kept, so it
+// can be set before profile_init() and survives a restart.
+void profile_thread_name(const char *name)
+{
+    profile_local_name = name;
+
+    profile_thread_t *thread = profile_thread();
+    if (thread)
+        snprintf(thread->name, sizeof(thread->name), "%s", name);
+
+    return;
+}
+
+#endif
@@ -0,0 +1,538 @@
+#pragma once
+
+#include <stdbool.h>
+#include <glad/glad.h>
+#include "glstats.h"
+#include "profile.h"
+#include "thread.h"
+#include "alloc.h"
+
+// A render thread that owns the GL context and replays command lists the
+// main thread records. There are two lists: while the render thread submits
+// frame N from one, the main thread simulates and records frame N + 1 into
+// the other, and only waits when it gets a whole frame ahead.
+//
+//   render_list_t *list = render_begin(&render);
+//   render_clear(list, 0.2f, 0.3f, 0.3f, 1.0f, GL_COLOR_BUFFER_BIT);
+//   render_draw_arrays(list, GL_TRIANGLES, 0, 36);
+//   render_present(list);
+//   render_submit(&render);
+//
+// Commands are fixed size and the lists are allocated once, at the capacity
+// given to render_init(), so recording a frame never allocates. Size them for
+// the scene: a list that fills up drops further state and draw commands,
+// counting them in render->dropped, but keeps room for calls and the present,
+// so the frame still begins and ends. Uniforms are set by name, and the
+// render thread caches the locations per program. Anything the list cannot
+// express goes through render_call(), which runs a function on the render
+// thread in order with the other commands; whatever it points at must outlive
+// the frame. Calls can take scratch memory from arena_frame(), which is reset
+// after every list.
+#define RENDER_MAX_UNIFORMS 32     // cached locations for the current program
+#define RENDER_RESERVED     64     // slots only calls and presents may use
+#define RENDER_ARENA_SIZE   (256 * 1024)
+
+typedef struct render_t render_t;
+
+// Context callbacks: make_current binds the context to the calling thread or
+// releases it, present shows the finished frame.
+typedef bool (*render_context_fn_t)(void *user, bool current);
+typedef void (*render_present_fn_t)(void *user);
+typedef void (*render_call_fn_t)(render_t *render, void *data);
+
+typedef enum
+{
+    RENDER_CMD_CLEAR,
+    RENDER_CMD_VIEWPORT,
+    RENDER_CMD_POLYGON_MODE,
+    RENDER_CMD_ENABLE,
+    RENDER_CMD_USE_PROGRAM,
+    RENDER_CMD_UNIFORM_INT,
+    RENDER_CMD_UNIFORM_MAT4,
+    RENDER_CMD_BIND_TEXTURE,
+    RENDER_CMD_BIND_VERTEX_ARRAY,
+    RENDER_CMD_DRAW_ARRAYS,
+    RENDER_CMD_CALL,
+    RENDER_CMD_PRESENT
+} render_command_type_t;
+
+typedef struct
+{
+    render_command_type_t type;
+    union
+    {
+        struct { float color[4]; unsigned int mask; }        clear;
+        struct { int x, y, width, height; }                  viewport;
+        struct { unsigned int value; }                       mode;        // polygon mode, enable
+        struct { unsigned int program; }                     program;
+        struct { const char *name; int value; }              uniform_int;
+        struct { const char *name; float m[16]; }            uniform_mat4;
+        struct { unsigned int target, texture; }             texture;
+        struct { unsigned int vao; }                         vertex_array;
+        struct { unsigned int mode; int first, count; }      draw;
+        struct { render_call_fn_t fn; void *data; }          call;
+    };
+} render_command_t;
+
+typedef struct
+{
+    render_command_t *commands;
+    int               count;
+    int               capacity;   // RENDER_RESERVED of it only for calls and presents
+    int               dropped;
+} render_list_t;
+
+typedef struct
+{
+    const char *name;
+    int         location;
+} render_uniform_t;
+
+struct render_t
+{
+    render_list_t       lists[2];
+    int                 recording;   // the list the main thread writes
+    int                 pending;     // submitted, not picked up yet; -1 for none
+    int                 executing;   // being replayed; -1 for none
+    bool                quit;
+    mutex_t             lock;
+    cond_t              submitted;
+    cond_t              finished;
+    thread_t            thread;
+    bool                running;
+    int                 started;     // 1 once the context is current there, -1 if it failed
+    render_context_fn_t make_current;
+    render_present_fn_t present;
+    void               *user;
+    long long           dropped;     // commands that did not fit, over all frames
+    // render thread only
+    arena_t             arena;
+    unsigned int        program;
+    render_uniform_t    uniforms[RENDER_MAX_UNIFORMS];
+    int                 uniform_count;
+};
+
+bool           render_init(render_t *render, int capacity, render_context_fn_t make_current, render_present_fn_t present, void *user);
+render_list_t *render_begin(render_t *render);
+void           render_submit(render_t *render);
+void           render_destroy(render_t *render);
+void           render_use_program(render_t *render, unsigned int program);
+int            render_uniform_location(render_t *render, const char *name);
+
+void render_clear(render_list_t *list, float r, float g, float b, float a, unsigned int mask);
+void render_viewport(render_list_t *list, int x, int y, int width, int height);
+void render_polygon_mode(render_list_t *list, unsigned int mode);
+void render_enable(render_list_t *list, unsigned int capability);
+void render_program(render_list_t *list, unsigned int program);
+void render_uniform_int(render_list_t *list, const char *name, int value);
+void render_uniform_mat4(render_list_t *list, const char *name, const float *m);
+void render_bind_texture(render_list_t *list, unsigned int target, unsigned int texture);
+void render_bind_vertex_array(render_list_t *list, unsigned int vao);
+void render_draw_arrays(render_list_t *list, unsigned int mode, int first, int count);
+void render_call(render_list_t *list, render_call_fn_t fn, void *data);
+void render_present(render_list_t *list);
+
+#ifdef RENDER_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static render_command_t *render_push(render_list_t *list, render_command_type_t type)
+{
+    int limit = (type == RENDER_CMD_CALL || type == RENDER_CMD_PRESENT) ? list->capacity : list->capacity - RENDER_RESERVED;
+    if (list->count >= limit)
+    {
+        list->dropped++;
+        return NULL;
+    }
+
+    render_command_t *command = &list->commands[list->count++];
+    command->type = type;
+
+    return command;
+}
+
+void render_use_program(render_t *render, unsigned int program)
+{
+    if (program != render->program)
+    {
+        render->program = program;
+        render->uniform_count = 0;
+    }
+
+    glUseProgram(program);
+
+    return;
+}
+
+// Names are compared by address first, so passing the same literal every
+// frame costs a pointer compare rather than a glGetUniformLocation().
+int render_uniform_location(render_t *render, const char *name)
+{
+    for (int i = 0; i < render->uniform_count; i++)
+        if (render->uniforms[i].name == name)
+            return render->uniforms[i].location;
+
+    for (int i = 0; i < render->uniform_count; i++)
+        if (strcmp(render->uniforms[i].name, name) == 0)
+            return render->uniforms[i].location;
+
+    int location = glGetUniformLocation(render->program, name);
+    if (render->uniform_count < RENDER_MAX_UNIFORMS)
+        render->uniforms[render->uniform_count++] = (render_uniform_t) { name, location };
+
+    return location;
+}
+
+static void render_execute(render_t *render, const render_list_t *list)
+{
+    for (int i = 0; i < list->count; i++)
+    {
+        const render_command_t *command = &list->commands[i];
+
+        switch (command->type)
+        {
+        case RENDER_CMD_CLEAR:
+            glClearColor(command->clear.color[0], command->clear.color[1], command->clear.color[2], command->clear.color[3]);
+            glClear(command->clear.mask);
+            break;
+        case RENDER_CMD_VIEWPORT:
+            glViewport(command->viewport.x, command->viewport.y, command->viewport.width, command->viewport.height);
+            break;
+        case RENDER_CMD_POLYGON_MODE:
+            glPolygonMode(GL_FRONT_AND_BACK, command->mode.value);
+            break;
+        case RENDER_CMD_ENABLE:
+            glEnable(command->mode.value);
+            break;
+        case RENDER_CMD_USE_PROGRAM:
+            render_use_program(render, command->program.program);
+            break;
+        case RENDER_CMD_UNIFORM_INT:
+            glUniform1i(render_uniform_location(render, command->uniform_int.name), command->uniform_int.value);
+            break;
+        case RENDER_CMD_UNIFORM_MAT4:
+            glUniformMatrix4fv(render_uniform_location(render, command->uniform_mat4.name), 1, GL_FALSE, command->uniform_mat4.m);
+            break;
+        case RENDER_CMD_BIND_TEXTURE:
+            glBindTexture(command->texture.target, command->texture.texture);
+            break;
+        case RENDER_CMD_BIND_VERTEX_ARRAY:
+            glBindVertexArray(command->vertex_array.vao);
+            break;
+        case RENDER_CMD_DRAW_ARRAYS:
+            glDrawArrays(command->draw.mode, command->draw.first, command->draw.count);
+            break;
+        case RENDER_CMD_CALL:
+            command->call.fn(render, command->call.data);
+            break;
+        case RENDER_CMD_PRESENT:
+            if (render->present)
+                render->present(render->user);
+            break;
+        }
+    }
+
+    return;
+}
+
+static void *render_thread(void *arg)
+{
+    render_t *render = (render_t *) arg;
+
+    PROFILE_THREAD_NAME("render");
+    arena_bind(&render->arena);
+    alloc_count_thread(true);
+    bool current = render->make_current(render->user, true);
+
+    mutex_lock(&render->lock);
+    render->started = current ? 1 : -1;
+    cond_broadcast(&render->finished);
+    if (!current)
+    {
+        mutex_unlock(&render->lock);
+        return NULL;
+    }
+
+    for (;;)
+    {
+        while (render->pending < 0 && !render->quit)
+            cond_wait(&render->submitted, &render->lock);
+
+        // a list submitted before render_destroy() still gets drawn
+        if (render->pending < 0)
+            break;
+
+        render->executing = render->pending;
+        render->pending = -1;
+        mutex_unlock(&render->lock);
+
+        render_execute(render, &render->lists[render->executing]);
+        arena_reset(&render->arena);
+
+        mutex_lock(&render->lock);
+        render->executing = -1;
+        cond_broadcast(&render->finished);
+    }
+    mutex_unlock(&render->lock);
+
+    glFinish();
+    render->make_current(render->user, false);
+
+    return NULL;
+}
+
+// The calling thread must have the context current; it is handed to the
+// render thread here and comes back in render_destroy(). capacity is the
+// number of state and draw commands a frame can record.
+bool render_init(render_t *render, int capacity, render_context_fn_t make_current, render_present_fn_t present, void *user)
+{
+    memset(render, 0, sizeof(*render));
+    render->pending = -1;
+    render->executing = -1;
+    render->make_current = make_current;
+    render->present = present;
+    render->user = user;
+
+    if (!arena_init(&render->arena, RENDER_ARENA_SIZE))
+        return false;
+
+    for (int i = 0; i < 2; i++)
+    {
+        render->lists[i].capacity = capacity + RENDER_RESERVED;
+        render->lists[i].commands = (render_command_t *) malloc((size_t) render->lists[i].capacity * sizeof(render_command_t));
+        if (render->lists[i].commands == NULL)
+        {
+            fprintf(stderr, "render.h::error: out of memory for command lists of %d\n", capacity);
+            free(render->lists[0].commands);
+            arena_destroy(&render->arena);
+            return false;
+        }
+    }
+
+    mutex_init(&render->lock);
+    cond_init(&render->submitted);
+    cond_init(&render->finished);
+
+    make_current(user, false);
+    if (!thread_create(&render->thread, render_thread, render))
+    {
+        fprintf(stderr, "render.h::error: cannot start the render thread\n");
+        make_current(user, true);
+        render_destroy(render);
+        return false;
+    }
+    render->running = true;
+
+    // no GL command may run until the context is known to have moved
+    mutex_lock(&render->lock);
+    while (render->started == 0)
+        cond_wait(&render->finished, &render->lock);
+    mutex_unlock(&render->lock);
+
+    if (render->started < 0)
+    {
+        fprintf(stderr, "render.h::error: cannot make the context current on the render thread\n");
+        render_destroy(render);
+        return false;
+    }
+
+    return true;
+}
+
+// Waits until the render thread has picked up the last list and is done
+// with the one to record into, which only happens when recording runs a full
+// frame ahead.
+render_list_t *render_begin(render_t *render)
+{
+    mutex_lock(&render->lock);
+    while (render->pending >= 0 || render->executing == render->recording)
+        cond_wait(&render->finished, &render->lock);
+    mutex_unlock(&render->lock);
+
+    render_list_t *list = &render->lists[render->recording];
+    list->count = 0;
+    list->dropped = 0;
+
+    return list;
+}
+
+void render_submit(render_t *render)
+{
+    render_list_t *list = &render->lists[render->recording];
+    if (list->dropped && render->dropped == 0)
+        fprintf(stderr, "render.h::error: %d commands did not fit in a list of %d\n", list->dropped, list->capacity - RENDER_RESERVED);
+    render->dropped += list->dropped;
+
+    mutex_lock(&render->lock);
+    render->pending = render->recording;
+    render->recording ^= 1;
+    cond_signal(&render->submitted);
+    mutex_unlock(&render->lock);
+
+    return;
+}
+
+// Draws whatever was submitted, stops the render thread and makes the
+// context current on the calling thread again.
+void render_destroy(render_t *render)
+{
+    if (render->running)
+    {
+        mutex_lock(&render->lock);
+        render->quit = true;
+        cond_signal(&render->submitted);
+        mutex_unlock(&render->lock);
+
+        thread_join(&render->thread);
+        render->make_current(render->user, true);
+
+        mutex_destroy(&render->lock);
+        cond_destroy(&render->submitted);
+        cond_destroy(&render->finished);
+    }
+
+    free(render->lists[0].commands);
+    free(render->lists[1].commands);
+    arena_destroy(&render->arena);
+    memset(render, 0, sizeof(*render));
+
+    return;
+}
+
+void render_clear(render_list_t *list, float r, float g, float b, float a, unsigned int mask)
+{
+    render_command_t *command = render_push(list, RENDER_CMD_CLEAR);
+    if (command)
+    {
+        command->clear.color[0] = r;
+        command->clear.color[1] = g;
+        command->clear.color[2] = b;
+        command->clear.color[3] = a;
+        command->clear.mask = mask;
+    }
+
+    return;
+}
+
+void render_viewport(render_list_t *list, int x, int y, int width, int height)
+{
+    render_command_t *command = render_push(list, RENDER_CMD_VIEWPORT);
+    if (command)
+    {
+        command->viewport.x = x;
+        command->viewport.y = y;
+        command->viewport.width = width;
+        command->viewport.height = height;
+    }
+
+    return;
+}
+
+void render_polygon_mode(render_list_t *list, unsigned int mode)
+{
+    render_command_t *command = render_push(list, RENDER_CMD_POLYGON_MODE);
+    if (command)
+        command->mode.value = mode;
+
+    return;
+}
+
+void render_enable(render_list_t *list, unsigned int capability)
+{
+    render_command_t *command = render_push(list, RENDER_CMD_ENABLE);
+    if (command)
+        command->mode.value = capability;
+
+    return;
+}
+
+void render_program(render_list_t *list, unsigned int program)
+{
+    render_command_t *command = render_push(list, RENDER_CMD_USE_PROGRAM);
+    if (command)
+        command->program.program = program;
+
+    return;
+}
+
+// The location cache keeps name, so it must outlive the program; use literals.
+void render_uniform_int(render_list_t *list, const char *name, int value)
+{
+    render_command_t *command = render_push(list, RENDER_CMD_UNIFORM_INT);
+    if (command)
+    {
+        command->uniform_int.name = name;
+        command->uniform_int.value = value;
+    }
+
+    return;
+}
+
+void render_uniform_mat4(render_list_t *list, const char *name, const float *m)
+{
+    render_command_t *command = render_push(list, RENDER_CMD_UNIFORM_MAT4);
+    if (command)
+    {
+        command->uniform_mat4.name = name;
+        memcpy(command->uniform_mat4.m, m, sizeof(command->uniform_mat4.m));
+    }
+
+    return;
+}
+
+void render_bind_texture(render_list_t *list, unsigned int target, unsigned int texture)
+{
+    render_command_t *command = render_push(list, RENDER_CMD_BIND_TEXTURE);
+    if (command)
+    {
+        command->texture.target = target;
+        command->texture.texture = texture;
+    }
+
+    return;
+}
+
+void render_bind_vertex_array(render_list_t *list, unsigned int vao)
+{
+    render_command_t *command = render_push(list, RENDER_CMD_BIND_VERTEX_ARRAY);
+    if (command)
+        command->vertex_array.vao = vao;
+
+    return;
+}
+
+void render_draw_arrays(render_list_t *list, unsigned int mode, int first, int count)
+{
+    render_command_t *command = render_push(list, RENDER_CMD_DRAW_ARRAYS);
+    if (command)
+    {
+        command->draw.mode = mode;
+        command->draw.first = first;
+        command->draw.count = count;
+    }
+
+    return;
+}
+
+void render_call(render_list_t *list, render_call_fn_t fn, void *data)
+{
+    render_command_t *command = render_push(list, RENDER_CMD_CALL);
+    if (command)
+    {
+        command->call.fn = fn;
+        command->call.data = data;
+    }
+
+    return;
+}
+
+void render_present(render_list_t *list)
+{
+    render_push(list, RENDER_CMD_PRESENT);
+
+    return;
+}
+
+#endif
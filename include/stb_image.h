@@ -274,6 +274,11 @@ RECENT REVISION HISTORY:
 // you have issues compiling it, you can disable it entirely by
 // defining STBI_NO_SIMD.
 //
+// On x86 the JPEG IDCT, YCbCr conversion and 2x2 chroma upsampling also have
+// AVX2 versions that are chosen at run time on CPUs that support them; they
+// produce exactly the same output as the SSE2 and C paths. Define STBI_NO_AVX2
+// to compile them out.
+//
 // ===========================================================================
 //
 // HDR image support   (disable by defining STBI_NO_HDR)
@@ -437,6 +442,66 @@ STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int *
 STBIDEF int stbi_convert_wchar_to_utf8(char *buffer, size_t bufferlen, const wchar_t* input);
 #endif
 
+////////////////////////////////////
+//
+// per-call options
+//
+// stbi_parallel_for must run task(task_data, i) for every i in [0, count),
+// in any order and on any threads, and return only once all of them finished.
+// When one is supplied, large JPEGs run IDCT and color conversion through it
+// once entropy decoding (which is inherently serial) is done.
+//
+// The returned image normally comes from STBI_MALLOC and is released with
+// stbi_image_free. Setting 'buffer' decodes into caller memory instead (a
+// mapped pixel buffer, an arena...): it must hold x*y*channels bytes, which
+// stbi_info reports up front, and the call returns 'buffer' itself or NULL
+// with "buffer too small". Alternatively 'alloc' and 'free' supply the
+// allocation for the returned image, which the caller then releases through
+// its own allocator. JPEG and 8-bit PNG decode straight into that memory;
+// other formats are decoded as usual and copied over once.
+//
+// 'flip_vertically' overrides stbi_set_flip_vertically_on_load for this call
+// only (1 flips, -1 does not, 0 follows the global or per-thread setting).
+// JPEG, PNG, BMP and TGA store their rows bottom-up as they are decoded,
+// other formats are flipped in an extra pass once loaded.
+//
+// 'rows' is called with bands of finished output rows while the load is
+// still running: 'count' rows starting at row 'y' of the returned image, each
+// width*channels bytes and only valid during the call. Bands come top to
+// bottom, or bottom to top when the image is flipped. Together with stbi_load_from_callbacks_ex this decodes incrementally:
+// baseline JPEG hands out rows per MCU row and non-interlaced 8-bit PNG as
+// IDAT data is read, provided the requested channel count needs no
+// conversion afterwards (PNG: no palette or tRNS either). Every other image
+// is handed out in one band just before the load returns. 8-bit loads only.
+
+typedef void stbi_parallel_task(void *task_data, int index);
+typedef void stbi_parallel_for(void *pool, int count, stbi_parallel_task *task, void *task_data);
+typedef void stbi_rows_callback(void *user, stbi_uc const *pixels, int width, int height, int channels, int y, int count);
+
+typedef struct
+{
+   stbi_parallel_for *parallel_for;   // NULL decodes on the calling thread
+   void              *pool;
+
+   stbi_uc           *buffer;         // NULL allocates the result
+   size_t             buffer_size;
+
+   void             *(*alloc)(void *user, size_t size);
+   void              (*free)(void *user, void *ptr);  // only called on error paths
+   void              *alloc_user;
+
+   stbi_rows_callback *rows;          // NULL only returns the finished image
+   void              *rows_user;
+
+   int                flip_vertically;  // 0 follows stbi_set_flip_vertically_on_load
+} stbi_load_options;
+
+STBIDEF stbi_uc *stbi_load_from_memory_ex   (stbi_uc           const *buffer, int len   , int *x, int *y, int *channels_in_file, int desired_channels, stbi_load_options const *options);
+STBIDEF stbi_uc *stbi_load_from_callbacks_ex(stbi_io_callbacks const *clbk  , void *user, int *x, int *y, int *channels_in_file, int desired_channels, stbi_load_options const *options);
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_uc *stbi_load_ex               (char const *filename, int *x, int *y, int *channels_in_file, int desired_channels, stbi_load_options const *options);
+#endif
+
 ////////////////////////////////////
 //
 // 16-bits-per-channel interface
@@ -643,12 +708,18 @@ typedef unsigned short stbi__uint16;
 typedef   signed short stbi__int16;
 typedef unsigned int   stbi__uint32;
 typedef   signed int   stbi__int32;
+#ifdef _MSC_VER
+typedef unsigned __int64 stbi__uint64;
+#else
+typedef unsigned long long stbi__uint64;
+#endif
 #else
 #include <stdint.h>
 typedef uint16_t stbi__uint16;
 typedef int16_t  stbi__int16;
 typedef uint32_t stbi__uint32;
 typedef int32_t  stbi__int32;
+typedef uint64_t stbi__uint64;
 #endif
 
 // should produce compiler error if size is wrong
@@ -774,6 +845,46 @@ static int stbi__sse2_available(void)
 #endif
 #endif
 
+// AVX2 kernels are compiled alongside the SSE2 ones and picked at run time, so
+// the build does not need -mavx2. Define STBI_NO_AVX2 to leave them out.
+#if defined(STBI_SSE2) && !defined(STBI_NO_AVX2) && !defined(STBI_NO_JPEG)
+#if defined(_MSC_VER) && !defined(__clang__)
+   #if _MSC_VER >= 1800
+      #define STBI_AVX2
+   #endif
+#elif defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5)
+   #define STBI_AVX2
+#endif
+#endif
+
+#ifdef STBI_AVX2
+#include <immintrin.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define STBI__AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define STBI__AVX2_TARGET
+#endif
+
+#ifdef _MSC_VER
+static int stbi__avx2_available(void)
+{
+   int info[4];
+   __cpuid(info,1);
+   // AVX2 also needs the OS to save the ymm registers (OSXSAVE + XCR0 bits 1, 2)
+   if (((info[2] >> 27) & 1) == 0 || ((info[2] >> 28) & 1) == 0) return 0;
+   if ((_xgetbv(0) & 6) != 6) return 0;
+   __cpuidex(info,7,0);
+   return ((info[1] >> 5) & 1) != 0;
+}
+#else
+static int stbi__avx2_available(void)
+{
+   return __builtin_cpu_supports("avx2");
+}
+#endif
+#endif
+
 // ARM NEON
 #if defined(STBI_NO_SIMD) && defined(STBI_NEON)
 #undef STBI_NEON
@@ -817,6 +928,12 @@ typedef struct
 
    stbi_uc *img_buffer, *img_buffer_end;
    stbi_uc *img_buffer_original, *img_buffer_original_end;
+
+   stbi_load_options const *options;
+   void *image_out;            // result placed as options asked, see stbi__malloc_image
+   int image_out_too_small;
+   stbi__uint32 rows_done;     // rows handed to stbi_load_options.rows so far
+   int flipped;                // the loader stored its rows bottom-up, see stbi__flip_on_load
 } stbi__context;
 
 
@@ -830,6 +947,11 @@ static void stbi__start_mem(stbi__context *s, stbi_uc const *buffer, int len)
    s->callback_already_read = 0;
    s->img_buffer = s->img_buffer_original = (stbi_uc *) buffer;
    s->img_buffer_end = s->img_buffer_original_end = (stbi_uc *) buffer+len;
+   s->options = NULL;
+   s->image_out = NULL;
+   s->image_out_too_small = 0;
+   s->rows_done = 0;
+   s->flipped = 0;
 }
 
 // initialize a callback-based context
@@ -843,6 +965,11 @@ static void stbi__start_callbacks(stbi__context *s, stbi_io_callbacks *c, void *
    s->img_buffer = s->img_buffer_original = s->buffer_start;
    stbi__refill_buffer(s);
    s->img_buffer_original_end = s->img_buffer_end;
+   s->options = NULL;
+   s->image_out = NULL;
+   s->image_out_too_small = 0;
+   s->rows_done = 0;
+   s->flipped = 0;
 }
 
 #ifndef STBI_NO_STDIO
@@ -1058,6 +1185,35 @@ static void *stbi__malloc_mad3(int a, int b, int c, int add)
    return stbi__malloc(a*b*c + add);
 }
 
+// allocates an image that a loader returns unchanged, so it can live where
+// stbi_load_options asks
+static void *stbi__malloc_image(stbi__context *s, int a, int b, int c)
+{
+   stbi_load_options const *o = s->options;
+   if (!stbi__mad3sizes_valid(a, b, c, 0)) return NULL;
+   if (o && o->buffer) {
+      if ((size_t) a*b*c > o->buffer_size) {
+         s->image_out_too_small = 1;
+         return NULL;
+      }
+      return s->image_out = o->buffer;
+   }
+   if (o && o->alloc)
+      return s->image_out = o->alloc(o->alloc_user, (size_t) a*b*c);
+   return stbi__malloc(a*b*c);
+}
+
+static void stbi__free_image(stbi__context *s, void *p)
+{
+   if (p != NULL && p == s->image_out) {
+      stbi_load_options const *o = s->options;
+      s->image_out = NULL;
+      if (!o->buffer) o->free(o->alloc_user, p);
+      return;
+   }
+   STBI_FREE(p);
+}
+
 #if !defined(STBI_NO_LINEAR) || !defined(STBI_NO_HDR) || !defined(STBI_NO_PNM)
 static void *stbi__malloc_mad4(int a, int b, int c, int d, int add)
 {
@@ -1134,6 +1290,15 @@ STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_fli
                                          : stbi__vertically_flip_on_load_global)
 #endif // STBI_THREAD_LOCAL
 
+// whether this load should be flipped; a loader that stores its rows in that
+// order while decoding sets s->flipped, which skips the separate flip pass
+static int stbi__flip_on_load(stbi__context *s)
+{
+   if (s->options && s->options->flip_vertically)
+      return s->options->flip_vertically > 0;
+   return stbi__vertically_flip_on_load;
+}
+
 static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
 {
    memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
@@ -1257,13 +1422,54 @@ static void stbi__vertical_flip_slices(void *image, int w, int h, int z, int byt
 }
 #endif
 
+// the loader returned an image in its own memory; move it to where the
+// caller's options want it
+static stbi_uc *stbi__place_image(stbi__context *s, stbi_uc *image, size_t size)
+{
+   stbi_load_options const *o = s->options;
+   stbi_uc *dest;
+   if (o->buffer) {
+      if (size > o->buffer_size) {
+         STBI_FREE(image);
+         return stbi__errpuc("buffer too small", "Output buffer too small");
+      }
+      dest = o->buffer;
+   } else {
+      dest = (stbi_uc *) o->alloc(o->alloc_user, size);
+      if (dest == NULL) {
+         STBI_FREE(image);
+         return stbi__errpuc("outofmem", "Out of memory");
+      }
+   }
+   memcpy(dest, image, size);
+   STBI_FREE(image);
+   s->image_out = dest;
+   return dest;
+}
+
+// hands decoded rows [s->rows_done, y1) of an image to stbi_load_options.rows;
+// a flipped image holds them at the bottom, in reverse
+static void stbi__emit_rows(stbi__context *s, stbi_uc *image, int x, int y, int channels, stbi__uint32 y1)
+{
+   stbi_load_options const *o = s->options;
+   if (o && o->rows && y1 > s->rows_done) {
+      size_t stride = (size_t) x * channels;
+      int first = s->flipped ? y - (int) y1 : (int) s->rows_done;
+      o->rows(o->rows_user, image + stride * first, x, y, channels, first, (int) (y1 - s->rows_done));
+      s->rows_done = y1;
+   }
+}
+
 static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
    stbi__result_info ri;
    void *result = stbi__load_main(s, x, y, comp, req_comp, &ri, 8);
 
-   if (result == NULL)
+   if (result == NULL) {
+      if (s->image_out_too_small)
+         return stbi__errpuc("buffer too small", "Output buffer too small");
       return NULL;
+   }
 
    // it is the responsibility of the loaders to make sure we get either 8 or 16 bit.
    STBI_ASSERT(ri.bits_per_channel == 8 || ri.bits_per_channel == 16);
@@ -1271,15 +1477,27 @@ static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x,
    if (ri.bits_per_channel != 8) {
       result = stbi__convert_16_to_8((stbi__uint16 *) result, *x, *y, req_comp == 0 ? *comp : req_comp);
       ri.bits_per_channel = 8;
+      if (result == NULL) return NULL;
+   }
+
+   if (s->options && (s->options->buffer || s->options->alloc) && result != s->image_out) {
+      int channels = req_comp ? req_comp : *comp;
+      result = stbi__place_image(s, (stbi_uc *) result, (size_t) *x * *y * channels);
+      if (result == NULL) return NULL;
    }
 
    // @TODO: move stbi__convert_format to here
 
-   if (stbi__vertically_flip_on_load) {
+   // loaders that stream rows also store them flipped, so rows_done is 0 here
+   if (stbi__flip_on_load(s) && !s->flipped) {
       int channels = req_comp ? req_comp : *comp;
       stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi_uc));
+      s->flipped = 1;
    }
 
+   // whatever the loader did not stream goes out in one band
+   stbi__emit_rows(s, (stbi_uc *) result, *x, *y, req_comp ? req_comp : *comp, (stbi__uint32) *y);
+
    return (unsigned char *) result;
 }
 
@@ -1302,7 +1520,7 @@ static stbi__uint16 *stbi__load_and_postprocess_16bit(stbi__context *s, int *x,
    // @TODO: move stbi__convert_format16 to here
    // @TODO: special case RGB-to-Y (and RGBA-to-YA) for 8-bit-to-16-bit case to keep more precision
 
-   if (stbi__vertically_flip_on_load) {
+   if (stbi__flip_on_load(s) && !s->flipped) {
       int channels = req_comp ? req_comp : *comp;
       stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi__uint16));
    }
@@ -1386,6 +1604,19 @@ STBIDEF stbi_uc *stbi_load_from_file(FILE *f, int *x, int *y, int *comp, int req
    return result;
 }
 
+STBIDEF stbi_uc *stbi_load_ex(char const *filename, int *x, int *y, int *comp, int req_comp, stbi_load_options const *options)
+{
+   FILE *f = stbi__fopen(filename, "rb");
+   unsigned char *result;
+   stbi__context s;
+   if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
+   stbi__start_file(&s,f);
+   s.options = options;
+   result = stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
+   fclose(f);
+   return result;
+}
+
 STBIDEF stbi__uint16 *stbi_load_from_file_16(FILE *f, int *x, int *y, int *comp, int req_comp)
 {
    stbi__uint16 *result;
@@ -1440,6 +1671,22 @@ STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *u
    return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
 }
 
+STBIDEF stbi_uc *stbi_load_from_memory_ex(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp, stbi_load_options const *options)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   s.options = options;
+   return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
+}
+
+STBIDEF stbi_uc *stbi_load_from_callbacks_ex(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp, stbi_load_options const *options)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   s.options = options;
+   return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
+}
+
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp)
 {
@@ -1672,7 +1919,13 @@ static int stbi__getn(stbi__context *s, stbi_uc *buffer, int n)
 
          memcpy(buffer, s->img_buffer, blen);
 
-         count = (s->io.read)(s->io_user_data, (char*) buffer + blen, n - blen);
+         // streaming sources may return less than asked for before the end
+         count = 0;
+         while (count < n - blen) {
+            res = (s->io.read)(s->io_user_data, (char*) buffer + blen + count, n - blen - count);
+            if (res <= 0) break;
+            count += res;
+         }
          res = (count == (n-blen));
          s->img_buffer = s->img_buffer_end;
          return res;
@@ -1993,9 +2246,12 @@ typedef struct
 
    int scan_n, order[4];
    int restart_interval, todo;
+   int deferred_idct;  // baseline blocks are kept as coefficients and transformed in stbi__jpeg_finish
+   void *stream;       // stbi__jpeg_output when rows are converted while decoding, else NULL
 
 // kernels
    void (*idct_block_kernel)(stbi_uc *out, int out_stride, short data[64]);
+   void (*idct_block2_kernel)(stbi_uc *out0, stbi_uc *out1, int out_stride, short *data0, short *data1); // two blocks at once, or NULL
    void (*YCbCr_to_RGB_kernel)(stbi_uc *out, const stbi_uc *y, const stbi_uc *pcb, const stbi_uc *pcr, int count, int step);
    stbi_uc *(*resample_row_hv_2_kernel)(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs);
 } stbi__jpeg;
@@ -2207,6 +2463,17 @@ static const stbi_uc stbi__jpeg_dezigzag[64+15] =
 };
 
 // decode one 64-entry block--
+// below this many pixels the hand-off to a thread pool costs more than it saves
+#ifndef STBI_PARALLEL_MIN_PIXELS
+#define STBI_PARALLEL_MIN_PIXELS (256*256)
+#endif
+
+static int stbi__jpeg_parallel(stbi__jpeg *z)
+{
+   return z->s->options && z->s->options->parallel_for &&
+          (double) z->s->img_x * z->s->img_y >= STBI_PARALLEL_MIN_PIXELS;
+}
+
 static int stbi__jpeg_decode_block(stbi__jpeg *j, short data[64], stbi__huffman *hdc, stbi__huffman *hac, stbi__int16 *fac, int b, stbi__uint16 *dequant)
 {
    int diff,dc,k;
@@ -2704,6 +2971,198 @@ static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
 
 #endif // STBI_SSE2
 
+#ifdef STBI_AVX2
+// avx2 integer IDCT of two blocks at once, bit-identical to stbi__idct_simd
+static STBI__AVX2_TARGET void stbi__idct_avx2(stbi_uc *out0, stbi_uc *out1, int out_stride, short *data0, short *data1)
+{
+   // Same arithmetic as stbi__idct_simd; every AVX2 op used here works within
+   // 128-bit lanes, so lane 0 transforms data0 and lane 1 transforms data1.
+   __m256i row0, row1, row2, row3, row4, row5, row6, row7;
+   __m256i tmp;
+
+   // dot product constant: even elems=x, odd elems=y
+   #define dct_const(x,y)  _mm256_setr_epi16((x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y))
+
+   // out(0) = c0[even]*x + c0[odd]*y   (c0, x, y 16-bit, out 32-bit)
+   // out(1) = c1[even]*x + c1[odd]*y
+   #define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##lo = _mm256_unpacklo_epi16((x),(y)); \
+      __m256i c0##hi = _mm256_unpackhi_epi16((x),(y)); \
+      __m256i out0##_l = _mm256_madd_epi16(c0##lo, c0); \
+      __m256i out0##_h = _mm256_madd_epi16(c0##hi, c0); \
+      __m256i out1##_l = _mm256_madd_epi16(c0##lo, c1); \
+      __m256i out1##_h = _mm256_madd_epi16(c0##hi, c1)
+
+   // out = in << 12  (in 16-bit, out 32-bit)
+   #define dct_widen(out, in) \
+      __m256i out##_l = _mm256_srai_epi32(_mm256_unpacklo_epi16(_mm256_setzero_si256(), (in)), 4); \
+      __m256i out##_h = _mm256_srai_epi32(_mm256_unpackhi_epi16(_mm256_setzero_si256(), (in)), 4)
+
+   // wide add
+   #define dct_wadd(out, a, b) \
+      __m256i out##_l = _mm256_add_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_add_epi32(a##_h, b##_h)
+
+   // wide sub
+   #define dct_wsub(out, a, b) \
+      __m256i out##_l = _mm256_sub_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_sub_epi32(a##_h, b##_h)
+
+   // butterfly a/b, add bias, then shift by "s" and pack
+   #define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased_l = _mm256_add_epi32(a##_l, bias); \
+         __m256i abiased_h = _mm256_add_epi32(a##_h, bias); \
+         dct_wadd(sum, abiased, b); \
+         dct_wsub(dif, abiased, b); \
+         out0 = _mm256_packs_epi32(_mm256_srai_epi32(sum_l, s), _mm256_srai_epi32(sum_h, s)); \
+         out1 = _mm256_packs_epi32(_mm256_srai_epi32(dif_l, s), _mm256_srai_epi32(dif_h, s)); \
+      }
+
+   // 8-bit interleave step (for transposes)
+   #define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi8(a, b); \
+      b = _mm256_unpackhi_epi8(tmp, b)
+
+   // 16-bit interleave step (for transposes)
+   #define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi16(a, b); \
+      b = _mm256_unpackhi_epi16(tmp, b)
+
+   #define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m256i sum04 = _mm256_add_epi16(row0, row4); \
+         __m256i dif04 = _mm256_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         dct_wadd(x0, t0e, t3e); \
+         dct_wsub(x3, t0e, t3e); \
+         dct_wadd(x1, t1e, t2e); \
+         dct_wsub(x2, t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m256i sum17 = _mm256_add_epi16(row1, row7); \
+         __m256i sum35 = _mm256_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         dct_wadd(x4, y0o, y4o); \
+         dct_wadd(x5, y1o, y5o); \
+         dct_wadd(x6, y2o, y5o); \
+         dct_wadd(x7, y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+   __m256i rot0_0 = dct_const(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+   __m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f( 0.765366865f), stbi__f2f(0.5411961f));
+   __m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f));
+   __m256i rot1_1 = dct_const(stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+   __m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f( 0.298631336f), stbi__f2f(-1.961570560f));
+   __m256i rot2_1 = dct_const(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f( 3.072711026f));
+   __m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f( 2.053119869f), stbi__f2f(-0.390180644f));
+   __m256i rot3_1 = dct_const(stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f( 1.501321110f));
+
+   // rounding biases in column/row passes, see stbi__idct_block for explanation.
+   __m256i bias_0 = _mm256_set1_epi32(512);
+   __m256i bias_1 = _mm256_set1_epi32(65536 + (128<<17));
+
+   // load
+   #define dct_load2(r) _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_load_si128((const __m128i *) (data0 + (r)*8))), \
+                                            _mm_load_si128((const __m128i *) (data1 + (r)*8)), 1)
+   row0 = dct_load2(0);
+   row1 = dct_load2(1);
+   row2 = dct_load2(2);
+   row3 = dct_load2(3);
+   row4 = dct_load2(4);
+   row5 = dct_load2(5);
+   row6 = dct_load2(6);
+   row7 = dct_load2(7);
+
+   // column pass
+   dct_pass(bias_0, 10);
+
+   {
+      // 16bit 8x8 transpose pass 1
+      dct_interleave16(row0, row4);
+      dct_interleave16(row1, row5);
+      dct_interleave16(row2, row6);
+      dct_interleave16(row3, row7);
+
+      // transpose pass 2
+      dct_interleave16(row0, row2);
+      dct_interleave16(row1, row3);
+      dct_interleave16(row4, row6);
+      dct_interleave16(row5, row7);
+
+      // transpose pass 3
+      dct_interleave16(row0, row1);
+      dct_interleave16(row2, row3);
+      dct_interleave16(row4, row5);
+      dct_interleave16(row6, row7);
+   }
+
+   // row pass
+   dct_pass(bias_1, 17);
+
+   {
+      // pack
+      __m256i p0 = _mm256_packus_epi16(row0, row1); // a0a1a2a3...a7b0b1b2b3...b7
+      __m256i p1 = _mm256_packus_epi16(row2, row3);
+      __m256i p2 = _mm256_packus_epi16(row4, row5);
+      __m256i p3 = _mm256_packus_epi16(row6, row7);
+
+      // 8bit 8x8 transpose pass 1
+      dct_interleave8(p0, p2); // a0e0a1e1...
+      dct_interleave8(p1, p3); // c0g0c1g1...
+
+      // transpose pass 2
+      dct_interleave8(p0, p1); // a0c0e0g0...
+      dct_interleave8(p2, p3); // b0d0f0h0...
+
+      // transpose pass 3
+      dct_interleave8(p0, p2); // a0b0c0d0...
+      dct_interleave8(p1, p3); // a4b4c4d4...
+
+      // store: lane 0 holds the rows of the first block, lane 1 the second
+      #define dct_store2(p) \
+         { \
+            __m128i lo = _mm256_castsi256_si128(p); \
+            __m128i hi = _mm256_extracti128_si256(p, 1); \
+            _mm_storel_epi64((__m128i *) out0, lo); \
+            _mm_storel_epi64((__m128i *) (out0 + out_stride), _mm_shuffle_epi32(lo, 0x4e)); \
+            _mm_storel_epi64((__m128i *) out1, hi); \
+            _mm_storel_epi64((__m128i *) (out1 + out_stride), _mm_shuffle_epi32(hi, 0x4e)); \
+            out0 += 2*out_stride; \
+            out1 += 2*out_stride; \
+         }
+      dct_store2(p0);
+      dct_store2(p2);
+      dct_store2(p1);
+      dct_store2(p3);
+   }
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_wadd
+#undef dct_wsub
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+#undef dct_load2
+#undef dct_store2
+}
+
+#endif // STBI_AVX2
+
+
 #ifdef STBI_NEON
 
 // NEON integer IDCT. should produce bit-identical
@@ -2946,6 +3405,8 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
    // since we don't even allow 1<<30 pixels
 }
 
+static void stbi__jpeg_stream_rows(stbi__jpeg *z, int mcu_row, int interleaved);
+
 static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
 {
    stbi__jpeg_reset(z);
@@ -2963,8 +3424,10 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
          for (j=0; j < h; ++j) {
             for (i=0; i < w; ++i) {
                int ha = z->img_comp[n].ha;
-               if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               short *block = z->deferred_idct ? z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w) : data;
+               if (!stbi__jpeg_decode_block(z, block, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+               if (!z->deferred_idct)
+                  z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
                // every data block is an MCU, so countdown the restart interval
                if (--z->todo <= 0) {
                   if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
@@ -2974,6 +3437,8 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                   stbi__jpeg_reset(z);
                }
             }
+            if (z->stream && z->s->img_n == 1)
+               stbi__jpeg_stream_rows(z, j, 0);
          }
          return 1;
       } else { // interleaved
@@ -2991,8 +3456,10 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                         int x2 = (i*z->img_comp[n].h + x)*8;
                         int y2 = (j*z->img_comp[n].v + y)*8;
                         int ha = z->img_comp[n].ha;
-                        if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                        z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
+                        short *block = z->deferred_idct ? z->img_comp[n].coeff + 64 * ((x2 >> 3) + (y2 >> 3) * z->img_comp[n].coeff_w) : data;
+                        if (!stbi__jpeg_decode_block(z, block, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                        if (!z->deferred_idct)
+                           z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
                      }
                   }
                }
@@ -3004,6 +3471,8 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                   stbi__jpeg_reset(z);
                }
             }
+            if (z->stream && z->scan_n == z->s->img_n)
+               stbi__jpeg_stream_rows(z, j, 1);
          }
          return 1;
       }
@@ -3077,21 +3546,53 @@ static void stbi__jpeg_dequantize(short *data, stbi__uint16 *dequant)
       data[i] *= dequant[i];
 }
 
+// dequantize (progressive only; baseline blocks were dequantized while decoding)
+// and idct one row of 8x8 blocks of one component
+static void stbi__jpeg_finish_row(stbi__jpeg *z, int n, int j)
+{
+   int i;
+   int w = (z->img_comp[n].x+7) >> 3;
+   for (i=0; i < w; ++i) {
+      short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
+      stbi_uc *out = z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8;
+      if (z->progressive)
+         stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
+      if (z->idct_block2_kernel && i+1 < w) {
+         // neighbouring blocks in a row are adjacent in the coefficient buffer
+         if (z->progressive)
+            stbi__jpeg_dequantize(data+64, z->dequant[z->img_comp[n].tq]);
+         z->idct_block2_kernel(out, out+8, z->img_comp[n].w2, data, data+64);
+         ++i;
+      } else {
+         z->idct_block_kernel(out, z->img_comp[n].w2, data);
+      }
+   }
+}
+
+static void stbi__jpeg_finish_task(void *task_data, int index)
+{
+   stbi__jpeg *z = (stbi__jpeg *) task_data;
+   int n = 0;
+   // tasks are numbered across the block rows of every component in turn
+   while (index >= ((z->img_comp[n].y+7) >> 3)) {
+      index -= (z->img_comp[n].y+7) >> 3;
+      ++n;
+   }
+   stbi__jpeg_finish_row(z, n, index);
+}
+
 static void stbi__jpeg_finish(stbi__jpeg *z)
 {
-   if (z->progressive) {
-      // dequantize and idct the data
-      int i,j,n;
-      for (n=0; n < z->s->img_n; ++n) {
-         int w = (z->img_comp[n].x+7) >> 3;
-         int h = (z->img_comp[n].y+7) >> 3;
-         for (j=0; j < h; ++j) {
-            for (i=0; i < w; ++i) {
-               short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
-               stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
-            }
-         }
+   if (z->progressive || z->deferred_idct) {
+      int j,n,rows=0;
+      for (n=0; n < z->s->img_n; ++n)
+         rows += (z->img_comp[n].y+7) >> 3;
+      if (stbi__jpeg_parallel(z)) {
+         z->s->options->parallel_for(z->s->options->pool, rows, stbi__jpeg_finish_task, z);
+      } else {
+         for (n=0; n < z->s->img_n; ++n)
+            for (j=0; j < ((z->img_comp[n].y+7) >> 3); ++j)
+               stbi__jpeg_finish_row(z, n, j);
       }
    }
 }
@@ -3297,6 +3798,11 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
 
    if (!stbi__mad3sizes_valid(s->img_x, s->img_y, s->img_n, 0)) return stbi__err("too large", "Image too large to decode");
 
+   // with a thread pool available, baseline images keep their coefficients so
+   // the IDCT can run in parallel after the (serial) entropy decode; streamed
+   // rows need their blocks transformed as they arrive instead
+   z->deferred_idct = !z->progressive && stbi__jpeg_parallel(z) && !z->stream;
+
    for (i=0; i < s->img_n; ++i) {
       if (z->img_comp[i].h > h_max) h_max = z->img_comp[i].h;
       if (z->img_comp[i].v > v_max) v_max = z->img_comp[i].v;
@@ -3339,7 +3845,7 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
          return stbi__free_jpeg_components(z, i+1, stbi__err("outofmem", "Out of memory"));
       // align blocks for idct using mmx/sse
       z->img_comp[i].data = (stbi_uc*) (((size_t) z->img_comp[i].raw_data + 15) & ~15);
-      if (z->progressive) {
+      if (z->progressive || z->deferred_idct) {
          // w2, h2 are multiples of 8 (see above)
          z->img_comp[i].coeff_w = z->img_comp[i].w2 / 8;
          z->img_comp[i].coeff_h = z->img_comp[i].h2 / 8;
@@ -3437,11 +3943,16 @@ static int stbi__decode_jpeg_image(stbi__jpeg *j)
          if (NL != j->s->img_y) return stbi__err("bad DNL height", "Corrupt JPEG");
          m = stbi__get_marker(j);
       } else {
-         if (!stbi__process_marker(j, m)) return 1;
+         if (!stbi__process_marker(j, m)) {
+            // baseline output is expected to be complete here, deferred or not
+            if (j->deferred_idct)
+               stbi__jpeg_finish(j);
+            return 1;
+         }
          m = stbi__get_marker(j);
       }
    }
-   if (j->progressive)
+   if (j->progressive || j->deferred_idct)
       stbi__jpeg_finish(j);
    return 1;
 }
@@ -3643,16 +4154,80 @@ static stbi_uc *stbi__resample_row_hv_2_simd(stbi_uc *out, stbi_uc *in_near, stb
 }
 #endif
 
-static stbi_uc *stbi__resample_row_generic(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+#ifdef STBI_AVX2
+// same filter as stbi__resample_row_hv_2_simd, 16 input pixels at a time
+static STBI__AVX2_TARGET stbi_uc *stbi__resample_row_hv_2_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
 {
-   // resample with nearest-neighbor
-   int i,j;
-   STBI_NOTUSED(in_far);
-   for (i=0; i < w; ++i)
-      for (j=0; j < hs; ++j)
-         out[i*hs+j] = in_near[i];
-   return out;
-}
+   int i=0,t0,t1;
+
+   if (w == 1) {
+      out[0] = out[1] = stbi__div4(3*in_near[0] + in_far[0] + 2);
+      return out;
+   }
+
+   t1 = 3*in_near[0] + in_far[0];
+   for (; i < ((w-1) & ~15); i += 16) {
+      // vertical pass, 3*x + y = 4*x + (y - x)
+      __m256i farw  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i)));
+      __m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i)));
+      __m256i diff  = _mm256_sub_epi16(farw, nearw);
+      __m256i nears = _mm256_slli_epi16(nearw, 2);
+      __m256i curr  = _mm256_add_epi16(nears, diff);
+
+      // byte shifts only work within a 128-bit lane, so the word that
+      // crosses the lane boundary comes from a lane swap of curr
+      __m256i prv0 = _mm256_alignr_epi8(curr, _mm256_permute2x128_si256(curr, curr, 0x08), 14);
+      __m256i nxt0 = _mm256_alignr_epi8(_mm256_permute2x128_si256(curr, curr, 0x81), curr, 2);
+      __m256i prev = _mm256_insert_epi16(prv0, t1, 0);
+      __m256i next = _mm256_insert_epi16(nxt0, 3*in_near[i+16] + in_far[i+16], 15);
+
+      // horizontal pass, even = cur*4 + (prev - cur), odd = cur*4 + (next - cur)
+      __m256i bias = _mm256_set1_epi16(8);
+      __m256i curs = _mm256_slli_epi16(curr, 2);
+      __m256i prvd = _mm256_sub_epi16(prev, curr);
+      __m256i nxtd = _mm256_sub_epi16(next, curr);
+      __m256i curb = _mm256_add_epi16(curs, bias);
+      __m256i even = _mm256_add_epi16(prvd, curb);
+      __m256i odd  = _mm256_add_epi16(nxtd, curb);
+
+      // per-lane interleave and pack leaves the 32 output bytes in order
+      __m256i int0 = _mm256_unpacklo_epi16(even, odd);
+      __m256i int1 = _mm256_unpackhi_epi16(even, odd);
+      __m256i de0  = _mm256_srli_epi16(int0, 4);
+      __m256i de1  = _mm256_srli_epi16(int1, 4);
+      _mm256_storeu_si256((__m256i *) (out + i*2), _mm256_packus_epi16(de0, de1));
+
+      t1 = 3*in_near[i+15] + in_far[i+15];
+   }
+
+   t0 = t1;
+   t1 = 3*in_near[i] + in_far[i];
+   out[i*2] = stbi__div16(3*t1 + t0 + 8);
+
+   for (++i; i < w; ++i) {
+      t0 = t1;
+      t1 = 3*in_near[i]+in_far[i];
+      out[i*2-1] = stbi__div16(3*t0 + t1 + 8);
+      out[i*2  ] = stbi__div16(3*t1 + t0 + 8);
+   }
+   out[w*2-1] = stbi__div4(t1+2);
+
+   STBI_NOTUSED(hs);
+
+   return out;
+}
+#endif
+
+static stbi_uc *stbi__resample_row_generic(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+   // resample with nearest-neighbor
+   int i,j;
+   STBI_NOTUSED(in_far);
+   for (i=0; i < w; ++i)
+      for (j=0; j < hs; ++j)
+         out[i*hs+j] = in_near[i];
+   return out;
+}
 
 // this is a reduced-precision calculation of YCbCr-to-RGB introduced
 // to make sure the code produces the same results in both SIMD and scalar
@@ -3677,7 +4252,7 @@ static void stbi__YCbCr_to_RGB_row(stbi_uc *out, const stbi_uc *y, const stbi_uc
       out[0] = (stbi_uc)r;
       out[1] = (stbi_uc)g;
       out[2] = (stbi_uc)b;
-      out[3] = 255;
+      if (step == 4) out[3] = 255;
       out += step;
    }
 }
@@ -3811,16 +4386,80 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
       out[0] = (stbi_uc)r;
       out[1] = (stbi_uc)g;
       out[2] = (stbi_uc)b;
-      out[3] = 255;
+      if (step == 4) out[3] = 255;
       out += step;
    }
 }
 #endif
 
+#ifdef STBI_AVX2
+// 16 pixels per iteration with the arithmetic of stbi__YCbCr_to_RGB_simd.
+// Only step == 4 is vectorized there, so the same holds here; everything
+// left over goes through the SSE2 routine to keep the output identical.
+static STBI__AVX2_TARGET void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+   int i = 0;
+
+   if (step == 4) {
+      __m128i signflip  = _mm_set1_epi8(-0x80);
+      __m256i cr_const0 = _mm256_set1_epi16(   (short) ( 1.40200f*4096.0f+0.5f));
+      __m256i cr_const1 = _mm256_set1_epi16( - (short) ( 0.71414f*4096.0f+0.5f));
+      __m256i cb_const0 = _mm256_set1_epi16( - (short) ( 0.34414f*4096.0f+0.5f));
+      __m256i cb_const1 = _mm256_set1_epi16(   (short) ( 1.77200f*4096.0f+0.5f));
+      __m256i y_bias = _mm256_set1_epi16(128);
+      __m256i xw = _mm256_set1_epi16(255); // alpha channel
+
+      for (; i+15 < count; i += 16) {
+         // load
+         __m128i y_bytes = _mm_loadu_si128((__m128i *) (y+i));
+         __m128i cr_biased = _mm_xor_si128(_mm_loadu_si128((__m128i *) (pcr+i)), signflip); // -128
+         __m128i cb_biased = _mm_xor_si128(_mm_loadu_si128((__m128i *) (pcb+i)), signflip); // -128
+
+         // widen to short with the byte in the high half, as the sse2 unpack does
+         __m256i yw  = _mm256_or_si256(_mm256_slli_epi16(_mm256_cvtepu8_epi16(y_bytes), 8), y_bias);
+         __m256i crw = _mm256_slli_epi16(_mm256_cvtepu8_epi16(cr_biased), 8);
+         __m256i cbw = _mm256_slli_epi16(_mm256_cvtepu8_epi16(cb_biased), 8);
+
+         // color transform
+         __m256i yws = _mm256_srli_epi16(yw, 4);
+         __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+         __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+         __m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+         __m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+         __m256i rws = _mm256_add_epi16(cr0, yws);
+         __m256i gwt = _mm256_add_epi16(cb0, yws);
+         __m256i bws = _mm256_add_epi16(yws, cb1);
+         __m256i gws = _mm256_add_epi16(gwt, cr1);
+
+         // descale
+         __m256i rw = _mm256_srai_epi16(rws, 4);
+         __m256i bw = _mm256_srai_epi16(bws, 4);
+         __m256i gw = _mm256_srai_epi16(gws, 4);
+
+         // back to byte and interleave; each lane now holds 8 pixels
+         __m256i brb = _mm256_packus_epi16(rw, bw);
+         __m256i gxb = _mm256_packus_epi16(gw, xw);
+         __m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+         __m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+         __m256i o0 = _mm256_unpacklo_epi16(t0, t1); // pixels 0-3, 8-11
+         __m256i o1 = _mm256_unpackhi_epi16(t0, t1); // pixels 4-7, 12-15
+
+         // store
+         _mm256_storeu_si256((__m256i *) (out + 0), _mm256_permute2x128_si256(o0, o1, 0x20));
+         _mm256_storeu_si256((__m256i *) (out + 32), _mm256_permute2x128_si256(o0, o1, 0x31));
+         out += 64;
+      }
+   }
+
+   stbi__YCbCr_to_RGB_simd(out, y+i, pcb+i, pcr+i, count-i, step);
+}
+#endif
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
    j->idct_block_kernel = stbi__idct_block;
+   j->idct_block2_kernel = NULL;
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_row;
    j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
 
@@ -3829,6 +4468,15 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
       j->idct_block_kernel = stbi__idct_simd;
       j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
       j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
+#ifdef STBI_AVX2
+      if (stbi__avx2_available()) {
+         // the single-block idct stays sse2: it runs while the entropy decoder
+         // is still producing blocks one by one
+         j->idct_block2_kernel = stbi__idct_avx2;
+         j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+         j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+      }
+#endif
    }
 #endif
 
@@ -3862,19 +4510,177 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
    return (stbi_uc) ((t + (t >>8)) >> 8);
 }
 
-static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
+// output rows handed to each parallel color conversion task, and the scratch
+// each band needs: one line per component
+#define STBI__JPEG_BAND_ROWS 32
+#define STBI__JPEG_BAND_SCRATCH(c) ((size_t) (c)->decode_n * ((c)->z->s->img_x + 3))
+
+typedef struct
 {
+   stbi__jpeg *z;
+   stbi_uc *output;
+   stbi__resample res_comp[4]; // state at row 0
+   stbi_uc *band_linebuf;      // per-band scratch lines, parallel path only
    int n, decode_n, is_rgb;
-   z->s->img_n = 0; // make stbi__cleanup_jpeg safe
+   int flip;                   // row j is stored at img_y-1-j
+} stbi__jpeg_convert;
+
+// resample and color-convert output rows [j0, j1) starting from the given
+// resampler state; linebuf holds one scratch line per component. every
+// converter stays within its own row, so bands can run side by side and the
+// output needs no slack past the last pixel
+static void stbi__jpeg_convert_rows(stbi__jpeg_convert *c, stbi__resample *res_comp, stbi_uc **linebuf, unsigned int j0, unsigned int j1)
+{
+   stbi__jpeg *z = c->z;
+   int k, n = c->n, decode_n = c->decode_n, is_rgb = c->is_rgb;
+   unsigned int i,j;
+   size_t stride = (size_t) n * z->s->img_x;
+   stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+
+   for (j=j0; j < j1; ++j) {
+      stbi_uc *out = c->output + stride * (c->flip ? z->s->img_y-1-j : j);
+      for (k=0; k < decode_n; ++k) {
+         stbi__resample *r = &res_comp[k];
+         int y_bot = r->ystep >= (r->vs >> 1);
+         coutput[k] = r->resample(linebuf[k],
+                                  y_bot ? r->line1 : r->line0,
+                                  y_bot ? r->line0 : r->line1,
+                                  r->w_lores, r->hs);
+         if (++r->ystep >= r->vs) {
+            r->ystep = 0;
+            r->line0 = r->line1;
+            if (++r->ypos < z->img_comp[k].y)
+               r->line1 += z->img_comp[k].w2;
+         }
+      }
+      if (n >= 3) {
+         stbi_uc *y = coutput[0];
+         if (z->s->img_n == 3) {
+            if (is_rgb) {
+               for (i=0; i < z->s->img_x; ++i) {
+                  out[0] = y[i];
+                  out[1] = coutput[1][i];
+                  out[2] = coutput[2][i];
+                  if (n == 4) out[3] = 255;
+                  out += n;
+               }
+            } else {
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else if (z->s->img_n == 4) {
+            if (z->app14_color_transform == 0) { // CMYK
+               for (i=0; i < z->s->img_x; ++i) {
+                  stbi_uc m = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(coutput[0][i], m);
+                  out[1] = stbi__blinn_8x8(coutput[1][i], m);
+                  out[2] = stbi__blinn_8x8(coutput[2][i], m);
+                  if (n == 4) out[3] = 255;
+                  out += n;
+               }
+            } else if (z->app14_color_transform == 2) { // YCCK
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+               for (i=0; i < z->s->img_x; ++i) {
+                  stbi_uc m = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(255 - out[0], m);
+                  out[1] = stbi__blinn_8x8(255 - out[1], m);
+                  out[2] = stbi__blinn_8x8(255 - out[2], m);
+                  out += n;
+               }
+            } else { // YCbCr + alpha?  Ignore the fourth channel for now
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = out[1] = out[2] = y[i];
+               if (n == 4) out[3] = 255;
+               out += n;
+            }
+      } else {
+         if (is_rgb) {
+            if (n == 1)
+               for (i=0; i < z->s->img_x; ++i)
+                  *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+            else {
+               for (i=0; i < z->s->img_x; ++i, out += 2) {
+                  out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+                  out[1] = 255;
+               }
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+            for (i=0; i < z->s->img_x; ++i) {
+               stbi_uc m = coutput[3][i];
+               stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
+               stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
+               stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
+               out[0] = stbi__compute_y(r, g, b);
+               if (n == 2) out[1] = 255;
+               out += n;
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+               if (n == 2) out[1] = 255;
+               out += n;
+            }
+         } else {
+            stbi_uc *y = coutput[0];
+            if (n == 1)
+               for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
+            else
+               for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
+         }
+      }
+   }
+}
 
-   // validate req_comp
-   if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
+// position a resampler on output row j; this is exactly the state the
+// forward-only stepping in stbi__jpeg_convert_rows reaches from row 0
+static void stbi__resample_seek(stbi__resample *r, stbi__jpeg *z, int k, unsigned int j)
+{
+   int wraps = (int) (((unsigned int) (r->vs >> 1) + j) / r->vs);
+   int last = z->img_comp[k].y - 1;
+   r->ystep = (int) (((unsigned int) (r->vs >> 1) + j) % r->vs);
+   r->ypos  = wraps;
+   r->line1 = z->img_comp[k].data + z->img_comp[k].w2 * (wraps < last ? wraps : last);
+   r->line0 = wraps == 0 ? z->img_comp[k].data : z->img_comp[k].data + z->img_comp[k].w2 * (wraps-1 < last ? wraps-1 : last);
+}
 
-   // load a jpeg image from whichever source, but leave in YCbCr format
-   if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
+static void stbi__jpeg_convert_task(void *task_data, int band)
+{
+   stbi__jpeg_convert *c = (stbi__jpeg_convert *) task_data;
+   stbi__jpeg *z = c->z;
+   stbi__resample res_comp[4];
+   stbi_uc *linebuf[4];
+   unsigned int j0 = (unsigned int) band * STBI__JPEG_BAND_ROWS;
+   unsigned int j1 = j0 + STBI__JPEG_BAND_ROWS < z->s->img_y ? j0 + STBI__JPEG_BAND_ROWS : z->s->img_y;
+   stbi_uc *scratch = c->band_linebuf + (size_t) band * STBI__JPEG_BAND_SCRATCH(c);
+   int k;
+
+   for (k=0; k < c->decode_n; ++k) {
+      res_comp[k] = c->res_comp[k];
+      stbi__resample_seek(&res_comp[k], z, k, j0);
+      linebuf[k] = scratch + (size_t) k * (z->s->img_x + 3);
+   }
+   stbi__jpeg_convert_rows(c, res_comp, linebuf, j0, j1);
+}
+
+// serial resampling and color conversion; a streamed baseline image advances
+// it as MCU rows arrive, any other image runs it once decoding is done
+typedef struct
+{
+   stbi__jpeg_convert conv;
+   stbi__resample res_comp[4];
+   stbi_uc *linebuf[4];
+   unsigned int row;   // output rows converted so far
+   int req_comp;
+} stbi__jpeg_output;
+
+static int stbi__jpeg_begin_output(stbi__jpeg *z, stbi__jpeg_output *o)
+{
+   int k, n, decode_n, is_rgb;
 
    // determine actual number of components to generate
-   n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
+   n = o->req_comp ? o->req_comp : z->s->img_n >= 3 ? 3 : 1;
 
    is_rgb = z->s->img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
 
@@ -3885,144 +4691,120 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
 
    // nothing to do if no components requested; check this now to avoid
    // accessing uninitialized coutput[0] later
-   if (decode_n <= 0) { stbi__cleanup_jpeg(z); return NULL; }
-
-   // resample and color-convert
-   {
-      int k;
-      unsigned int i,j;
-      stbi_uc *output;
-      stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+   if (decode_n <= 0) return 0;
+
+   for (k=0; k < decode_n; ++k) {
+      stbi__resample *r = &o->res_comp[k];
+
+      // allocate line buffer big enough for upsampling off the edges
+      // with upsample factor of 4
+      STBI_FREE(z->img_comp[k].linebuf);
+      z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(z->s->img_x + 3);
+      if (!z->img_comp[k].linebuf) return stbi__err("outofmem", "Out of memory");
+      o->linebuf[k] = z->img_comp[k].linebuf;
+
+      r->hs      = z->img_h_max / z->img_comp[k].h;
+      r->vs      = z->img_v_max / z->img_comp[k].v;
+      r->ystep   = r->vs >> 1;
+      r->w_lores = (z->s->img_x + r->hs-1) / r->hs;
+      r->ypos    = 0;
+      r->line0   = r->line1 = z->img_comp[k].data;
+
+      if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
+      else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
+      else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
+      else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
+      else                               r->resample = stbi__resample_row_generic;
+   }
+
+   o->conv.output = (stbi_uc *) stbi__malloc_image(z->s, n, z->s->img_x, z->s->img_y);
+   if (!o->conv.output) return stbi__err("outofmem", "Out of memory");
+
+   o->conv.z = z;
+   o->conv.n = n;
+   o->conv.decode_n = decode_n;
+   o->conv.is_rgb = is_rgb;
+   o->conv.flip = z->s->flipped;
+   o->conv.band_linebuf = NULL;
+   o->row = 0;
+   return 1;
+}
 
-      stbi__resample res_comp[4];
+// convert output rows up to j1 and hand them to stbi_load_options.rows
+static void stbi__jpeg_output_rows(stbi__jpeg *z, stbi__jpeg_output *o, unsigned int j1)
+{
+   if (j1 <= o->row) return;
+   stbi__jpeg_convert_rows(&o->conv, o->res_comp, o->linebuf, o->row, j1);
+   o->row = j1;
+   stbi__emit_rows(z->s, o->conv.output, z->s->img_x, z->s->img_y, o->conv.n, j1);
+}
 
-      for (k=0; k < decode_n; ++k) {
-         stbi__resample *r = &res_comp[k];
+// called after each MCU row of a baseline scan that carries every component;
+// converts the output rows whose source lines have all been decoded
+static void stbi__jpeg_stream_rows(stbi__jpeg *z, int mcu_row, int interleaved)
+{
+   stbi__jpeg_output *o = (stbi__jpeg_output *) z->stream;
+   unsigned int ready = z->s->img_y;
+   int k;
 
-         // allocate line buffer big enough for upsampling off the edges
-         // with upsample factor of 4
-         z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(z->s->img_x + 3);
-         if (!z->img_comp[k].linebuf) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
-
-         r->hs      = z->img_h_max / z->img_comp[k].h;
-         r->vs      = z->img_v_max / z->img_comp[k].v;
-         r->ystep   = r->vs >> 1;
-         r->w_lores = (z->s->img_x + r->hs-1) / r->hs;
-         r->ypos    = 0;
-         r->line0   = r->line1 = z->img_comp[k].data;
-
-         if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
-         else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
-         else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
-         else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
-         else                               r->resample = stbi__resample_row_generic;
+   if (!o->conv.output && !stbi__jpeg_begin_output(z, o)) {
+      z->stream = NULL; // load_jpeg_image tries again and reports the error
+      return;
+   }
+   for (k=0; k < o->conv.decode_n; ++k) {
+      stbi__resample *r = &o->res_comp[k];
+      int decoded = (mcu_row+1) * 8 * (interleaved ? z->img_comp[k].v : 1);
+      // output row j reads source lines up to (j + vs/2) / vs
+      if (decoded < z->img_comp[k].y) {
+         unsigned int rows = (unsigned int) (decoded * r->vs - (r->vs >> 1));
+         if (rows < ready) ready = rows;
       }
+   }
+   stbi__jpeg_output_rows(z, o, ready);
+}
 
-      // can't error after this so, this is safe
-      output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
-      if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
-
-      // now go ahead and resample
-      for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
-         for (k=0; k < decode_n; ++k) {
-            stbi__resample *r = &res_comp[k];
-            int y_bot = r->ystep >= (r->vs >> 1);
-            coutput[k] = r->resample(z->img_comp[k].linebuf,
-                                     y_bot ? r->line1 : r->line0,
-                                     y_bot ? r->line0 : r->line1,
-                                     r->w_lores, r->hs);
-            if (++r->ystep >= r->vs) {
-               r->ystep = 0;
-               r->line0 = r->line1;
-               if (++r->ypos < z->img_comp[k].y)
-                  r->line1 += z->img_comp[k].w2;
-            }
-         }
-         if (n >= 3) {
-            stbi_uc *y = coutput[0];
-            if (z->s->img_n == 3) {
-               if (is_rgb) {
-                  for (i=0; i < z->s->img_x; ++i) {
-                     out[0] = y[i];
-                     out[1] = coutput[1][i];
-                     out[2] = coutput[2][i];
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else {
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else if (z->s->img_n == 4) {
-               if (z->app14_color_transform == 0) { // CMYK
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(coutput[0][i], m);
-                     out[1] = stbi__blinn_8x8(coutput[1][i], m);
-                     out[2] = stbi__blinn_8x8(coutput[2][i], m);
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else if (z->app14_color_transform == 2) { // YCCK
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(255 - out[0], m);
-                     out[1] = stbi__blinn_8x8(255 - out[1], m);
-                     out[2] = stbi__blinn_8x8(255 - out[2], m);
-                     out += n;
-                  }
-               } else { // YCbCr + alpha?  Ignore the fourth channel for now
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = out[1] = out[2] = y[i];
-                  out[3] = 255; // not used if n==3
-                  out += n;
-               }
-         } else {
-            if (is_rgb) {
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i)
-                     *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-               else {
-                  for (i=0; i < z->s->img_x; ++i, out += 2) {
-                     out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                     out[1] = 255;
-                  }
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  stbi_uc m = coutput[3][i];
-                  stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
-                  stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
-                  stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
-                  out[0] = stbi__compute_y(r, g, b);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else {
-               stbi_uc *y = coutput[0];
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
-               else
-                  for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
-            }
-         }
-      }
+static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
+{
+   stbi__jpeg_output o;
+   int bands;
+   z->s->img_n = 0; // make stbi__cleanup_jpeg safe
+
+   // validate req_comp
+   if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
+
+   memset(&o, 0, sizeof(o));
+   o.req_comp = req_comp;
+   z->stream = z->s->options && z->s->options->rows ? &o : NULL;
+   z->s->flipped = stbi__flip_on_load(z->s);
+
+   // load a jpeg image from whichever source, but leave in YCbCr format
+   if (!stbi__decode_jpeg_image(z)) {
+      stbi__free_image(z->s, o.conv.output);
       stbi__cleanup_jpeg(z);
-      *out_x = z->s->img_x;
-      *out_y = z->s->img_y;
-      if (comp) *comp = z->s->img_n >= 3 ? 3 : 1; // report original components, not output
-      return output;
+      return NULL;
    }
+
+   // resample and color-convert whatever streaming did not get to
+   if (!o.conv.output && !stbi__jpeg_begin_output(z, &o)) { stbi__cleanup_jpeg(z); return NULL; }
+
+   bands = (int) ((z->s->img_y + STBI__JPEG_BAND_ROWS-1) / STBI__JPEG_BAND_ROWS);
+   if (o.row == 0 && stbi__jpeg_parallel(z) && bands > 1)
+      o.conv.band_linebuf = (stbi_uc *) stbi__malloc_mad2(bands, (int) STBI__JPEG_BAND_SCRATCH(&o.conv), 0);
+
+   if (o.conv.band_linebuf) {
+      int k;
+      for (k=0; k < o.conv.decode_n; ++k)
+         o.conv.res_comp[k] = o.res_comp[k];
+      z->s->options->parallel_for(z->s->options->pool, bands, stbi__jpeg_convert_task, &o.conv);
+      STBI_FREE(o.conv.band_linebuf);
+   } else {
+      stbi__jpeg_output_rows(z, &o, z->s->img_y);
+   }
+   stbi__cleanup_jpeg(z);
+   *out_x = z->s->img_x;
+   *out_y = z->s->img_y;
+   if (comp) *comp = z->s->img_n >= 3 ? 3 : 1; // report original components, not output
+   return o.conv.output;
 }
 
 static void *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
@@ -4092,6 +4874,12 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
 #define STBI__ZNSYMS 288 // number of symbols in literal/length alphabet
 
+// wider tables used by stbi__parse_huffman_fast, see stbi__zbuild_wide
+#define STBI__ZWIDE_BITS       11
+#define STBI__ZWIDE_MASK       ((1 << STBI__ZWIDE_BITS) - 1)
+#define STBI__ZWIDE_DIST_BITS  10
+#define STBI__ZWIDE_DIST_MASK  ((1 << STBI__ZWIDE_DIST_BITS) - 1)
+
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
 typedef struct
@@ -4172,11 +4960,16 @@ static int stbi__zbuild_huffman(stbi__zhuffman *z, const stbi_uc *sizelist, int
 //    because PNG allows splitting the zlib stream arbitrarily,
 //    and it's annoying structurally to have PNG call ZLIB call PNG,
 //    we require PNG read all the IDATs and combine them into a single
-//    memory buffer
+//    memory buffer -- except when PNG streams rows, where 'zrefill' is
+//    called whenever the input runs dry and hands over the next piece
 
-typedef struct
+typedef struct stbi__zbuf_s stbi__zbuf;
+
+struct stbi__zbuf_s
 {
    stbi_uc *zbuffer, *zbuffer_end;
+   int (*zrefill)(stbi__zbuf *z); // points zbuffer at more input, or returns 0 at the end
+   void *zrefill_user;
    int num_bits;
    int hit_zeof_once;
    stbi__uint32 code_buffer;
@@ -4187,11 +4980,13 @@ typedef struct
    int   z_expandable;
 
    stbi__zhuffman z_length, z_distance;
-} stbi__zbuf;
+   stbi__uint32 z_length_wide[1 << STBI__ZWIDE_BITS];
+   stbi__uint32 z_distance_wide[1 << STBI__ZWIDE_DIST_BITS];
+};
 
 stbi_inline static int stbi__zeof(stbi__zbuf *z)
 {
-   return (z->zbuffer >= z->zbuffer_end);
+   return (z->zbuffer >= z->zbuffer_end) && !(z->zrefill && z->zrefill(z));
 }
 
 stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
@@ -4204,6 +4999,7 @@ static void stbi__fill_bits(stbi__zbuf *z)
    do {
       if (z->code_buffer >= (1U << z->num_bits)) {
         z->zbuffer = z->zbuffer_end;  /* treat this as EOF so we fail. */
+        z->zrefill = NULL;
         return;
       }
       z->code_buffer |= (unsigned int) stbi__zget8(z) << z->num_bits;
@@ -4221,12 +5017,12 @@ stbi_inline static unsigned int stbi__zreceive(stbi__zbuf *z, int n)
    return k;
 }
 
-static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
+// decode a code longer than STBI__ZFAST_BITS from the low 16 bits of code_buffer
+static int stbi__zhuffman_symbol(stbi__zhuffman *z, unsigned int code_buffer, int *size)
 {
    int b,s,k;
-   // not resolved by fast table, so compute it the slow way
    // use jpeg approach, which requires MSbits at top
-   k = stbi__bit_reverse(a->code_buffer, 16);
+   k = stbi__bit_reverse(code_buffer, 16);
    for (s=STBI__ZFAST_BITS+1; ; ++s)
       if (k < z->maxcode[s])
          break;
@@ -4235,9 +5031,19 @@ static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
    b = (k >> (16-s)) - z->firstcode[s] + z->firstsymbol[s];
    if (b >= STBI__ZNSYMS) return -1; // some data was corrupt somewhere!
    if (z->size[b] != s) return -1;  // was originally an assert, but report failure instead.
+   *size = s;
+   return z->value[b];
+}
+
+static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
+{
+   int s, v;
+   // not resolved by fast table, so compute it the slow way
+   v = stbi__zhuffman_symbol(z, a->code_buffer, &s);
+   if (v < 0) return -1;
    a->code_buffer >>= s;
    a->num_bits -= s;
-   return z->value[b];
+   return v;
 }
 
 stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
@@ -4306,11 +5112,204 @@ static const int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129
 static const int stbi__zdist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
 
+// Entries of the wide tables carry everything the fast loop needs for one
+// lookup; an entry of 0 means the code is longer than the table.
+//    bits 0-3    code length (for a literal pair, both codes together)
+//  literal/length table:
+//    bits 4-5    1 = literals, 2 = length, 3 = end of block or invalid symbol
+//    bits 6-7    number of literals, 1 or 2
+//    bits 8-23   the literals, or for lengths the extra bit count in 8-11
+//                and the base length in 16-24; symbol in 16-24 for type 3
+//  distance table:
+//    bits 4-7    extra bit count
+//    bits 8-23   base distance, 0 for the invalid symbols 30 and 31
+static stbi__uint32 stbi__zwide_length_entry(int sym, int size)
+{
+   if (sym < 256)
+      return size | (1 << 4) | (1 << 6) | (sym << 8);
+   if (sym == 256 || sym >= 286)
+      return size | (3 << 4) | (sym << 16);
+   sym -= 257;
+   return size | (2 << 4) | (stbi__zlength_extra[sym] << 8) | (stbi__zlength_base[sym] << 16);
+}
+
+static stbi__uint32 stbi__zwide_distance_entry(int sym, int size)
+{
+   if (sym >= 30)
+      return size;
+   return size | (stbi__zdist_extra[sym] << 4) | (stbi__zdist_base[sym] << 8);
+}
+
+// sizelist has already been validated by stbi__zbuild_huffman
+static void stbi__zbuild_wide(stbi__uint32 *wide, int bits, const stbi_uc *sizelist, int num, int is_distance)
+{
+   int i,j,s,code=0;
+   int next_code[16], sizes[16];
+
+   memset(sizes, 0, sizeof(sizes));
+   memset(wide, 0, sizeof(*wide) << bits);
+   for (i=0; i < num; ++i)
+      ++sizes[sizelist[i]];
+   sizes[0] = 0;
+   for (s=1; s < 16; ++s) {
+      next_code[s] = code;
+      code = (code + sizes[s]) << 1;
+   }
+   for (i=0; i < num; ++i) {
+      s = sizelist[i];
+      if (!s) continue;
+      if (s <= bits) {
+         stbi__uint32 e = is_distance ? stbi__zwide_distance_entry(i, s) : stbi__zwide_length_entry(i, s);
+         for (j = stbi__bit_reverse(next_code[s], s); j < (1 << bits); j += (1 << s))
+            wide[j] = e;
+      }
+      ++next_code[s];
+   }
+
+   if (is_distance) return;
+
+   // where a short literal leaves room for another whole literal code in the
+   // same index, store both. going downwards, wide[j >> s] is still a single.
+   for (j=(1 << bits)-1; j >= 0; --j) {
+      stbi__uint32 e1 = wide[j], e2;
+      if ((e1 & 0xf0) != 0x50) continue;
+      s = e1 & 15;
+      e2 = wide[j >> s];
+      if ((e2 & 0xf0) == 0x50 && s + (int) (e2 & 15) <= bits)
+         wide[j] = (s + (e2 & 15)) | (1 << 4) | (2 << 6) | (e1 & 0xff00) | ((e2 & 0xff00) << 8);
+   }
+}
+
+static void stbi__zbuild_wide_tables(stbi__zbuf *a, const stbi_uc *lengths, int nlength, const stbi_uc *distances, int ndistance)
+{
+   stbi__zbuild_wide(a->z_length_wide, STBI__ZWIDE_BITS, lengths, nlength, 0);
+   stbi__zbuild_wide(a->z_distance_wide, STBI__ZWIDE_DIST_BITS, distances, ndistance, 1);
+}
+
+static stbi__uint32 stbi__zwide_slow(stbi__zhuffman *z, stbi__uint64 bits, int is_distance)
+{
+   int size, sym = stbi__zhuffman_symbol(z, (unsigned int) (bits & 0xffff), &size);
+   if (sym < 0) return 0;
+   return is_distance ? stbi__zwide_distance_entry(sym, size) : stbi__zwide_length_entry(sym, size);
+}
+
+stbi_inline static stbi__uint64 stbi__zload64(const stbi_uc *p)
+{
+#if defined(STBI__X64_TARGET) || defined(STBI__X86_TARGET) || defined(_M_ARM64) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+   stbi__uint64 v;
+   memcpy(&v, p, 8);
+   return v;
+#else
+   return  (stbi__uint64) p[0]        | ((stbi__uint64) p[1] <<  8) | ((stbi__uint64) p[2] << 16) | ((stbi__uint64) p[3] << 24)
+        | ((stbi__uint64) p[4] << 32) | ((stbi__uint64) p[5] << 40) | ((stbi__uint64) p[6] << 48) | ((stbi__uint64) p[7] << 56);
+#endif
+}
+
+#define STBI__ZFAST_IN_SLACK   8          // one unaligned 64-bit load
+#define STBI__ZFAST_OUT_SLACK  (258 + 8)  // longest match plus the copy overrun
+
+// Inner loop for the middle of a compressed block: a 64-bit bit buffer that is
+// refilled once per symbol, one table lookup per code (two literals at once
+// where they fit), and 8-byte match copies that may overrun into the slack.
+// Returns 1 at the end of the block, 0 on error, and -1 once it gets within
+// the slack of either buffer end, leaving the rest to stbi__parse_huffman_block.
+static int stbi__parse_huffman_fast(stbi__zbuf *a)
+{
+   const stbi_uc *in = a->zbuffer;
+   const stbi_uc *in_end = a->zbuffer_end - STBI__ZFAST_IN_SLACK;
+   stbi_uc *out = (stbi_uc *) a->zout;
+   stbi_uc *out_start = (stbi_uc *) a->zout_start;
+   stbi_uc *out_end = (stbi_uc *) a->zout_end - STBI__ZFAST_OUT_SLACK;
+   stbi__uint64 bits = a->code_buffer;
+   int nbits = a->num_bits;
+   int result = -1;
+
+   while (in <= in_end && out <= out_end) {
+      stbi__uint32 e;
+      stbi_uc *src, *end;
+      int n, len, dist;
+
+      // branch-free refill to 56..63 bits, which covers a length code, its
+      // extra bits, a distance code and its extra bits (15+5+15+13)
+      bits |= stbi__zload64(in) << nbits;
+      in += (63 - nbits) >> 3;
+      nbits |= 56;
+
+      e = a->z_length_wide[bits & STBI__ZWIDE_MASK];
+      if (e == 0) e = stbi__zwide_slow(&a->z_length, bits, 0);
+      if (e == 0) { result = stbi__err("bad huffman code","Corrupt PNG"); break; }
+      n = e & 15;
+      bits >>= n;
+      nbits -= n;
+
+      if (((e >> 4) & 3) == 1) {
+         out[0] = (stbi_uc) (e >> 8);
+         out[1] = (stbi_uc) (e >> 16);
+         out += (e >> 6) & 3;
+         continue;
+      }
+      if (((e >> 4) & 3) == 3) {
+         // per DEFLATE, length codes 286 and 287 must not appear in compressed data
+         result = ((e >> 16) == 256) ? 1 : stbi__err("bad huffman code","Corrupt PNG");
+         break;
+      }
+
+      n = (e >> 8) & 15;
+      len = (int) (e >> 16) + (int) (bits & ((1u << n) - 1));
+      bits >>= n;
+      nbits -= n;
+
+      e = a->z_distance_wide[bits & STBI__ZWIDE_DIST_MASK];
+      if (e == 0) e = stbi__zwide_slow(&a->z_distance, bits, 1);
+      if ((e >> 8) == 0) { result = stbi__err("bad huffman code","Corrupt PNG"); break; }
+      n = e & 15;
+      bits >>= n;
+      nbits -= n;
+      n = (e >> 4) & 15;
+      dist = (int) (e >> 8) + (int) (bits & ((1u << n) - 1));
+      bits >>= n;
+      nbits -= n;
+
+      if (out - out_start < dist) { result = stbi__err("bad dist","Corrupt PNG"); break; }
+      src = out - dist;
+      end = out + len;
+      if (dist >= 8) {
+         // each 8-byte chunk reads only bytes that are already final
+         do {
+            memcpy(out, src, 8);
+            out += 8;
+            src += 8;
+         } while (out < end);
+      } else if (dist == 1) {
+         memset(out, *src, len);
+      } else {
+         do *out++ = *src++; while (out < end);
+      }
+      out = end;
+   }
+
+   // give back the whole bytes that were loaded but not consumed
+   in -= nbits >> 3;
+   nbits &= 7;
+   a->zbuffer = (stbi_uc *) in;
+   a->code_buffer = (stbi__uint32) bits & ((1u << nbits) - 1);
+   a->num_bits = nbits;
+   a->zout = (char *) out;
+   return result;
+}
+
 static int stbi__parse_huffman_block(stbi__zbuf *a)
 {
    char *zout = a->zout;
    for(;;) {
-      int z = stbi__zhuffman_decode(a, &a->z_length);
+      int z;
+      if (a->zbuffer_end - a->zbuffer >= STBI__ZFAST_IN_SLACK && a->zout_end - zout >= STBI__ZFAST_OUT_SLACK) {
+         a->zout = zout;
+         z = stbi__parse_huffman_fast(a);
+         if (z >= 0) return z;
+         zout = a->zout;
+      }
+      z = stbi__zhuffman_decode(a, &a->z_length);
       if (z < 256) {
          if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
          if (zout >= a->zout_end) {
@@ -4403,6 +5402,7 @@ static int stbi__compute_huffman_codes(stbi__zbuf *a)
    if (n != ntot) return stbi__err("bad codelengths","Corrupt PNG");
    if (!stbi__zbuild_huffman(&a->z_length, lencodes, hlit)) return 0;
    if (!stbi__zbuild_huffman(&a->z_distance, lencodes+hlit, hdist)) return 0;
+   stbi__zbuild_wide_tables(a, lencodes, hlit, lencodes+hlit, hdist);
    return 1;
 }
 
@@ -4426,12 +5426,22 @@ static int stbi__parse_uncompressed_block(stbi__zbuf *a)
    len  = header[1] * 256 + header[0];
    nlen = header[3] * 256 + header[2];
    if (nlen != (len ^ 0xffff)) return stbi__err("zlib corrupt","Corrupt PNG");
-   if (a->zbuffer + len > a->zbuffer_end) return stbi__err("read past buffer","Corrupt PNG");
+   if (!a->zrefill && a->zbuffer + len > a->zbuffer_end) return stbi__err("read past buffer","Corrupt PNG");
    if (a->zout + len > a->zout_end)
       if (!stbi__zexpand(a, a->zout, len)) return 0;
-   memcpy(a->zout, a->zbuffer, len);
-   a->zbuffer += len;
-   a->zout += len;
+   while (len > 0) {
+      // streamed input can end anywhere inside the block
+      int n = (int) (a->zbuffer_end - a->zbuffer);
+      if (n == 0) {
+         if (stbi__zeof(a)) return stbi__err("read past buffer","Corrupt PNG");
+         continue;
+      }
+      if (n > len) n = len;
+      memcpy(a->zout, a->zbuffer, n);
+      a->zbuffer += n;
+      a->zout += n;
+      len -= n;
+   }
    return 1;
 }
 
@@ -4498,6 +5508,7 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
             // use fixed code lengths
             if (!stbi__zbuild_huffman(&a->z_length  , stbi__zdefault_length  , STBI__ZNSYMS)) return 0;
             if (!stbi__zbuild_huffman(&a->z_distance, stbi__zdefault_distance,  32)) return 0;
+            stbi__zbuild_wide_tables(a, stbi__zdefault_length, STBI__ZNSYMS, stbi__zdefault_distance, 32);
          } else {
             if (!stbi__compute_huffman_codes(a)) return 0;
          }
@@ -4524,6 +5535,7 @@ STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int
    if (p == NULL) return NULL;
    a.zbuffer = (stbi_uc *) buffer;
    a.zbuffer_end = (stbi_uc *) buffer + len;
+   a.zrefill = NULL;
    if (stbi__do_zlib(&a, p, initial_size, 1, 1)) {
       if (outlen) *outlen = (int) (a.zout - a.zout_start);
       return a.zout_start;
@@ -4545,6 +5557,7 @@ STBIDEF char *stbi_zlib_decode_malloc_guesssize_headerflag(const char *buffer, i
    if (p == NULL) return NULL;
    a.zbuffer = (stbi_uc *) buffer;
    a.zbuffer_end = (stbi_uc *) buffer + len;
+   a.zrefill = NULL;
    if (stbi__do_zlib(&a, p, initial_size, 1, parse_header)) {
       if (outlen) *outlen = (int) (a.zout - a.zout_start);
       return a.zout_start;
@@ -4559,6 +5572,7 @@ STBIDEF int stbi_zlib_decode_buffer(char *obuffer, int olen, char const *ibuffer
    stbi__zbuf a;
    a.zbuffer = (stbi_uc *) ibuffer;
    a.zbuffer_end = (stbi_uc *) ibuffer + ilen;
+   a.zrefill = NULL;
    if (stbi__do_zlib(&a, obuffer, olen, 0, 1))
       return (int) (a.zout - a.zout_start);
    else
@@ -4572,6 +5586,7 @@ STBIDEF char *stbi_zlib_decode_noheader_malloc(char const *buffer, int len, int
    if (p == NULL) return NULL;
    a.zbuffer = (stbi_uc *) buffer;
    a.zbuffer_end = (stbi_uc *) buffer+len;
+   a.zrefill = NULL;
    if (stbi__do_zlib(&a, p, 16384, 1, 0)) {
       if (outlen) *outlen = (int) (a.zout - a.zout_start);
       return a.zout_start;
@@ -4586,6 +5601,7 @@ STBIDEF int stbi_zlib_decode_noheader_buffer(char *obuffer, int olen, const char
    stbi__zbuf a;
    a.zbuffer = (stbi_uc *) ibuffer;
    a.zbuffer_end = (stbi_uc *) ibuffer + ilen;
+   a.zrefill = NULL;
    if (stbi__do_zlib(&a, obuffer, olen, 0, 0))
       return (int) (a.zout - a.zout_start);
    else
@@ -4632,6 +5648,16 @@ typedef struct
    stbi__context *s;
    stbi_uc *idata, *expanded, *out;
    int depth;
+   int out_final; // the next image built is returned as is, see stbi__malloc_image
+
+   stbi_uc *filter_buf;       // two scanlines, see stbi__png_begin_rows
+   stbi__uint32 row;          // rows unfiltered into 'out' so far
+   int flip_rows;             // row j goes to img_y-1-j, whole images only
+   int stream;                // IDAT is inflated and unfiltered as it is read
+   int color;                 // IHDR color type, for streamed unfiltering
+   stbi__uint32 idat_left;    // unread bytes of the current IDAT chunk
+   stbi__pngchunk next;       // chunk header read past the last IDAT
+   int has_next;
 } stbi__png;
 
 
@@ -4667,6 +5693,85 @@ static int stbi__paeth(int a, int b, int c)
    return t1;
 }
 
+// SSE2 unfiltering needs SSE2 at compile time; unlike the JPEG kernels there
+// is no run-time check, so 32-bit MSVC builds only get it with /arch:SSE2.
+#if defined(STBI_SSE2) && (!defined(_MSC_VER) || defined(STBI__X64_TARGET) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define STBI__PNG_SSE2
+#endif
+
+#ifdef STBI__PNG_SSE2
+stbi_inline static __m128i stbi__png_load4(const stbi_uc *p)
+{
+   int v;
+   memcpy(&v, p, 4);
+   return _mm_cvtsi32_si128(v);
+}
+
+stbi_inline static void stbi__png_store4(stbi_uc *p, __m128i v)
+{
+   int x = _mm_cvtsi128_si32(v);
+   memcpy(p, &x, 4);
+}
+
+// Unfilters the pixels of a 3 or 4 byte-per-pixel row with one vector op per
+// pixel instead of one scalar op per byte. Pixels are moved as 4 bytes, so
+// with filter_bytes == 3 the last pixel is left for the caller (the 4th byte
+// would read past the row); returns the byte offset it stopped at.
+static int stbi__png_unfilter_sse2(stbi_uc *cur, const stbi_uc *prior, const stbi_uc *raw, int nk, int filter_bytes, int filter)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i a = zero, c = zero;
+   int k = 0;
+
+   switch (filter) {
+   case STBI__F_up:
+      for (; k+16 <= nk; k += 16) {
+         __m128i x = _mm_loadu_si128((const __m128i *) (raw+k));
+         __m128i b = _mm_loadu_si128((const __m128i *) (prior+k));
+         _mm_storeu_si128((__m128i *) (cur+k), _mm_add_epi8(x, b));
+      }
+      break;
+   case STBI__F_sub:
+      for (; k+4 <= nk; k += filter_bytes) {
+         a = _mm_add_epi8(stbi__png_load4(raw+k), a);
+         stbi__png_store4(cur+k, a);
+      }
+      break;
+   case STBI__F_avg:
+      // (a+b)>>1 = avg_epu8(a,b) minus the rounding bit
+      for (; k+4 <= nk; k += filter_bytes) {
+         __m128i b = stbi__png_load4(prior+k);
+         __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+         a = _mm_add_epi8(stbi__png_load4(raw+k), avg);
+         stbi__png_store4(cur+k, a);
+      }
+      break;
+   case STBI__F_paeth:
+      // stbi__paeth in 16-bit lanes; a stays widened from one pixel to the
+      // next so only the select and the add are on the dependency chain.
+      // a and c start at zero, so the first pixel predicts from b alone.
+      {
+         for (; k+4 <= nk; k += filter_bytes) {
+            __m128i b = _mm_unpacklo_epi8(stbi__png_load4(prior+k), zero);
+            __m128i x = _mm_unpacklo_epi8(stbi__png_load4(raw+k), zero);
+            __m128i thresh = _mm_sub_epi16(_mm_sub_epi16(_mm_add_epi16(c, _mm_add_epi16(c, c)), b), a);
+            __m128i lo = _mm_min_epi16(a, b);
+            __m128i hi = _mm_max_epi16(a, b);
+            __m128i m0 = _mm_cmpgt_epi16(hi, thresh); // t0 = hi <= thresh ? lo : c
+            __m128i m1 = _mm_cmpgt_epi16(thresh, lo); // t1 = thresh <= lo ? hi : t0
+            __m128i t0 = _mm_or_si128(_mm_and_si128(m0, c), _mm_andnot_si128(m0, lo));
+            __m128i t1 = _mm_or_si128(_mm_and_si128(m1, t0), _mm_andnot_si128(m1, hi));
+            a = _mm_add_epi8(x, t1); // byte add wraps like the filter and leaves the high bytes 0
+            stbi__png_store4(cur+k, _mm_packus_epi16(a, a));
+            c = b;
+         }
+      }
+      break;
+   }
+   return k;
+}
+#endif
+
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
 // adds an extra all-255 alpha channel
@@ -4692,24 +5797,21 @@ static void stbi__create_png_alpha_expand8(stbi_uc *dest, stbi_uc *src, stbi__ui
    }
 }
 
-// create the png data from post-deflated data
-static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
+// allocate the output image and scanline workspace for unfiltering rows
+// one batch at a time with stbi__png_unfilter_rows
+static int stbi__png_begin_rows(stbi__png *a, int out_n, stbi__uint32 x, stbi__uint32 y, int depth)
 {
    int bytes = (depth == 16 ? 2 : 1);
    stbi__context *s = a->s;
-   stbi__uint32 i,j,stride = x*out_n*bytes;
-   stbi__uint32 img_len, img_width_bytes;
-   stbi_uc *filter_buf;
-   int all_ok = 1;
-   int k;
-   int img_n = s->img_n; // copy it into a local for later
-
+   stbi__uint32 img_width_bytes;
+   int img_n = s->img_n;
    int output_bytes = out_n*bytes;
-   int filter_bytes = img_n*bytes;
-   int width = x;
 
    STBI_ASSERT(out_n == s->img_n || out_n == s->img_n+1);
-   a->out = (stbi_uc *) stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
+   if (a->out_final)
+      a->out = (stbi_uc *) stbi__malloc_image(s, x, y, output_bytes);
+   else
+      a->out = (stbi_uc *) stbi__malloc_mad3(x, y, output_bytes, 0);
    if (!a->out) return stbi__err("outofmem", "Out of memory");
 
    // note: error exits here don't need to clean up a->out individually,
@@ -4717,16 +5819,32 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    if (!stbi__mad3sizes_valid(img_n, x, depth, 7)) return stbi__err("too large", "Corrupt PNG");
    img_width_bytes = (((img_n * x * depth) + 7) >> 3);
    if (!stbi__mad2sizes_valid(img_width_bytes, y, img_width_bytes)) return stbi__err("too large", "Corrupt PNG");
-   img_len = (img_width_bytes + 1) * y;
-
-   // we used to check for exact match between raw_len and img_len on non-interlaced PNGs,
-   // but issue #276 reported a PNG in the wild that had extra data at the end (all zeros),
-   // so just check for raw_len < img_len always.
-   if (raw_len < img_len) return stbi__err("not enough pixels","Corrupt PNG");
 
    // Allocate two scan lines worth of filter workspace buffer.
-   filter_buf = (stbi_uc *) stbi__malloc_mad2(img_width_bytes, 2, 0);
-   if (!filter_buf) return stbi__err("outofmem", "Out of memory");
+   a->filter_buf = (stbi_uc *) stbi__malloc_mad2(img_width_bytes, 2, 0);
+   if (!a->filter_buf) return stbi__err("outofmem", "Out of memory");
+   a->row = 0;
+
+   return 1;
+}
+
+// unfilter rows [a->row, y1) into a->out; 'raw' is the start of row 0 of the
+// decompressed data
+static int stbi__png_unfilter_rows(stbi__png *a, stbi_uc *raw, stbi__uint32 y1, int out_n, stbi__uint32 x, int depth, int color)
+{
+   int bytes = (depth == 16 ? 2 : 1);
+   stbi__context *s = a->s;
+   stbi__uint32 i,j,stride = x*out_n*bytes;
+   stbi__uint32 img_width_bytes;
+   stbi_uc *filter_buf = a->filter_buf;
+   int k, k0;
+   int img_n = s->img_n; // copy it into a local for later
+
+   int filter_bytes = img_n*bytes;
+   int width = x;
+
+   img_width_bytes = (((img_n * x * depth) + 7) >> 3);
+   raw += (size_t) (img_width_bytes + 1) * a->row;
 
    // Filtering for low-bit-depth images
    if (depth < 8) {
@@ -4734,47 +5852,55 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       width = img_width_bytes;
    }
 
-   for (j=0; j < y; ++j) {
+   for (j=a->row; j < y1; ++j) {
       // cur/prior filter buffers alternate
       stbi_uc *cur = filter_buf + (j & 1)*img_width_bytes;
       stbi_uc *prior = filter_buf + (~j & 1)*img_width_bytes;
-      stbi_uc *dest = a->out + stride*j;
+      stbi_uc *dest = a->out + stride*(a->flip_rows ? s->img_y-1-j : j);
       int nk = width * filter_bytes;
       int filter = *raw++;
 
       // check filter type
       if (filter > 4) {
-         all_ok = stbi__err("invalid filter","Corrupt PNG");
-         break;
+         a->row = j;
+         return stbi__err("invalid filter","Corrupt PNG");
       }
 
       // if first row, use special filter that doesn't sample previous row
       if (j == 0) filter = first_row_filter[filter];
 
+      // vector loops take whole pixels first (any width for up), the scalar
+      // loops below pick up from k0
+      k0 = 0;
+#ifdef STBI__PNG_SSE2
+      if (filter == STBI__F_up || (filter_bytes >= 3 && filter_bytes <= 4 && filter != STBI__F_none && filter != STBI__F_avg_first))
+         k0 = stbi__png_unfilter_sse2(cur, prior, raw, nk, filter_bytes, filter);
+#endif
+
       // perform actual filtering
       switch (filter) {
       case STBI__F_none:
          memcpy(cur, raw, nk);
          break;
       case STBI__F_sub:
-         memcpy(cur, raw, filter_bytes);
-         for (k = filter_bytes; k < nk; ++k)
+         if (k0 == 0) memcpy(cur, raw, filter_bytes), k0 = filter_bytes;
+         for (k = k0; k < nk; ++k)
             cur[k] = STBI__BYTECAST(raw[k] + cur[k-filter_bytes]);
          break;
       case STBI__F_up:
-         for (k = 0; k < nk; ++k)
+         for (k = k0; k < nk; ++k)
             cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
          break;
       case STBI__F_avg:
-         for (k = 0; k < filter_bytes; ++k)
+         for (k = k0; k < filter_bytes; ++k)
             cur[k] = STBI__BYTECAST(raw[k] + (prior[k]>>1));
-         for (k = filter_bytes; k < nk; ++k)
+         for (k = k0 > filter_bytes ? k0 : filter_bytes; k < nk; ++k)
             cur[k] = STBI__BYTECAST(raw[k] + ((prior[k] + cur[k-filter_bytes])>>1));
          break;
       case STBI__F_paeth:
-         for (k = 0; k < filter_bytes; ++k)
+         for (k = k0; k < filter_bytes; ++k)
             cur[k] = STBI__BYTECAST(raw[k] + prior[k]); // prior[k] == stbi__paeth(0,prior[k],0)
-         for (k = filter_bytes; k < nk; ++k)
+         for (k = k0 > filter_bytes ? k0 : filter_bytes; k < nk; ++k)
             cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k-filter_bytes], prior[k], prior[k-filter_bytes]));
          break;
       case STBI__F_avg_first:
@@ -4852,24 +5978,49 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       }
    }
 
-   STBI_FREE(filter_buf);
-   if (!all_ok) return 0;
+   a->row = y1;
 
    return 1;
 }
 
+// create the png data from post-deflated data
+static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
+{
+   stbi__uint32 img_len;
+   int all_ok;
+
+   if (!stbi__png_begin_rows(a, out_n, x, y, depth)) return 0;
+   img_len = ((((a->s->img_n * x * depth) + 7) >> 3) + 1) * y;
+
+   // we used to check for exact match between raw_len and img_len on non-interlaced PNGs,
+   // but issue #276 reported a PNG in the wild that had extra data at the end (all zeros),
+   // so just check for raw_len < img_len always.
+   if (raw_len < img_len)
+      all_ok = stbi__err("not enough pixels","Corrupt PNG");
+   else
+      all_ok = stbi__png_unfilter_rows(a, raw, y, out_n, x, depth, color);
+
+   STBI_FREE(a->filter_buf); a->filter_buf = NULL;
+   return all_ok;
+}
+
 static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint32 image_data_len, int out_n, int depth, int color, int interlaced)
 {
    int bytes = (depth == 16 ? 2 : 1);
    int out_bytes = out_n * bytes;
    stbi_uc *final;
    int p;
+   a->flip_rows = !interlaced && a->s->flipped;
    if (!interlaced)
       return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color);
 
-   // de-interlacing
-   final = (stbi_uc *) stbi__malloc_mad3(a->s->img_x, a->s->img_y, out_bytes, 0);
+   // de-interlacing; the passes are scratch, only 'final' is returned
+   if (a->out_final)
+      final = (stbi_uc *) stbi__malloc_image(a->s, a->s->img_x, a->s->img_y, out_bytes);
+   else
+      final = (stbi_uc *) stbi__malloc_mad3(a->s->img_x, a->s->img_y, out_bytes, 0);
    if (!final) return stbi__err("outofmem", "Out of memory");
+   a->out_final = 0;
    for (p=0; p < 7; ++p) {
       int xorig[] = { 0,4,0,2,0,1,0 };
       int yorig[] = { 0,0,4,0,2,0,1 };
@@ -4882,12 +6033,13 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
       if (x && y) {
          stbi__uint32 img_len = ((((a->s->img_n * x * depth) + 7) >> 3) + 1) * y;
          if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color)) {
-            STBI_FREE(final);
+            stbi__free_image(a->s, final);
             return 0;
          }
          for (j=0; j < y; ++j) {
             for (i=0; i < x; ++i) {
                int out_y = j*yspc[p]+yorig[p];
+               if (a->s->flipped) out_y = a->s->img_y-1-out_y;
                int out_x = i*xspc[p]+xorig[p];
                memcpy(final + out_y*a->s->img_x*out_bytes + out_x*out_bytes,
                       a->out + (j*x+i)*out_bytes, out_bytes);
@@ -4958,7 +6110,10 @@ static int stbi__expand_png_palette(stbi__png *a, stbi_uc *palette, int len, int
    stbi__uint32 i, pixel_count = a->s->img_x * a->s->img_y;
    stbi_uc *p, *temp_out, *orig = a->out;
 
-   p = (stbi_uc *) stbi__malloc_mad2(pixel_count, pal_img_n, 0);
+   if (a->out_final)
+      p = (stbi_uc *) stbi__malloc_image(a->s, pixel_count, pal_img_n, 1);
+   else
+      p = (stbi_uc *) stbi__malloc_mad2(pixel_count, pal_img_n, 0);
    if (p == NULL) return stbi__err("outofmem", "Out of memory");
 
    // between here and free(out) below, exitting would leak
@@ -5075,6 +6230,93 @@ static void stbi__de_iphone(stbi__png *z)
 
 #define STBI__PNG_TYPE(a,b,c,d)  (((unsigned) (a) << 24) + ((unsigned) (b) << 16) + ((unsigned) (c) << 8) + (unsigned) (d))
 
+// compressed bytes read per refill when streaming; rows go out between reads
+#define STBI__PNG_STREAM_READ 16384
+
+// unfilter every complete row inflated so far and hand it out
+static int stbi__png_stream_rows(stbi__png *z, stbi__zbuf *a)
+{
+   stbi__context *s = z->s;
+   stbi__uint32 row_bytes = (((s->img_n * s->img_x * z->depth) + 7) >> 3) + 1;
+   stbi__uint32 rows = (stbi__uint32) ((a->zout - a->zout_start) / row_bytes);
+   if (rows > s->img_y) rows = s->img_y;
+   if (rows <= z->row) return 1;
+   if (!stbi__png_unfilter_rows(z, (stbi_uc *) a->zout_start, rows, s->img_out_n, s->img_x, z->depth, z->color)) return 0;
+   stbi__emit_rows(s, z->out, s->img_x, s->img_y, s->img_out_n, rows);
+   return 1;
+}
+
+// zlib ran out of input: hand out the rows it produced so far (a->zout may
+// trail the inflate loop by a few symbols, but everything before it is final),
+// then read the next piece of IDAT data, following the IDAT run across chunks
+static int stbi__png_stream_refill(stbi__zbuf *a)
+{
+   stbi__png *z = (stbi__png *) a->zrefill_user;
+   stbi__context *s = z->s;
+   stbi__uint32 n;
+
+   a->zrefill = NULL; // until this succeeds, the input has ended
+   if (!stbi__png_stream_rows(z, a)) return 0;
+   while (z->idat_left == 0) {
+      stbi__get32be(s); // CRC of the previous IDAT
+      z->next = stbi__get_chunk_header(s);
+      if (z->next.type != STBI__PNG_TYPE('I','D','A','T')) {
+         z->has_next = 1;
+         return 0;
+      }
+      if (z->next.length > (1u << 30)) return stbi__err("IDAT size limit", "IDAT section larger than 2^30 bytes");
+      z->idat_left = z->next.length;
+   }
+   n = z->idat_left < STBI__PNG_STREAM_READ ? z->idat_left : STBI__PNG_STREAM_READ;
+   if (!stbi__getn(s, z->idata, n)) return stbi__err("outofdata","Corrupt PNG");
+   z->idat_left -= n;
+   a->zbuffer = z->idata;
+   a->zbuffer_end = z->idata + n;
+   a->zrefill = stbi__png_stream_refill;
+   return 1;
+}
+
+// inflate and unfilter the IDAT run starting with a chunk of 'length' bytes
+// while it is being read; leaves the header of the chunk after it in z->next
+static int stbi__png_stream_idat(stbi__png *z, stbi__uint32 length)
+{
+   stbi__context *s = z->s;
+   stbi__uint32 img_len;
+   stbi__zbuf a;
+   int ok;
+
+   z->flip_rows = s->flipped;
+   if (!stbi__png_begin_rows(z, s->img_out_n, s->img_x, s->img_y, z->depth)) return 0;
+   img_len = ((((s->img_n * s->img_x * z->depth) + 7) >> 3) + 1) * s->img_y;
+   z->idata = (stbi_uc *) stbi__malloc(STBI__PNG_STREAM_READ);
+   z->expanded = (stbi_uc *) stbi__malloc(img_len);
+   if (!z->idata || !z->expanded) return stbi__err("outofmem", "Out of memory");
+
+   z->idat_left = length;
+   z->has_next = 0;
+   a.zbuffer = a.zbuffer_end = z->idata;
+   a.zrefill = stbi__png_stream_refill;
+   a.zrefill_user = z;
+   ok = stbi__do_zlib(&a, (char *) z->expanded, (int) img_len, 1, 1);
+   z->expanded = (stbi_uc *) a.zout_start;
+   if (!ok) return 0;
+   if ((stbi__uint32) (a.zout - a.zout_start) < img_len) return stbi__err("not enough pixels","Corrupt PNG");
+   if (!stbi__png_stream_rows(z, &a)) return 0;
+
+   // skip the adler32 and anything else zlib left unread in the IDAT run
+   while (!z->has_next) {
+      stbi__skip(s, (int) z->idat_left);
+      stbi__get32be(s); // CRC
+      z->next = stbi__get_chunk_header(s);
+      z->idat_left = z->next.length;
+      z->has_next = z->next.type != STBI__PNG_TYPE('I','D','A','T');
+   }
+
+   STBI_FREE(z->filter_buf); z->filter_buf = NULL;
+   STBI_FREE(z->expanded);   z->expanded   = NULL;
+   return 1;
+}
+
 static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
 {
    stbi_uc palette[1024], pal_img_n=0;
@@ -5086,14 +6328,25 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
 
    z->expanded = NULL;
    z->idata = NULL;
+   z->out_final = 0;
    z->out = NULL;
+   z->filter_buf = NULL;
+   z->flip_rows = 0;
+   z->stream = 0;
+   z->has_next = 0;
 
    if (!stbi__check_png_header(s)) return 0;
 
    if (scan == STBI__SCAN_type) return 1;
 
    for (;;) {
-      stbi__pngchunk c = stbi__get_chunk_header(s);
+      stbi__pngchunk c;
+      if (z->has_next) {
+         c = z->next;
+         z->has_next = 0;
+      } else {
+         c = stbi__get_chunk_header(s);
+      }
       switch (c.type) {
          case STBI__PNG_TYPE('C','g','B','I'):
             is_iphone = 1;
@@ -5180,6 +6433,19 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
                return 1;
             }
             if (c.length > (1u << 30)) return stbi__err("IDAT size limit", "IDAT section larger than 2^30 bytes");
+            if (z->stream) return stbi__err("IDAT not contiguous","Corrupt PNG");
+            // with a row callback, images whose rows come out of unfiltering
+            // final are decoded while IDAT is read
+            if (!z->idata && s->options && s->options->rows && !interlace && z->depth <= 8 && !pal_img_n && !has_trans && !is_iphone) {
+               s->img_out_n = (req_comp == s->img_n+1 && req_comp != 3) ? s->img_n+1 : s->img_n;
+               if (req_comp == 0 || req_comp == s->img_out_n) {
+                  z->stream = 1;
+                  z->out_final = 1;
+                  z->color = color;
+                  if (!stbi__png_stream_idat(z, c.length)) return 0;
+                  continue; // the IDAT CRCs and the next chunk header have been read
+               }
+            }
             if ((int)(ioff + c.length) < (int)ioff) return 0;
             if (ioff + c.length > idata_limit) {
                stbi__uint32 idata_limit_old = idata_limit;
@@ -5201,6 +6467,12 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
             if (first) return stbi__err("first not IHDR", "Corrupt PNG");
             if (scan != STBI__SCAN_load) return 1;
             if (z->idata == NULL) return stbi__err("no IDAT","Corrupt PNG");
+            if (z->stream) {
+               // streamed images are complete once IDAT ends
+               STBI_FREE(z->idata); z->idata = NULL;
+               stbi__get32be(s);
+               return 1;
+            }
             // initial guess for decoded data size to avoid unnecessary reallocs
             bpl = (s->img_x * z->depth + 7) / 8; // bytes per line, per component
             raw_len = bpl * s->img_y * s->img_n /* pixels */ + s->img_y /* filter mode per row */;
@@ -5211,6 +6483,9 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
                s->img_out_n = s->img_n+1;
             else
                s->img_out_n = s->img_n;
+            // 8-bit images that need no format conversion afterwards are built
+            // where the caller wants them; palettes are expanded into it instead
+            z->out_final = z->depth <= 8 && !pal_img_n && (req_comp == 0 || req_comp == s->img_out_n);
             if (!stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace)) return 0;
             if (has_trans) {
                if (z->depth == 16) {
@@ -5226,6 +6501,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
                s->img_n = pal_img_n; // record the actual colors we had
                s->img_out_n = pal_img_n;
                if (req_comp >= 3) s->img_out_n = req_comp;
+               z->out_final = req_comp == 0 || req_comp == s->img_out_n;
                if (!stbi__expand_png_palette(z, palette, pal_len, s->img_out_n))
                   return 0;
             } else if (has_trans) {
@@ -5264,6 +6540,7 @@ static void *stbi__do_png(stbi__png *p, int *x, int *y, int *n, int req_comp, st
 {
    void *result=NULL;
    if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
+   p->s->flipped = stbi__flip_on_load(p->s);
    if (stbi__parse_png_file(p, STBI__SCAN_load, req_comp)) {
       if (p->depth <= 8)
          ri->bits_per_channel = 8;
@@ -5285,9 +6562,10 @@ static void *stbi__do_png(stbi__png *p, int *x, int *y, int *n, int req_comp, st
       *y = p->s->img_y;
       if (n) *n = p->s->img_n;
    }
-   STBI_FREE(p->out);      p->out      = NULL;
-   STBI_FREE(p->expanded); p->expanded = NULL;
-   STBI_FREE(p->idata);    p->idata    = NULL;
+   stbi__free_image(p->s, p->out); p->out = NULL;
+   STBI_FREE(p->expanded);   p->expanded   = NULL;
+   STBI_FREE(p->idata);      p->idata      = NULL;
+   STBI_FREE(p->filter_buf); p->filter_buf = NULL;
 
    return result;
 }
@@ -5545,6 +6823,12 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
    flip_vertically = ((int) s->img_y) > 0;
    s->img_y = abs((int) s->img_y);
 
+   // a flip on load cancels or joins the one bottom-up files need anyway
+   if (stbi__flip_on_load(s)) {
+      flip_vertically = !flip_vertically;
+      s->flipped = 1;
+   }
+
    if (s->img_y > STBI_MAX_DIMENSIONS) return stbi__errpuc("too large","Very large image (corrupt?)");
    if (s->img_x > STBI_MAX_DIMENSIONS) return stbi__errpuc("too large","Very large image (corrupt?)");
 
@@ -5909,6 +7193,12 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
    }
    tga_inverted = 1 - ((tga_inverted >> 5) & 1);
 
+   // a flip on load cancels or joins the one bottom-up files need anyway
+   if (stbi__flip_on_load(s)) {
+      tga_inverted = !tga_inverted;
+      s->flipped = 1;
+   }
+
    //   If I'm paletted, then I'll use the number of bits from the palette
    if ( tga_indexed ) tga_comp = stbi__tga_get_comp(tga_palette_bits, 0, &tga_rgb16);
    else tga_comp = stbi__tga_get_comp(tga_bits_per_pixel, (tga_image_type == 3), &tga_rgb16);
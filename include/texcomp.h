@@ -0,0 +1,887 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "thread.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define TEXCOMP_SSE2
+    #include <emmintrin.h>
+#endif
+
+#define TEXCOMP_MAX_LEVELS 16
+
+typedef enum
+{
+    TEXCOMP_BC1,    // DXT1: opaque RGB, 8 bytes per 4x4 block
+    TEXCOMP_BC3,    // DXT5: RGBA, 16 bytes per 4x4 block
+} texcomp_format_t;
+
+typedef enum
+{
+    TEXCOMP_FAST,   // bounding box endpoints
+    TEXCOMP_NORMAL, // principal axis endpoints plus one least squares pass
+    TEXCOMP_HIGH,   // best of both, refined until the error stops dropping
+} texcomp_quality_t;
+
+typedef struct
+{
+    texcomp_format_t format;
+    int              width;
+    int              height;
+    int              level_count;
+    size_t           level_offset[TEXCOMP_MAX_LEVELS];
+    size_t           level_size[TEXCOMP_MAX_LEVELS];
+    unsigned char   *data;
+    size_t           size;
+    double           psnr;
+} compressed_texture_t;
+
+size_t texcomp_level_size(texcomp_format_t format, int width, int height);
+void   texcomp_encode(unsigned char *dst, const unsigned char *rgba, int width, int height, texcomp_format_t format, texcomp_quality_t quality, thread_pool_t *pool);
+void   texcomp_decode(unsigned char *rgba, const unsigned char *blocks, int width, int height, texcomp_format_t format);
+double texcomp_psnr(const unsigned char *rgba, const unsigned char *blocks, int width, int height, texcomp_format_t format);
+bool   texcomp_compress_texture(compressed_texture_t *tex, const unsigned char *rgba, int width, int height, texcomp_format_t format, texcomp_quality_t quality, bool mipmaps, thread_pool_t *pool);
+void   texcomp_free(compressed_texture_t *tex);
+bool   texcomp_save_dds(const compressed_texture_t *tex, const char *path);
+bool   texcomp_load_dds(compressed_texture_t *tex, const char *path);
+
+#ifdef TEXCOMP_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef struct
+{
+    float r[16];
+    float g[16];
+    float b[16];
+    float a[16];
+} texcomp_block_t;
+
+typedef struct
+{
+    unsigned char       *dst;
+    const unsigned char *rgba;
+    int                  width;
+    int                  height;
+    texcomp_format_t     format;
+    texcomp_quality_t    quality;
+} texcomp_job_t;
+
+static int texcomp_block_bytes(texcomp_format_t format)
+{
+    return format == TEXCOMP_BC1 ? 8 : 16;
+}
+
+size_t texcomp_level_size(texcomp_format_t format, int width, int height)
+{
+    size_t blocks_x = (width + 3) / 4;
+    size_t blocks_y = (height + 3) / 4;
+
+    return blocks_x * blocks_y * texcomp_block_bytes(format);
+}
+
+// Edge blocks replicate the last row/column so padding never pulls the
+// endpoints towards colors that are not in the image.
+static void texcomp_load_block(texcomp_block_t *blk, const unsigned char *rgba, int width, int height, int bx, int by)
+{
+    for (int y = 0; y < 4; y++)
+    {
+        int sy = by * 4 + y < height ? by * 4 + y : height - 1;
+        for (int x = 0; x < 4; x++)
+        {
+            int sx = bx * 4 + x < width ? bx * 4 + x : width - 1;
+            const unsigned char *p = rgba + ((size_t) sy * width + sx) * 4;
+
+            blk->r[y * 4 + x] = p[0];
+            blk->g[y * 4 + x] = p[1];
+            blk->b[y * 4 + x] = p[2];
+            blk->a[y * 4 + x] = p[3];
+        }
+    }
+
+    return;
+}
+
+static float texcomp_clamp(float v, float lo, float hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+static unsigned short texcomp_pack565(const float c[3])
+{
+    int r = (int) (texcomp_clamp(c[0], 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+    int g = (int) (texcomp_clamp(c[1], 0.0f, 255.0f) * 63.0f / 255.0f + 0.5f);
+    int b = (int) (texcomp_clamp(c[2], 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+
+    return (unsigned short) ((r << 11) | (g << 5) | b);
+}
+
+static void texcomp_unpack565(unsigned short c, int rgb[3])
+{
+    int r = (c >> 11) & 31;
+    int g = (c >> 5) & 63;
+    int b = c & 31;
+
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+
+    return;
+}
+
+// Palette exactly as the decoder below rebuilds it, so the error we minimise
+// is the error we ship.
+static void texcomp_color_palette(unsigned short c0, unsigned short c1, bool four_color, int pal[4][3])
+{
+    texcomp_unpack565(c0, pal[0]);
+    texcomp_unpack565(c1, pal[1]);
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (four_color)
+        {
+            pal[2][i] = (2 * pal[0][i] + pal[1][i]) / 3;
+            pal[3][i] = (pal[0][i] + 2 * pal[1][i]) / 3;
+        } else
+        {
+            pal[2][i] = (pal[0][i] + pal[1][i]) / 2;
+            pal[3][i] = 0;
+        }
+    }
+
+    return;
+}
+
+static float texcomp_fit_color_indices(const texcomp_block_t *blk, int pal[4][3], unsigned char idx[16])
+{
+    float error = 0.0f;
+
+#ifdef TEXCOMP_SSE2
+    for (int g = 0; g < 16; g += 4)
+    {
+        __m128 r = _mm_loadu_ps(blk->r + g);
+        __m128 gr = _mm_loadu_ps(blk->g + g);
+        __m128 b = _mm_loadu_ps(blk->b + g);
+        __m128 best = _mm_set1_ps(1e30f);
+        __m128i best_index = _mm_setzero_si128();
+
+        for (int p = 0; p < 4; p++)
+        {
+            __m128 dr = _mm_sub_ps(r, _mm_set1_ps((float) pal[p][0]));
+            __m128 dg = _mm_sub_ps(gr, _mm_set1_ps((float) pal[p][1]));
+            __m128 db = _mm_sub_ps(b, _mm_set1_ps((float) pal[p][2]));
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+            __m128i closer = _mm_castps_si128(_mm_cmplt_ps(d, best));
+
+            best = _mm_min_ps(best, d);
+            best_index = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(p)), _mm_andnot_si128(closer, best_index));
+        }
+
+        float lane_error[4];
+        int lane_index[4];
+        _mm_storeu_ps(lane_error, best);
+        _mm_storeu_si128((__m128i *) lane_index, best_index);
+
+        for (int i = 0; i < 4; i++)
+        {
+            idx[g + i] = (unsigned char) lane_index[i];
+            error += lane_error[i];
+        }
+    }
+#else
+    for (int i = 0; i < 16; i++)
+    {
+        float best = 1e30f;
+        for (int p = 0; p < 4; p++)
+        {
+            float dr = blk->r[i] - pal[p][0];
+            float dg = blk->g[i] - pal[p][1];
+            float db = blk->b[i] - pal[p][2];
+            float d = dr * dr + dg * dg + db * db;
+
+            if (d < best)
+            {
+                best = d;
+                idx[i] = (unsigned char) p;
+            }
+        }
+        error += best;
+    }
+#endif
+
+    return error;
+}
+
+// Least squares endpoints for a fixed index assignment.
+static bool texcomp_refine_endpoints(const texcomp_block_t *blk, const unsigned char idx[16], float e0[3], float e1[3])
+{
+    static const float weight[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+    float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+    float ax[3] = { 0.0f, 0.0f, 0.0f };
+    float bx[3] = { 0.0f, 0.0f, 0.0f };
+
+    for (int i = 0; i < 16; i++)
+    {
+        float wa = weight[idx[i]];
+        float wb = 1.0f - wa;
+        float px[3] = { blk->r[i], blk->g[i], blk->b[i] };
+
+        aa += wa * wa;
+        bb += wb * wb;
+        ab += wa * wb;
+        for (int c = 0; c < 3; c++)
+        {
+            ax[c] += wa * px[c];
+            bx[c] += wb * px[c];
+        }
+    }
+
+    float det = aa * bb - ab * ab;
+    if (fabsf(det) < 1e-6f)
+        return false;
+
+    for (int c = 0; c < 3; c++)
+    {
+        e0[c] = texcomp_clamp((ax[c] * bb - bx[c] * ab) / det, 0.0f, 255.0f);
+        e1[c] = texcomp_clamp((bx[c] * aa - ax[c] * ab) / det, 0.0f, 255.0f);
+    }
+
+    return true;
+}
+
+static void texcomp_bbox_endpoints(const texcomp_block_t *blk, float e0[3], float e1[3])
+{
+    float lo[3] = { 255.0f, 255.0f, 255.0f };
+    float hi[3] = { 0.0f, 0.0f, 0.0f };
+
+    for (int i = 0; i < 16; i++)
+    {
+        float px[3] = { blk->r[i], blk->g[i], blk->b[i] };
+        for (int c = 0; c < 3; c++)
+        {
+            lo[c] = px[c] < lo[c] ? px[c] : lo[c];
+            hi[c] = px[c] > hi[c] ? px[c] : hi[c];
+        }
+    }
+
+    for (int c = 0; c < 3; c++)
+    {
+        float inset = (hi[c] - lo[c]) / 16.0f;
+        e0[c] = hi[c] - inset;
+        e1[c] = lo[c] + inset;
+    }
+
+    return;
+}
+
+static void texcomp_pca_endpoints(const texcomp_block_t *blk, float e0[3], float e1[3])
+{
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++)
+    {
+        mean[0] += blk->r[i];
+        mean[1] += blk->g[i];
+        mean[2] += blk->b[i];
+    }
+    for (int c = 0; c < 3; c++)
+        mean[c] /= 16.0f;
+
+    float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++)
+    {
+        float r = blk->r[i] - mean[0];
+        float g = blk->g[i] - mean[1];
+        float b = blk->b[i] - mean[2];
+
+        cov[0] += r * r;
+        cov[1] += r * g;
+        cov[2] += r * b;
+        cov[3] += g * g;
+        cov[4] += g * b;
+        cov[5] += b * b;
+    }
+
+    // Power iteration converges to the principal axis in a handful of steps
+    // for 3x3 covariance matrices.
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iter = 0; iter < 8; iter++)
+    {
+        float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        float m = fmaxf(fabsf(x), fmaxf(fabsf(y), fabsf(z)));
+
+        if (m < 1e-6f)
+            break;
+
+        axis[0] = x / m;
+        axis[1] = y / m;
+        axis[2] = z / m;
+    }
+
+    float len = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    for (int c = 0; c < 3; c++)
+        axis[c] /= len;
+
+    float tmin = 1e30f, tmax = -1e30f;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = (blk->r[i] - mean[0]) * axis[0] + (blk->g[i] - mean[1]) * axis[1] + (blk->b[i] - mean[2]) * axis[2];
+        tmin = t < tmin ? t : tmin;
+        tmax = t > tmax ? t : tmax;
+    }
+
+    for (int c = 0; c < 3; c++)
+    {
+        e0[c] = texcomp_clamp(mean[c] + axis[c] * tmax, 0.0f, 255.0f);
+        e1[c] = texcomp_clamp(mean[c] + axis[c] * tmin, 0.0f, 255.0f);
+    }
+
+    return;
+}
+
+typedef struct
+{
+    unsigned short c0;
+    unsigned short c1;
+    unsigned char  idx[16];
+    float          error;
+} texcomp_color_fit_t;
+
+static void texcomp_try_endpoints(const texcomp_block_t *blk, const float e0[3], const float e1[3], texcomp_color_fit_t *best)
+{
+    texcomp_color_fit_t fit;
+    int pal[4][3];
+
+    fit.c0 = texcomp_pack565(e0);
+    fit.c1 = texcomp_pack565(e1);
+
+    // Four color mode needs c0 > c1; equal endpoints decode as a flat block.
+    if (fit.c0 < fit.c1)
+    {
+        unsigned short t = fit.c0;
+        fit.c0 = fit.c1;
+        fit.c1 = t;
+    }
+
+    texcomp_color_palette(fit.c0, fit.c1, true, pal);
+    if (fit.c0 == fit.c1)
+    {
+        memcpy(pal[2], pal[0], sizeof(pal[0]));
+        memcpy(pal[3], pal[0], sizeof(pal[0]));
+    }
+
+    fit.error = texcomp_fit_color_indices(blk, pal, fit.idx);
+    if (fit.c0 == fit.c1)
+        memset(fit.idx, 0, sizeof(fit.idx));
+
+    if (fit.error < best->error)
+        *best = fit;
+
+    return;
+}
+
+static void texcomp_encode_color_block(unsigned char *dst, const texcomp_block_t *blk, texcomp_quality_t quality)
+{
+    texcomp_color_fit_t best;
+    float e0[3], e1[3];
+
+    best.error = 1e30f;
+
+    if (quality != TEXCOMP_NORMAL)
+    {
+        texcomp_bbox_endpoints(blk, e0, e1);
+        texcomp_try_endpoints(blk, e0, e1, &best);
+    }
+
+    if (quality != TEXCOMP_FAST)
+    {
+        texcomp_pca_endpoints(blk, e0, e1);
+        texcomp_try_endpoints(blk, e0, e1, &best);
+
+        int passes = quality == TEXCOMP_HIGH ? 4 : 1;
+        for (int pass = 0; pass < passes && best.error > 0.0f; pass++)
+        {
+            float previous = best.error;
+
+            if (!texcomp_refine_endpoints(blk, best.idx, e0, e1))
+                break;
+            texcomp_try_endpoints(blk, e0, e1, &best);
+
+            if (best.error >= previous)
+                break;
+        }
+    }
+
+    dst[0] = (unsigned char) (best.c0 & 0xff);
+    dst[1] = (unsigned char) (best.c0 >> 8);
+    dst[2] = (unsigned char) (best.c1 & 0xff);
+    dst[3] = (unsigned char) (best.c1 >> 8);
+
+    for (int row = 0; row < 4; row++)
+    {
+        dst[4 + row] = (unsigned char) (best.idx[row * 4 + 0]
+                     | (best.idx[row * 4 + 1] << 2)
+                     | (best.idx[row * 4 + 2] << 4)
+                     | (best.idx[row * 4 + 3] << 6));
+    }
+
+    return;
+}
+
+static void texcomp_alpha_palette(int a0, int a1, int pal[8])
+{
+    pal[0] = a0;
+    pal[1] = a1;
+
+    if (a0 > a1)
+    {
+        for (int i = 1; i < 7; i++)
+            pal[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+    } else
+    {
+        for (int i = 1; i < 5; i++)
+            pal[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+        pal[6] = 0;
+        pal[7] = 255;
+    }
+
+    return;
+}
+
+static int texcomp_fit_alpha_indices(const texcomp_block_t *blk, const int pal[8], unsigned char idx[16])
+{
+    int error = 0;
+
+    for (int i = 0; i < 16; i++)
+    {
+        int a = (int) blk->a[i];
+        int best = 1 << 30;
+
+        for (int p = 0; p < 8; p++)
+        {
+            int d = (a - pal[p]) * (a - pal[p]);
+            if (d < best)
+            {
+                best = d;
+                idx[i] = (unsigned char) p;
+            }
+        }
+        error += best;
+    }
+
+    return error;
+}
+
+static void texcomp_encode_alpha_block(unsigned char *dst, const texcomp_block_t *blk, texcomp_quality_t quality)
+{
+    int lo = 255, hi = 0;
+    int inner_lo = 255, inner_hi = 0;
+
+    for (int i = 0; i < 16; i++)
+    {
+        int a = (int) blk->a[i];
+        lo = a < lo ? a : lo;
+        hi = a > hi ? a : hi;
+
+        if (a != 0 && a != 255)
+        {
+            inner_lo = a < inner_lo ? a : inner_lo;
+            inner_hi = a > inner_hi ? a : inner_hi;
+        }
+    }
+
+    int a0 = hi, a1 = lo;
+    int pal[8];
+    unsigned char idx[16];
+
+    texcomp_alpha_palette(a0, a1, pal);
+    int error = texcomp_fit_alpha_indices(blk, pal, idx);
+
+    // Six value mode keeps exact 0 and 255, which pays off on cut-out edges.
+    if (quality == TEXCOMP_HIGH && error > 0 && inner_lo <= inner_hi)
+    {
+        int alt_pal[8];
+        unsigned char alt_idx[16];
+
+        texcomp_alpha_palette(inner_lo, inner_hi, alt_pal);
+        int alt_error = texcomp_fit_alpha_indices(blk, alt_pal, alt_idx);
+
+        if (alt_error < error)
+        {
+            a0 = inner_lo;
+            a1 = inner_hi;
+            memcpy(idx, alt_idx, sizeof(idx));
+        }
+    }
+
+    dst[0] = (unsigned char) a0;
+    dst[1] = (unsigned char) a1;
+
+    unsigned long long bits = 0;
+    for (int i = 0; i < 16; i++)
+        bits |= (unsigned long long) idx[i] << (3 * i);
+
+    for (int i = 0; i < 6; i++)
+        dst[2 + i] = (unsigned char) (bits >> (8 * i));
+
+    return;
+}
+
+static void texcomp_encode_row(void *data, int by)
+{
+    texcomp_job_t *job = (texcomp_job_t *) data;
+    int blocks_x = (job->width + 3) / 4;
+    int block_bytes = texcomp_block_bytes(job->format);
+    unsigned char *dst = job->dst + (size_t) by * blocks_x * block_bytes;
+    texcomp_block_t blk;
+
+    for (int bx = 0; bx < blocks_x; bx++, dst += block_bytes)
+    {
+        texcomp_load_block(&blk, job->rgba, job->width, job->height, bx, by);
+
+        if (job->format == TEXCOMP_BC3)
+        {
+            texcomp_encode_alpha_block(dst, &blk, job->quality);
+            texcomp_encode_color_block(dst + 8, &blk, job->quality);
+        } else
+        {
+            texcomp_encode_color_block(dst, &blk, job->quality);
+        }
+    }
+
+    return;
+}
+
+// Rows of blocks are independent, so they are handed out to the pool one at a
+// time. A NULL pool encodes on the calling thread.
+void texcomp_encode(unsigned char *dst, const unsigned char *rgba, int width, int height, texcomp_format_t format, texcomp_quality_t quality, thread_pool_t *pool)
+{
+    texcomp_job_t job = { dst, rgba, width, height, format, quality };
+
+    thread_pool_for(pool, (height + 3) / 4, texcomp_encode_row, &job);
+
+    return;
+}
+
+static void texcomp_decode_color_block(unsigned char out[16][4], const unsigned char *src, bool force_four_color)
+{
+    unsigned short c0 = (unsigned short) (src[0] | (src[1] << 8));
+    unsigned short c1 = (unsigned short) (src[2] | (src[3] << 8));
+    int pal[4][3];
+
+    texcomp_color_palette(c0, c1, force_four_color || c0 > c1, pal);
+
+    for (int i = 0; i < 16; i++)
+    {
+        int index = (src[4 + i / 4] >> (2 * (i % 4))) & 3;
+
+        out[i][0] = (unsigned char) pal[index][0];
+        out[i][1] = (unsigned char) pal[index][1];
+        out[i][2] = (unsigned char) pal[index][2];
+        out[i][3] = (!force_four_color && c0 <= c1 && index == 3) ? 0 : 255;
+    }
+
+    return;
+}
+
+static void texcomp_decode_alpha_block(unsigned char out[16][4], const unsigned char *src)
+{
+    int pal[8];
+    unsigned long long bits = 0;
+
+    texcomp_alpha_palette(src[0], src[1], pal);
+    for (int i = 0; i < 6; i++)
+        bits |= (unsigned long long) src[2 + i] << (8 * i);
+
+    for (int i = 0; i < 16; i++)
+        out[i][3] = (unsigned char) pal[(bits >> (3 * i)) & 7];
+
+    return;
+}
+
+void texcomp_decode(unsigned char *rgba, const unsigned char *blocks, int width, int height, texcomp_format_t format)
+{
+    int blocks_x = (width + 3) / 4;
+    int blocks_y = (height + 3) / 4;
+    int block_bytes = texcomp_block_bytes(format);
+    unsigned char texels[16][4];
+
+    for (int by = 0; by < blocks_y; by++)
+    {
+        for (int bx = 0; bx < blocks_x; bx++, blocks += block_bytes)
+        {
+            if (format == TEXCOMP_BC3)
+            {
+                texcomp_decode_color_block(texels, blocks + 8, true);
+                texcomp_decode_alpha_block(texels, blocks);
+            } else
+            {
+                texcomp_decode_color_block(texels, blocks, false);
+            }
+
+            for (int y = 0; y < 4 && by * 4 + y < height; y++)
+            {
+                for (int x = 0; x < 4 && bx * 4 + x < width; x++)
+                    memcpy(rgba + ((size_t) (by * 4 + y) * width + bx * 4 + x) * 4, texels[y * 4 + x], 4);
+            }
+        }
+    }
+
+    return;
+}
+
+// PSNR over the channels the format actually stores (RGB for BC1, RGBA for BC3).
+double texcomp_psnr(const unsigned char *rgba, const unsigned char *blocks, int width, int height, texcomp_format_t format)
+{
+    size_t count = (size_t) width * height;
+    unsigned char *decoded = (unsigned char *) malloc(count * 4);
+    int channels = format == TEXCOMP_BC3 ? 4 : 3;
+    double sum = 0.0;
+
+    if (decoded == NULL)
+        return 0.0;
+
+    texcomp_decode(decoded, blocks, width, height, format);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        for (int c = 0; c < channels; c++)
+        {
+            double d = (double) rgba[i * 4 + c] - (double) decoded[i * 4 + c];
+            sum += d * d;
+        }
+    }
+
+    free(decoded);
+
+    double mse = sum / ((double) count * channels);
+    if (mse <= 0.0)
+        return INFINITY;
+
+    return 10.0 * log10(255.0 * 255.0 / mse);
+}
+
+static void texcomp_downsample(unsigned char *dst, const unsigned char *src, int src_width, int src_height, int dst_width, int dst_height)
+{
+    for (int y = 0; y < dst_height; y++)
+    {
+        int y0 = 2 * y;
+        int y1 = 2 * y + 1 < src_height ? 2 * y + 1 : src_height - 1;
+
+        for (int x = 0; x < dst_width; x++)
+        {
+            int x0 = 2 * x;
+            int x1 = 2 * x + 1 < src_width ? 2 * x + 1 : src_width - 1;
+
+            for (int c = 0; c < 4; c++)
+            {
+                int sum = src[((size_t) y0 * src_width + x0) * 4 + c]
+                        + src[((size_t) y0 * src_width + x1) * 4 + c]
+                        + src[((size_t) y1 * src_width + x0) * 4 + c]
+                        + src[((size_t) y1 * src_width + x1) * 4 + c];
+
+                dst[((size_t) y * dst_width + x) * 4 + c] = (unsigned char) ((sum + 2) / 4);
+            }
+        }
+    }
+
+    return;
+}
+
+static void texcomp_layout_levels(compressed_texture_t *tex, bool mipmaps)
+{
+    int w = tex->width, h = tex->height;
+
+    tex->level_count = 0;
+    tex->size = 0;
+
+    do
+    {
+        tex->level_offset[tex->level_count] = tex->size;
+        tex->level_size[tex->level_count] = texcomp_level_size(tex->format, w, h);
+        tex->size += tex->level_size[tex->level_count];
+        tex->level_count++;
+
+        if (w == 1 && h == 1)
+            break;
+
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    } while (mipmaps && tex->level_count < TEXCOMP_MAX_LEVELS);
+
+    return;
+}
+
+// Compresses an RGBA8 image (and optionally a box filtered mip chain) into a
+// single allocation. tex->psnr reports the quality of level 0.
+bool texcomp_compress_texture(compressed_texture_t *tex, const unsigned char *rgba, int width, int height, texcomp_format_t format, texcomp_quality_t quality, bool mipmaps, thread_pool_t *pool)
+{
+    memset(tex, 0, sizeof(*tex));
+    tex->format = format;
+    tex->width = width;
+    tex->height = height;
+
+    texcomp_layout_levels(tex, mipmaps);
+
+    tex->data = (unsigned char *) malloc(tex->size);
+    if (tex->data == NULL)
+        return false;
+
+    texcomp_encode(tex->data, rgba, width, height, format, quality, pool);
+    tex->psnr = texcomp_psnr(rgba, tex->data, width, height, format);
+
+    if (tex->level_count > 1)
+    {
+        unsigned char *level = (unsigned char *) malloc((size_t) width * height * 4);
+        unsigned char *next = (unsigned char *) malloc((size_t) ((width + 1) / 2) * ((height + 1) / 2) * 4);
+        const unsigned char *src = rgba;
+        int w = width, h = height;
+
+        if (level == NULL || next == NULL)
+        {
+            free(level);
+            free(next);
+            texcomp_free(tex);
+            return false;
+        }
+
+        for (int i = 1; i < tex->level_count; i++)
+        {
+            int nw = w > 1 ? w / 2 : 1;
+            int nh = h > 1 ? h / 2 : 1;
+
+            texcomp_downsample(next, src, w, h, nw, nh);
+            texcomp_encode(tex->data + tex->level_offset[i], next, nw, nh, format, quality, pool);
+
+            unsigned char *t = level;
+            level = next;
+            next = t;
+            src = level;
+            w = nw;
+            h = nh;
+        }
+
+        free(level);
+        free(next);
+    }
+
+    return true;
+}
+
+void texcomp_free(compressed_texture_t *tex)
+{
+    free(tex->data);
+    tex->data = NULL;
+    tex->size = 0;
+    tex->level_count = 0;
+
+    return;
+}
+
+#define TEXCOMP_DDS_MAGIC       0x20534444u // "DDS "
+#define TEXCOMP_DDS_FOURCC_DXT1 0x31545844u
+#define TEXCOMP_DDS_FOURCC_DXT5 0x35545844u
+#define TEXCOMP_DDS_HEADER_SIZE 128
+
+static void texcomp_put_u32(unsigned char *p, unsigned int v)
+{
+    p[0] = (unsigned char) v;
+    p[1] = (unsigned char) (v >> 8);
+    p[2] = (unsigned char) (v >> 16);
+    p[3] = (unsigned char) (v >> 24);
+
+    return;
+}
+
+static unsigned int texcomp_get_u32(const unsigned char *p)
+{
+    return (unsigned int) p[0] | ((unsigned int) p[1] << 8) | ((unsigned int) p[2] << 16) | ((unsigned int) p[3] << 24);
+}
+
+bool texcomp_save_dds(const compressed_texture_t *tex, const char *path)
+{
+    unsigned char header[TEXCOMP_DDS_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+
+    texcomp_put_u32(header + 0, TEXCOMP_DDS_MAGIC);
+    texcomp_put_u32(header + 4, 124);
+    // CAPS | HEIGHT | WIDTH | PIXELFORMAT | MIPMAPCOUNT | LINEARSIZE
+    texcomp_put_u32(header + 8, 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000);
+    texcomp_put_u32(header + 12, (unsigned int) tex->height);
+    texcomp_put_u32(header + 16, (unsigned int) tex->width);
+    texcomp_put_u32(header + 20, (unsigned int) tex->level_size[0]);
+    texcomp_put_u32(header + 28, (unsigned int) tex->level_count);
+    texcomp_put_u32(header + 76, 32);
+    texcomp_put_u32(header + 80, 0x4);
+    texcomp_put_u32(header + 84, tex->format == TEXCOMP_BC3 ? TEXCOMP_DDS_FOURCC_DXT5 : TEXCOMP_DDS_FOURCC_DXT1);
+    texcomp_put_u32(header + 108, 0x1000 | (tex->level_count > 1 ? 0x8 | 0x400000 : 0));
+
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL)
+        return false;
+
+    bool ok = fwrite(header, sizeof(header), 1, fp) == 1 && fwrite(tex->data, tex->size, 1, fp) == 1;
+    fclose(fp);
+
+    return ok;
+}
+
+bool texcomp_load_dds(compressed_texture_t *tex, const char *path)
+{
+    unsigned char header[TEXCOMP_DDS_HEADER_SIZE];
+    memset(tex, 0, sizeof(*tex));
+
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return false;
+
+    if (fread(header, sizeof(header), 1, fp) != 1 || texcomp_get_u32(header) != TEXCOMP_DDS_MAGIC)
+    {
+        fclose(fp);
+        return false;
+    }
+
+    unsigned int fourcc = texcomp_get_u32(header + 84);
+    if (fourcc != TEXCOMP_DDS_FOURCC_DXT1 && fourcc != TEXCOMP_DDS_FOURCC_DXT5)
+    {
+        fclose(fp);
+        return false;
+    }
+
+    // sizes come from the file, so they are bounded before any are laid out
+    unsigned int height = texcomp_get_u32(header + 12);
+    unsigned int width = texcomp_get_u32(header + 16);
+    unsigned int levels = texcomp_get_u32(header + 28);
+    if (width < 1 || width > 65535 || height < 1 || height > 65535 || levels > TEXCOMP_MAX_LEVELS)
+    {
+        fclose(fp);
+        return false;
+    }
+
+    tex->format = fourcc == TEXCOMP_DDS_FOURCC_DXT5 ? TEXCOMP_BC3 : TEXCOMP_BC1;
+    tex->height = (int) height;
+    tex->width = (int) width;
+
+    texcomp_layout_levels(tex, levels > 1);
+    if (levels > 1 && (int) levels < tex->level_count)
+    {
+        tex->level_count = (int) levels;
+        tex->size = tex->level_offset[levels - 1] + tex->level_size[levels - 1];
+    }
+
+    tex->data = (unsigned char *) malloc(tex->size);
+    bool ok = tex->data != NULL && fread(tex->data, tex->size, 1, fp) == 1;
+    fclose(fp);
+
+    if (!ok)
+        texcomp_free(tex);
+
+    return ok;
+}
+
+#endif
@@ -0,0 +1,463 @@
+#pragma once
+
+// clock_gettime() is POSIX rather than C11; this only helps when no system
+// header came first
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+    #define _POSIX_C_SOURCE 199309L
+#endif
+
+#include <stdbool.h>
+
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+    #include <intrin.h>
+    // minwindef.h still defines these and they clash with parameter names in lgebra.h
+    #undef near
+    #undef far
+#else
+    #include <pthread.h>
+    #include <unistd.h>
+#endif
+
+#ifndef THREAD
+    #define THREAD static inline
+#endif
+
+#if defined(_MSC_VER)
+    #define THREAD_LOCAL __declspec(thread)
+#else
+    #define THREAD_LOCAL __thread
+#endif
+
+typedef void *(*thread_fn_t)(void *arg);
+typedef void  (*task_fn_t)(void *data, int index);
+
+#ifdef _WIN32
+typedef struct
+{
+    HANDLE      handle;
+    thread_fn_t fn;
+    void       *arg;
+} thread_t;
+
+typedef SRWLOCK            mutex_t;
+typedef CONDITION_VARIABLE cond_t;
+#else
+typedef struct
+{
+    pthread_t handle;
+} thread_t;
+
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t  cond_t;
+#endif
+
+typedef struct
+{
+    thread_t      *workers;
+    int            worker_count;
+
+    mutex_t        lock;
+    cond_t         work_ready;
+    cond_t         work_done;
+
+    task_fn_t      task;
+    void          *task_data;
+    int            task_count;
+    volatile int   next_index;
+    int            active;
+    unsigned int   generation;
+    bool           quit;
+} thread_pool_t;
+
+// Atomics are kept to the handful of operations the rest of include/ needs.
+// All of them are sequentially consistent unless the name says otherwise.
+THREAD int atomic_load_i32(volatile int *p)
+{
+#ifdef _MSC_VER
+    return _InterlockedOr((volatile long *) p, 0);
+#else
+    return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+#endif
+}
+
+THREAD void atomic_store_i32(volatile int *p, int value)
+{
+#ifdef _MSC_VER
+    _InterlockedExchange((volatile long *) p, value);
+#else
+    __atomic_store_n(p, value, __ATOMIC_SEQ_CST);
+#endif
+
+    return;
+}
+
+// Returns the value held before the addition.
+THREAD int atomic_add_i32(volatile int *p, int value)
+{
+#ifdef _MSC_VER
+    return _InterlockedExchangeAdd((volatile long *) p, value);
+#else
+    return __atomic_fetch_add(p, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+THREAD bool atomic_cas_i32(volatile int *p, int expected, int desired)
+{
+#ifdef _MSC_VER
+    return _InterlockedCompareExchange((volatile long *) p, desired, expected) == expected;
+#else
+    return __atomic_compare_exchange_n(p, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+}
+
+// Acquire and release only order the accesses around them, which is all a
+// single producer, single consumer ring needs, and keeps the producer side
+// to plain moves on x86. MSVC gives volatile accesses these semantics on
+// x86 and x64 (/volatile:ms), so only the compiler barrier is added there.
+THREAD int atomic_load_acquire_i32(volatile int *p)
+{
+#ifdef _MSC_VER
+    int value = *p;
+    _ReadWriteBarrier();
+
+    return value;
+#else
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#endif
+}
+
+THREAD void atomic_store_release_i32(volatile int *p, int value)
+{
+#ifdef _MSC_VER
+    _ReadWriteBarrier();
+    *p = value;
+#else
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+#endif
+
+    return;
+}
+
+THREAD long long atomic_load_i64(volatile long long *p)
+{
+#ifdef _MSC_VER
+    return _InterlockedOr64(p, 0);
+#else
+    return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+#endif
+}
+
+THREAD void atomic_store_i64(volatile long long *p, long long value)
+{
+#ifdef _MSC_VER
+    _InterlockedExchange64(p, value);
+#else
+    __atomic_store_n(p, value, __ATOMIC_SEQ_CST);
+#endif
+
+    return;
+}
+
+THREAD long long atomic_add_i64(volatile long long *p, long long value)
+{
+#ifdef _MSC_VER
+    return _InterlockedExchangeAdd64(p, value);
+#else
+    return __atomic_fetch_add(p, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+THREAD bool atomic_cas_i64(volatile long long *p, long long expected, long long desired)
+{
+#ifdef _MSC_VER
+    return _InterlockedCompareExchange64(p, desired, expected) == expected;
+#else
+    return __atomic_compare_exchange_n(p, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+}
+
+int    thread_create(thread_t *thread, thread_fn_t fn, void *arg);
+void   thread_join(thread_t *thread);
+void   thread_yield(void);
+int    thread_hardware_concurrency(void);
+double thread_now(void);
+
+void mutex_init(mutex_t *mutex);
+void mutex_destroy(mutex_t *mutex);
+void mutex_lock(mutex_t *mutex);
+void mutex_unlock(mutex_t *mutex);
+
+void cond_init(cond_t *cond);
+void cond_destroy(cond_t *cond);
+void cond_wait(cond_t *cond, mutex_t *mutex);
+void cond_signal(cond_t *cond);
+void cond_broadcast(cond_t *cond);
+
+void thread_pool_init(thread_pool_t *pool, int worker_count);
+void thread_pool_destroy(thread_pool_t *pool);
+void thread_pool_for(thread_pool_t *pool, int count, task_fn_t task, void *data);
+
+#ifdef THREAD_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+    #include <time.h>
+#endif
+
+#ifdef _WIN32
+static DWORD WINAPI thread_trampoline(LPVOID arg)
+{
+    thread_t *thread = (thread_t *) arg;
+    thread->fn(thread->arg);
+
+    return 0;
+}
+
+int thread_create(thread_t *thread, thread_fn_t fn, void *arg)
+{
+    thread->fn = fn;
+    thread->arg = arg;
+    thread->handle = CreateThread(NULL, 0, thread_trampoline, thread, 0, NULL);
+
+    return thread->handle != NULL;
+}
+
+void thread_join(thread_t *thread)
+{
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+
+    return;
+}
+
+void thread_yield(void)
+{
+    SwitchToThread();
+
+    return;
+}
+
+int thread_hardware_concurrency(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+
+    return (int) info.dwNumberOfProcessors;
+}
+
+// Seconds from an arbitrary origin on a clock that never jumps, so a change
+// to the system time cannot land inside a measurement.
+double thread_now(void)
+{
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+
+    return (double) counter.QuadPart / (double) frequency.QuadPart;
+}
+
+void mutex_init(mutex_t *mutex)    { InitializeSRWLock(mutex); }
+void mutex_destroy(mutex_t *mutex) { (void) mutex; }
+void mutex_lock(mutex_t *mutex)    { AcquireSRWLockExclusive(mutex); }
+void mutex_unlock(mutex_t *mutex)  { ReleaseSRWLockExclusive(mutex); }
+
+void cond_init(cond_t *cond)                 { InitializeConditionVariable(cond); }
+void cond_destroy(cond_t *cond)              { (void) cond; }
+void cond_wait(cond_t *cond, mutex_t *mutex) { SleepConditionVariableSRW(cond, mutex, INFINITE, 0); }
+void cond_signal(cond_t *cond)               { WakeConditionVariable(cond); }
+void cond_broadcast(cond_t *cond)            { WakeAllConditionVariable(cond); }
+#else
+int thread_create(thread_t *thread, thread_fn_t fn, void *arg)
+{
+    return pthread_create(&thread->handle, NULL, fn, arg) == 0;
+}
+
+void thread_join(thread_t *thread)
+{
+    pthread_join(thread->handle, NULL);
+
+    return;
+}
+
+void thread_yield(void)
+{
+    sched_yield();
+
+    return;
+}
+
+int thread_hardware_concurrency(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return count > 0 ? (int) count : 1;
+}
+
+double thread_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void mutex_init(mutex_t *mutex)    { pthread_mutex_init(mutex, NULL); }
+void mutex_destroy(mutex_t *mutex) { pthread_mutex_destroy(mutex); }
+void mutex_lock(mutex_t *mutex)    { pthread_mutex_lock(mutex); }
+void mutex_unlock(mutex_t *mutex)  { pthread_mutex_unlock(mutex); }
+
+void cond_init(cond_t *cond)                 { pthread_cond_init(cond, NULL); }
+void cond_destroy(cond_t *cond)              { pthread_cond_destroy(cond); }
+void cond_wait(cond_t *cond, mutex_t *mutex) { pthread_cond_wait(cond, mutex); }
+void cond_signal(cond_t *cond)               { pthread_cond_signal(cond); }
+void cond_broadcast(cond_t *cond)            { pthread_cond_broadcast(cond); }
+#endif
+
+static void thread_pool_run_tasks(thread_pool_t *pool, task_fn_t task, void *data, int count)
+{
+    int index;
+    while ((index = atomic_add_i32(&pool->next_index, 1)) < count)
+        task(data, index);
+
+    return;
+}
+
+static void *thread_pool_worker(void *arg)
+{
+    thread_pool_t *pool = (thread_pool_t *) arg;
+    unsigned int seen = 0;
+
+    mutex_lock(&pool->lock);
+    for (;;)
+    {
+        while (!pool->quit && pool->generation == seen)
+            cond_wait(&pool->work_ready, &pool->lock);
+
+        if (pool->quit)
+            break;
+
+        // Snapshot the batch under the lock; the caller cannot publish the
+        // next one until every active worker has checked back in.
+        seen = pool->generation;
+        task_fn_t task = pool->task;
+        void *data = pool->task_data;
+        int count = pool->task_count;
+        pool->active++;
+        mutex_unlock(&pool->lock);
+
+        thread_pool_run_tasks(pool, task, data, count);
+
+        mutex_lock(&pool->lock);
+        if (--pool->active == 0)
+            cond_signal(&pool->work_done);
+    }
+    mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+void thread_pool_init(thread_pool_t *pool, int worker_count)
+{
+    if (worker_count < 0)
+        worker_count = thread_hardware_concurrency() - 1;
+    if (worker_count < 0)
+        worker_count = 0;
+
+    pool->worker_count = worker_count;
+    pool->workers = worker_count ? (thread_t *) malloc(worker_count * sizeof(thread_t)) : NULL;
+    pool->task = NULL;
+    pool->task_data = NULL;
+    pool->task_count = 0;
+    pool->next_index = 0;
+    pool->active = 0;
+    pool->generation = 0;
+    pool->quit = false;
+
+    mutex_init(&pool->lock);
+    cond_init(&pool->work_ready);
+    cond_init(&pool->work_done);
+
+    for (int i = 0; i < worker_count; i++)
+    {
+        if (!thread_create(&pool->workers[i], thread_pool_worker, pool))
+        {
+            fprintf(stderr, "thread.h::error: failed to start worker %d\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return;
+}
+
+void thread_pool_destroy(thread_pool_t *pool)
+{
+    mutex_lock(&pool->lock);
+    pool->quit = true;
+    cond_broadcast(&pool->work_ready);
+    mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->worker_count; i++)
+        thread_join(&pool->workers[i]);
+
+    free(pool->workers);
+    pool->workers = NULL;
+    pool->worker_count = 0;
+
+    cond_destroy(&pool->work_done);
+    cond_destroy(&pool->work_ready);
+    mutex_destroy(&pool->lock);
+
+    return;
+}
+
+// Runs task(data, i) for every i in [0, count) on the workers and the calling
+// thread, returning once all of them have finished. Batches are issued from
+// one thread at a time.
+void thread_pool_for(thread_pool_t *pool, int count, task_fn_t task, void *data)
+{
+    if (count <= 0)
+        return;
+
+    if (pool == NULL || pool->worker_count == 0 || count == 1)
+    {
+        for (int i = 0; i < count; i++)
+            task(data, i);
+        return;
+    }
+
+    mutex_lock(&pool->lock);
+    // A worker that woke late for the previous batch may still hold its
+    // snapshot; let it drain before next_index is reset under it.
+    while (pool->active > 0)
+        cond_wait(&pool->work_done, &pool->lock);
+
+    pool->task = task;
+    pool->task_data = data;
+    pool->task_count = count;
+    atomic_store_i32(&pool->next_index, 0);
+    pool->generation++;
+    cond_broadcast(&pool->work_ready);
+    mutex_unlock(&pool->lock);
+
+    thread_pool_run_tasks(pool, task, data, count);
+
+    mutex_lock(&pool->lock);
+    while (pool->active > 0)
+        cond_wait(&pool->work_done, &pool->lock);
+    mutex_unlock(&pool->lock);
+
+    return;
+}
+
+#endif
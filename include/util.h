@@ -2,13 +2,22 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include "glstats.h"
+#include "profile.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include "texcomp.h"
+#include "filemap.h"
+
 #define INFO_LOG_BUFFER_SIZE 1024
+#define SHADER_CACHE_MAGIC   0x48435347u  // "GSCH"
+#define SHADER_INCLUDE_DEPTH 16
+#define SHADER_MAX_FEATURES  32
 
 typedef enum
 {
@@ -16,14 +25,154 @@ typedef enum
     FRAGMENT_SHADER,
 } shader_type_t;
 
+// How an image with a given channel count is stored on the GPU, chosen before
+// decoding so stb_image produces exactly that layout. RGB is padded to RGBA:
+// three-byte texels are not a native layout on most hardware and the driver
+// would convert every upload on the CPU. Gray and gray-alpha keep one and two
+// channels and are swizzled back to (l, l, l, a) when sampled.
+typedef struct
+{
+    GLint  internal_format;
+    GLenum format;
+    int    channel;              // channels requested from stb_image
+    GLint  swizzle[4];
+} texture_format_t;
+
+// A texture decoded on a worker thread and uploaded in row bands as stb_image
+// finishes them, so large images on slow storage show up before they are read
+// completely. Bytes come from a file or are pushed with texture_stream_feed().
+// The struct is shared with the worker and must stay put until closed.
+typedef struct
+{
+    unsigned int   texture;
+    int            width;
+    int            height;
+    int            vflip;
+
+    FILE          *file;
+    unsigned char *feed;
+    size_t         feed_size;
+    size_t         feed_read;
+    size_t         feed_capacity;
+    bool           feed_closed;
+    bool           feed_started;   // the decoder has had its first fill
+
+    unsigned char *pixels;         // RGBA, rows in upload order
+    int            rows_ready;
+    int            rows_uploaded;
+    bool           allocated;
+    bool           decoded;
+    bool           failed;
+    bool           joined;
+
+    mutex_t        lock;
+    cond_t         fed;
+    thread_t       worker;
+} texture_stream_t;
+
+// One texture of a texture_manifest_t. Everything but path, vflip and srgb
+// is filled in by texture_manifest_probe() and texture_manifest_allocate().
+typedef struct
+{
+    char             *path;
+    int               vflip;
+    bool              srgb;
+    int               width;
+    int               height;
+    texture_format_t  format;
+    int               levels;
+    size_t            size;        // bytes of the whole mip chain as uploaded
+    bool              probed;
+    unsigned int      texture;
+} texture_entry_t;
+
+// The textures a scene needs, known before any of them is decoded. Probing
+// reads only the image headers, so the sizes can be checked against the
+// limits and the storage for every texture created up front; loading then
+// only fills that storage and never redefines it.
+typedef struct
+{
+    texture_entry_t *entries;
+    int              count;
+    int              capacity;
+
+    int              max_size;     // longest edge accepted, 0 uses GL_MAX_TEXTURE_SIZE
+    size_t           budget;       // total bytes accepted, 0 for no limit
+    size_t           total_size;
+} texture_manifest_t;
+
+typedef struct shader_batch_entry
+{
+    unsigned int vshader;
+    unsigned int fshader;
+    unsigned int program;
+    unsigned long long key;
+    bool cached;
+    bool resolved;
+} shader_batch_entry_t;
+
+// Programs are compiled and linked as they are added, and their status is
+// only read back by shader_batch_get(), so the driver can work through the
+// whole batch at once instead of stalling on each program in turn.
+typedef struct shader_batch
+{
+    shader_batch_entry_t *entries;
+    int count;
+    int capacity;
+    bool parallel;
+} shader_batch_t;
+
+typedef struct shader_permutation
+{
+    unsigned int features;
+    int handle;
+    bool used;
+} shader_permutation_t;
+
+// Variants of one program selected by a feature bit set. Bit i defines
+// features[i] as 1 ahead of the sources; each variant is compiled the first
+// time it is prepared or asked for and kept until shader_permutations_free().
+typedef struct shader_permutations
+{
+    char vshader_path[256];
+    char fshader_path[256];
+    const char *features[SHADER_MAX_FEATURES];
+    int feature_count;
+
+    shader_batch_t batch;
+    shader_permutation_t *table;
+    int count;
+    int capacity;
+} shader_permutations_t;
+
+// Watches a program's sources and rebuilds it when either file is saved. The
+// watcher thread only waits for changes and reads the files; compiling and
+// swapping happen in shader_watch_update() on the thread that owns the context.
+typedef struct shader_watch
+{
+    char vshader_path[256];
+    char fshader_path[256];
+    volatile int program;
+
+    thread_t thread;
+    volatile int running;
+
+    mutex_t lock;
+    char *vshader_src;  // latest sources read by the watcher, under lock
+    char *fshader_src;
+
+    shader_batch_t batch;
+    int pending;
+} shader_watch_t;
+
 static int compilation_status = 0;
 static char info_log[INFO_LOG_BUFFER_SIZE];
 static bool wireframe_mode = false;
+static char shader_cache_dir[512];
 
-static long        get_stream_char_count(FILE *fp);
 static const char *parse_shader(const char *shader_path);
-static void        check_shader_compilation_error(const char *shader, shader_type_t type);
-static void        check_shader_program_compilation_error(unsigned int sp);
+static bool        check_shader_compilation_error(unsigned int shader, shader_type_t type);
+static bool        check_shader_program_compilation_error(unsigned int sp);
 
 int          glad_init(void);
 void         frame_buffer_size_callback(GLFWwindow *window, int xscale, int yscale);
@@ -32,45 +181,233 @@ void         key_callback(GLFWwindow *window, int key, int scancode, int action,
 unsigned int create_vbo(unsigned int vertex_data_size, float *vertex_data);
 unsigned int create_vao(void);
 unsigned int create_ebo(unsigned int index_data_size, unsigned int *index_data);
+char        *preprocess_shader(const char *shader_path, const char *defines);
+void         shader_cache_enable(const char *directory);
 unsigned int create_shader_program(const char *vshader_src_path, const char *fshader_src_path);
+void         shader_batch_init(shader_batch_t *batch);
+int          shader_batch_add(shader_batch_t *batch, const char *vshader_src_path, const char *fshader_src_path);
+int          shader_batch_add_source(shader_batch_t *batch, const char *vshader_src, const char *fshader_src);
+bool         shader_batch_ready(const shader_batch_t *batch, int handle);
+unsigned int shader_batch_get(shader_batch_t *batch, int handle);
+void         shader_batch_free(shader_batch_t *batch);
+void         shader_permutations_init(shader_permutations_t *permutations, const char *vshader_src_path, const char *fshader_src_path, const char **features, int feature_count);
+void         shader_permutations_prepare(shader_permutations_t *permutations, unsigned int features);
+unsigned int shader_permutations_get(shader_permutations_t *permutations, unsigned int features);
+void         shader_permutations_free(shader_permutations_t *permutations);
+void         shader_watch_init(shader_watch_t *watch, const char *vshader_src_path, const char *fshader_src_path);
+bool         shader_watch_update(shader_watch_t *watch);
+unsigned int shader_watch_program(shader_watch_t *watch);
+void         shader_watch_destroy(shader_watch_t *watch);
 void         use_shader_program(unsigned int sp);
+texture_format_t choose_texture_format(int channel, bool srgb);
 unsigned int load_texture(const char *image_path, int vflip);
+unsigned int load_texture_srgb(const char *image_path, int vflip);
+unsigned int upload_compressed_texture(const compressed_texture_t *tex);
+unsigned int load_compressed_texture(const char *image_path, int vflip, texcomp_format_t format, texcomp_quality_t quality, thread_pool_t *pool);
+void         texture_stream_open(texture_stream_t *stream, const char *image_path, int vflip);
+void         texture_stream_begin(texture_stream_t *stream, int vflip);
+void         texture_stream_feed(texture_stream_t *stream, const void *data, size_t size);
+void         texture_stream_end_feed(texture_stream_t *stream);
+bool         texture_stream_update(texture_stream_t *stream);
+void         texture_stream_close(texture_stream_t *stream);
+void         texture_manifest_init(texture_manifest_t *manifest, int max_size, size_t budget);
+void         texture_manifest_add(texture_manifest_t *manifest, const char *image_path, int vflip, bool srgb);
+void         texture_manifest_read(texture_manifest_t *manifest, const char *manifest_path);
+void         texture_manifest_probe(texture_manifest_t *manifest, thread_pool_t *pool);
+void         texture_manifest_allocate(texture_manifest_t *manifest);
+void         texture_manifest_load(texture_manifest_t *manifest, thread_pool_t *pool);
+void         texture_manifest_free(texture_manifest_t *manifest);
 
 #ifdef UTIL_IMPLEMENTATION
 
-static long get_stream_char_count(FILE *fp)
+#include <string.h>
+
+#define __FILENAME__ (strrchr(__FILE__, '\\') ? strrchr(__FILE__, '\\') + 1 : __FILE__)
+
+typedef struct shader_text
+{
+    char *data;
+    size_t length;
+    size_t capacity;
+} shader_text_t;
+
+static void shader_text_append(shader_text_t *text, const char *data, size_t length)
 {
-    fseek(fp, 0, SEEK_END);
-    long count = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
+    if (text->length + length + 1 > text->capacity)
+    {
+        size_t capacity = text->capacity ? text->capacity : 4096;
+        while (capacity < text->length + length + 1)
+            capacity *= 2;
+
+        text->data = (char *) realloc(text->data, capacity);
+        if (text->data == NULL)
+        {
+            fprintf(stderr, "%s::error: out of memory for shader source\n", __FILENAME__);
+            exit(EXIT_FAILURE);
+        }
+        text->capacity = capacity;
+    }
 
-    return count;
+    memcpy(text->data + text->length, data, length);
+    text->length += length;
+    text->data[text->length] = '\0';
+
+    return;
 }
-#include <string.h>
 
-#define __FILENAME__ (strrchr(__FILE__, '\\') ? strrchr(__FILE__, '\\') + 1 : __FILE__)
+static void shader_text_line(shader_text_t *text, int line, int source)
+{
+    char directive[32];
+    int length = sprintf(directive, "#line %d %d\n", line, source);
+    shader_text_append(text, directive, length);
 
-static const char *parse_shader(const char *shader_path)
+    return;
+}
+
+// Finds a directive at the start of a line, leading blanks allowed.
+static const char *shader_directive(const char *line, const char *line_end, const char *name)
 {
-    FILE *fp = fopen(shader_path, "rb");
-    if (fp == NULL)
+    while (line < line_end && (*line == ' ' || *line == '\t'))
+        line++;
+
+    size_t length = strlen(name);
+    if ((size_t) (line_end - line) < length || memcmp(line, name, length) != 0)
+        return NULL;
+
+    return line + length;
+}
+
+// Each file gets its own source string number in the #line directives, so a
+// compile error reads "<file index>(<line>)" where the index counts the files
+// in the order they were included, starting from 0 for the top level file.
+// Direct reads, includes and all, skip the mounted packs.
+static bool preprocess_shader_file(shader_text_t *text, const char *shader_path, const char *defines, int depth, int *file_count, bool direct)
+{
+    if (depth > SHADER_INCLUDE_DEPTH)
+    {
+        fprintf(stderr, "%s::error: #include nested too deeply at \"%s\"\n", __FILENAME__, shader_path);
+        return false;
+    }
+
+    file_map_t file;
+    if (!(direct ? file_map_open_direct(&file, shader_path) : file_map_open(&file, shader_path)))
     {
         fprintf(stderr, "%s::error: cannot find \"%s\"\n", __FILENAME__, shader_path);
-        exit(EXIT_FAILURE);
+        return false;
     }
 
-    long size = get_stream_char_count(fp);
-    char *shader_src = (char *) malloc(size + 1);
+    const char *src = (const char *) file.data;
+    const char *src_end = src + file.size;
 
-    fread(shader_src, size, 1, fp);
-    shader_src[size] = '\0';
+    int source = (*file_count)++;
+    bool defined = defines == NULL || depth > 0;
 
-    fclose(fp);
+    // #version has to come first, so defines go after it when there is one
+    if (!defined)
+    {
+        bool versioned = false;
+        for (const char *start = src; start < src_end && !versioned; )
+        {
+            const char *end = (const char *) memchr(start, '\n', src_end - start);
+            const char *line_end = end ? end : src_end;
+
+            versioned = shader_directive(start, line_end, "#version") != NULL;
+            start = line_end + 1;
+        }
+
+        if (!versioned)
+        {
+            shader_text_append(text, defines, strlen(defines));
+            shader_text_line(text, 1, source);
+            defined = true;
+        }
+    }
+
+    bool ok = true;
+    int line = 1;
+    for (const char *start = src; start < src_end && ok; line++)
+    {
+        const char *end = (const char *) memchr(start, '\n', src_end - start);
+        const char *line_end = end ? end : src_end;
+        const char *directive;
+
+        if ((directive = shader_directive(start, line_end, "#include")) != NULL)
+        {
+            const char *open = (const char *) memchr(directive, '"', line_end - directive);
+            const char *close = open ? (const char *) memchr(open + 1, '"', line_end - open - 1) : NULL;
+            if (close == NULL)
+            {
+                fprintf(stderr, "%s::error: %s:%d: expected #include \"file\"\n", __FILENAME__, shader_path, line);
+                ok = false;
+                break;
+            }
+
+            // includes are relative to the including file
+            char include_path[512];
+            const char *name = shader_path;
+            for (const char *c = shader_path; *c; c++)
+                if (*c == '/' || *c == '\\')
+                    name = c + 1;
+            snprintf(include_path, sizeof(include_path), "%.*s%.*s", (int) (name - shader_path), shader_path, (int) (close - open - 1), open + 1);
+
+            shader_text_line(text, 1, *file_count);
+            ok = preprocess_shader_file(text, include_path, defines, depth + 1, file_count, direct);
+            shader_text_line(text, line + 1, source);
+        } else
+        {
+            shader_text_append(text, start, line_end - start);
+            shader_text_append(text, "\n", 1);
+
+            if (!defined && shader_directive(start, line_end, "#version"))
+            {
+                shader_text_append(text, defines, strlen(defines));
+                shader_text_line(text, line + 1, source);
+                defined = true;
+            }
+        }
+
+        start = line_end + 1;
+    }
+
+    file_map_close(&file);
+
+    return ok;
+}
+
+static char *preprocess_shader_from(const char *shader_path, const char *defines, bool direct)
+{
+    shader_text_t text = { 0 };
+    int file_count = 0;
+
+    shader_text_append(&text, "", 0);
+
+    if (!preprocess_shader_file(&text, shader_path, defines, 0, &file_count, direct))
+    {
+        free(text.data);
+        return NULL;
+    }
+
+    return text.data;
+}
+
+// Expands #include "file" and injects defines, a string of #define lines, just
+// after #version. Returns NULL after printing the reason on failure.
+char *preprocess_shader(const char *shader_path, const char *defines)
+{
+    return preprocess_shader_from(shader_path, defines, false);
+}
+
+static const char *parse_shader(const char *shader_path)
+{
+    char *shader_src = preprocess_shader(shader_path, NULL);
+    if (shader_src == NULL)
+        exit(EXIT_FAILURE);
 
     return shader_src;
 }
 
-static void check_shader_compilation_error(const char *shader, shader_type_t type)
+// Both checks print the info log and leave it to the caller whether a failure is fatal.
+static bool check_shader_compilation_error(unsigned int shader, shader_type_t type)
 {
     glGetShaderiv(shader, GL_COMPILE_STATUS, &compilation_status);
     if (compilation_status == false)
@@ -82,21 +419,24 @@ static void check_shader_compilation_error(const char *shader, shader_type_t typ
         if (type == FRAGMENT_SHADER)
             fprintf(stderr, "%s::fragment_shader::error: compilation failed\n%s\n", __FILENAME__, info_log);
 
-        exit(EXIT_FAILURE);
+        return false;
     }
+
+    return true;
 }
 
-static void check_shader_program_compilation_error(unsigned int sp)
+static bool check_shader_program_compilation_error(unsigned int sp)
 {
-    glGetShaderiv(sp, GL_COMPILE_STATUS, &compilation_status);
+    glGetProgramiv(sp, GL_LINK_STATUS, &compilation_status);
 
     if (!compilation_status)
     {
         glGetProgramInfoLog(sp, 512, NULL, info_log);
-        exit(EXIT_FAILURE);
+        fprintf(stderr, "%s::shader_program::error: linking failed\n%s\n", __FILENAME__, info_log);
+        return false;
     }
 
-    return;
+    return true;
 }
 
 int glad_init(void)
@@ -136,8 +476,10 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
 {
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
         glfwSetWindowShouldClose(window, GL_TRUE);
+    // the callback runs on the thread polling events, which need not have
+    // the context; whoever draws picks the mode up from wireframe_mode
     if (key == GLFW_KEY_X && action == GLFW_PRESS)
-        toggle_wireframe_mode();
+        wireframe_mode = !wireframe_mode;
 
     return;
 }
@@ -174,78 +516,1590 @@ unsigned int create_ebo(unsigned int index_data_size, unsigned int *index_data)
     return ebo;
 }
 
-unsigned int create_shader_program(const char *vshader_src_path, const char *fshader_src_path)
-{ 
+#include <sys/stat.h>
+#ifdef _WIN32
+    #include <direct.h>
+    #define make_directory(path) _mkdir(path)
+#else
+    #define make_directory(path) mkdir(path, 0755)
+#endif
+
+// Linked programs are saved with glGetProgramBinary under a name derived from
+// their sources and the driver strings, so an edited shader or a driver update
+// simply misses. Binaries need GL 4.1 or ARB_get_program_binary; without them
+// the cache stays empty and every program is compiled as before.
+void shader_cache_enable(const char *directory)
+{
+    if (strlen(directory) + 32 > sizeof(shader_cache_dir))
+    {
+        fprintf(stderr, "%s::error: shader cache path \"%s\" is too long\n", __FILENAME__, directory);
+        exit(EXIT_FAILURE);
+    }
+
+    strcpy(shader_cache_dir, directory);
+    make_directory(shader_cache_dir);
+
+    return;
+}
+
+static unsigned long long shader_cache_hash(unsigned long long hash, const char *text)
+{
+    // FNV-1a, terminator included so "ab" + "c" and "a" + "bc" differ
+    do
+    {
+        hash ^= (unsigned char) *text;
+        hash *= 1099511628211ull;
+    } while (*text++);
+
+    return hash;
+}
+
+static unsigned long long shader_cache_key(const char *vshader_src, const char *fshader_src)
+{
+    unsigned long long key = 14695981039346656037ull;
+
+    key = shader_cache_hash(key, vshader_src);
+    key = shader_cache_hash(key, fshader_src);
+    key = shader_cache_hash(key, (const char *) glGetString(GL_VENDOR));
+    key = shader_cache_hash(key, (const char *) glGetString(GL_RENDERER));
+    key = shader_cache_hash(key, (const char *) glGetString(GL_VERSION));
+
+    return key;
+}
+
+static void shader_cache_path(char *path, unsigned long long key)
+{
+    sprintf(path, "%s/%016llx.bin", shader_cache_dir, key);
+
+    return;
+}
+
+#ifdef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+static bool shader_cache_supported(void)
+{
+    int formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+    return shader_cache_dir[0] != '\0' && formats > 0;
+}
+
+// Returns 0 when there is no usable binary; the driver rejects ones it
+// cannot take, and a rejected or damaged file is rebuilt on the next store.
+static unsigned int shader_cache_load(unsigned long long key)
+{
+    char path[sizeof(shader_cache_dir)];
+    shader_cache_path(path, key);
+
+    file_map_t file;
+    if (!file_map_open(&file, path))
+        return 0;
+
+    unsigned int header[3] = { 0 };
+    unsigned long long stored_key = 0;
+    size_t header_size = sizeof(header) + sizeof(stored_key);
+    unsigned int program = 0;
+
+    if (file.size > header_size)
+    {
+        memcpy(header, file.data, sizeof(header));
+        memcpy(&stored_key, file.data + sizeof(header), sizeof(stored_key));
+    }
+
+    if (header[0] == SHADER_CACHE_MAGIC && stored_key == key && header[2] == file.size - header_size)
+    {
+        program = glCreateProgram();
+        glProgramBinary(program, (GLenum) header[1], file.data + header_size, (GLsizei) header[2]);
+
+        int linked = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked)
+        {
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+
+    file_map_close(&file);
+
+    return program;
+}
+
+static void shader_cache_store(unsigned int program, unsigned long long key)
+{
+    int length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    void *binary = malloc(length);
+    if (binary == NULL)
+        return;
+
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary);
+
+    char path[sizeof(shader_cache_dir)];
+    shader_cache_path(path, key);
+
+    // a failed write only costs a recompile next time
+    FILE *fp = fopen(path, "wb");
+    if (fp)
+    {
+        unsigned int header[3] = { SHADER_CACHE_MAGIC, (unsigned int) format, (unsigned int) length };
+        fwrite(header, sizeof(header), 1, fp);
+        fwrite(&key, sizeof(key), 1, fp);
+        fwrite(binary, length, 1, fp);
+        fclose(fp);
+    }
+
+    free(binary);
+
+    return;
+}
+#else
+static bool         shader_cache_supported(void)                                 { return false; }
+static unsigned int shader_cache_load(unsigned long long key)                    { (void) key; return 0; }
+static void         shader_cache_store(unsigned int program, unsigned long long key) { (void) program; (void) key; }
+#endif
+
+static bool has_gl_extension(const char *name)
+{
+    int count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+    for (int i = 0; i < count; i++)
+        if (strcmp((const char *) glGetStringi(GL_EXTENSIONS, i), name) == 0)
+            return true;
+
+    return false;
+}
+
+#ifdef GL_KHR_parallel_shader_compile
+// Checked and set up on first use only; like every batch call it runs on the
+// thread that owns the one context.
+static bool shader_batch_parallel(void)
+{
+    static int parallel = -1;
+    if (parallel < 0)
+    {
+        parallel = has_gl_extension("GL_KHR_parallel_shader_compile");
+        if (parallel)
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);  // let the driver pick
+    }
+
+    return parallel > 0;
+}
+#endif
+
+void shader_batch_init(shader_batch_t *batch)
+{
+    memset(batch, 0, sizeof(*batch));
+
+#ifdef GL_KHR_parallel_shader_compile
+    batch->parallel = shader_batch_parallel();
+#endif
+
+    return;
+}
+
+int shader_batch_add(shader_batch_t *batch, const char *vshader_src_path, const char *fshader_src_path)
+{
     const char *vshader_src = parse_shader(vshader_src_path);
     const char *fshader_src = parse_shader(fshader_src_path);
 
-    // Vertex Shader
-    unsigned int vshader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vshader, 1, &vshader_src, NULL);
-    glCompileShader(vshader);
+    int handle = shader_batch_add_source(batch, vshader_src, fshader_src);
+
+    free((void *) vshader_src);
+    free((void *) fshader_src);
+
+    return handle;
+}
 
-    check_shader_compilation_error(vshader, VERTEX_SHADER);
+// The sources are copied by GL and can be freed as soon as this returns.
+int shader_batch_add_source(shader_batch_t *batch, const char *vshader_src, const char *fshader_src)
+{
+    if (batch->count == batch->capacity)
+    {
+        batch->capacity = batch->capacity ? batch->capacity * 2 : 16;
+        batch->entries = (shader_batch_entry_t *) realloc(batch->entries, batch->capacity * sizeof(*batch->entries));
+        if (batch->entries == NULL)
+        {
+            fprintf(stderr, "%s::error: out of memory for shader batch\n", __FILENAME__);
+            exit(EXIT_FAILURE);
+        }
+    }
 
-    // Fragment Shader
-    unsigned int fshader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fshader, 1, &fshader_src, NULL);
-    glCompileShader(fshader);
+    shader_batch_entry_t *entry = &batch->entries[batch->count];
+    memset(entry, 0, sizeof(*entry));
 
-    check_shader_compilation_error(fshader, FRAGMENT_SHADER);
+    bool cache = shader_cache_supported();
+    if (cache)
+    {
+        entry->key = shader_cache_key(vshader_src, fshader_src);
+        entry->program = shader_cache_load(entry->key);
+        entry->cached = entry->program != 0;
+    }
 
-    // Shader Program
-    unsigned int shader_program = glCreateProgram();
-    glAttachShader(shader_program, vshader);
-    glAttachShader(shader_program, fshader);
-    glLinkProgram(shader_program);
+    if (!entry->cached)
+    {
+        // no status queries here; they would wait for the compile to finish
+        entry->vshader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(entry->vshader, 1, &vshader_src, NULL);
+        glCompileShader(entry->vshader);
 
-    check_shader_program_compilation_error(shader_program);
+        entry->fshader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(entry->fshader, 1, &fshader_src, NULL);
+        glCompileShader(entry->fshader);
 
-    glDeleteShader(vshader);
-    glDeleteShader(fshader);
+        entry->program = glCreateProgram();
+        glAttachShader(entry->program, entry->vshader);
+        glAttachShader(entry->program, entry->fshader);
+#ifdef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+        if (cache)
+            glProgramParameteri(entry->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
+        glLinkProgram(entry->program);
+    }
 
-    return shader_program;
+    return batch->count++;
 }
 
-void use_shader_program(unsigned int sp)
+// Without the extension there is no way to ask without blocking, so every
+// program reports ready and shader_batch_get() takes the wait instead.
+bool shader_batch_ready(const shader_batch_t *batch, int handle)
 {
-    glUseProgram(sp);
+    const shader_batch_entry_t *entry = &batch->entries[handle];
+
+    if (entry->resolved || entry->cached || !batch->parallel)
+        return true;
+
+    int done = GL_TRUE;
+#ifdef GL_KHR_parallel_shader_compile
+    glGetProgramiv(entry->program, GL_COMPLETION_STATUS_KHR, &done);
+#endif
+
+    return done == GL_TRUE;
+}
+
+// A program that fails to build is deleted and resolves to 0.
+static unsigned int shader_batch_resolve(shader_batch_t *batch, int handle)
+{
+    shader_batch_entry_t *entry = &batch->entries[handle];
+
+    if (entry->resolved)
+        return entry->program;
+
+    if (!entry->cached)
+    {
+        bool ok = check_shader_compilation_error(entry->vshader, VERTEX_SHADER)
+               && check_shader_compilation_error(entry->fshader, FRAGMENT_SHADER)
+               && check_shader_program_compilation_error(entry->program);
+
+        glDetachShader(entry->program, entry->vshader);
+        glDetachShader(entry->program, entry->fshader);
+        glDeleteShader(entry->vshader);
+        glDeleteShader(entry->fshader);
+
+        if (!ok)
+        {
+            glDeleteProgram(entry->program);
+            entry->program = 0;
+        } else if (shader_cache_supported())
+            shader_cache_store(entry->program, entry->key);
+    }
+
+    entry->resolved = true;
+
+    return entry->program;
+}
+
+unsigned int shader_batch_get(shader_batch_t *batch, int handle)
+{
+    unsigned int program = shader_batch_resolve(batch, handle);
+    if (program == 0)
+        exit(EXIT_FAILURE);
+
+    return program;
+}
+
+// Programs already handed out by shader_batch_get() belong to the caller;
+// the rest are deleted.
+void shader_batch_free(shader_batch_t *batch)
+{
+    for (int i = 0; i < batch->count; i++)
+    {
+        shader_batch_entry_t *entry = &batch->entries[i];
+        if (entry->resolved)
+            continue;
+
+        if (!entry->cached)
+        {
+            glDeleteShader(entry->vshader);
+            glDeleteShader(entry->fshader);
+        }
+        glDeleteProgram(entry->program);
+    }
+
+    free(batch->entries);
+    memset(batch, 0, sizeof(*batch));
 
     return;
 }
 
-unsigned int load_texture(const char *image_path, int vflip)
+unsigned int create_shader_program(const char *vshader_src_path, const char *fshader_src_path)
+{ 
+    shader_batch_t batch;
+    shader_batch_init(&batch);
+
+    unsigned int shader_program = shader_batch_get(&batch, shader_batch_add(&batch, vshader_src_path, fshader_src_path));
+
+    shader_batch_free(&batch);
+
+    return shader_program;
+}
+
+void shader_permutations_init(shader_permutations_t *permutations, const char *vshader_src_path, const char *fshader_src_path, const char **features, int feature_count)
 {
-    unsigned int tex = 0;
+    memset(permutations, 0, sizeof(*permutations));
 
-    glGenTextures(1, &tex);
-    glBindTexture(GL_TEXTURE_2D, tex);
+    if (feature_count > SHADER_MAX_FEATURES
+        || strlen(vshader_src_path) >= sizeof(permutations->vshader_path)
+        || strlen(fshader_src_path) >= sizeof(permutations->fshader_path))
+    {
+        fprintf(stderr, "%s::error: invalid shader permutation set \"%s\"\n", __FILENAME__, fshader_src_path);
+        exit(EXIT_FAILURE);
+    }
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    strcpy(permutations->vshader_path, vshader_src_path);
+    strcpy(permutations->fshader_path, fshader_src_path);
+    memcpy(permutations->features, features, feature_count * sizeof(*features));
+    permutations->feature_count = feature_count;
 
-    stbi_set_flip_vertically_on_load(vflip);
+    shader_batch_init(&permutations->batch);
 
-    int image_width, image_height, channel;
-    unsigned char *image_data = stbi_load(image_path, &image_width, &image_height, &channel, 0);
+    return;
+}
 
-    if (image_data)
+static shader_permutation_t *shader_permutations_find(shader_permutations_t *permutations, unsigned int features)
+{
+    if (permutations->capacity == 0)
+        return NULL;
+
+    // open addressing, kept at most half full
+    unsigned int mask = permutations->capacity - 1;
+    for (unsigned int i = (features * 2654435761u) & mask; ; i = (i + 1) & mask)
     {
-        if (channel == 4)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image_width, image_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image_data);
-        if (channel == 3)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image_width, image_height, 0, GL_RGB, GL_UNSIGNED_BYTE, image_data);
-        
-        glGenerateMipmap(GL_TEXTURE_2D);
-    } else
+        shader_permutation_t *slot = &permutations->table[i];
+        if (!slot->used || slot->features == features)
+            return slot;
+    }
+}
+
+static void shader_permutations_grow(shader_permutations_t *permutations)
+{
+    shader_permutation_t *table = permutations->table;
+    int capacity = permutations->capacity;
+
+    permutations->capacity = capacity ? capacity * 2 : 64;
+    permutations->table = (shader_permutation_t *) calloc(permutations->capacity, sizeof(*permutations->table));
+    if (permutations->table == NULL)
     {
-        fprintf(stderr, "%s::error: failed to load texture \"%s\"\n", __FILENAME__, image_path);
+        fprintf(stderr, "%s::error: out of memory for shader permutations\n", __FILENAME__);
         exit(EXIT_FAILURE);
     }
 
-    return tex;
+    for (int i = 0; i < capacity; i++)
+        if (table[i].used)
+            *shader_permutations_find(permutations, table[i].features) = table[i];
+
+    free(table);
+
+    return;
+}
+
+// Submits a variant without waiting for it, so a frame can queue the variants
+// it is about to need and let them compile together.
+void shader_permutations_prepare(shader_permutations_t *permutations, unsigned int features)
+{
+    shader_permutation_t *slot = shader_permutations_find(permutations, features);
+    if (slot && slot->used)
+        return;
+
+    if (permutations->feature_count < 32 && features >> permutations->feature_count)
+    {
+        fprintf(stderr, "%s::error: unknown feature bits 0x%x for \"%s\"\n", __FILENAME__, features, permutations->fshader_path);
+        exit(EXIT_FAILURE);
+    }
+
+    shader_text_t defines = { 0 };
+    shader_text_append(&defines, "", 0);
+    for (int i = 0; i < permutations->feature_count; i++)
+    {
+        if (features & (1u << i))
+        {
+            char define[128];
+            int length = snprintf(define, sizeof(define), "#define %s 1\n", permutations->features[i]);
+            shader_text_append(&defines, define, length);
+        }
+    }
+
+    char *vshader_src = preprocess_shader(permutations->vshader_path, defines.data);
+    char *fshader_src = preprocess_shader(permutations->fshader_path, defines.data);
+    free(defines.data);
+
+    if (vshader_src == NULL || fshader_src == NULL)
+        exit(EXIT_FAILURE);
+
+    int handle = shader_batch_add_source(&permutations->batch, vshader_src, fshader_src);
+
+    free(vshader_src);
+    free(fshader_src);
+
+    if (2 * (permutations->count + 1) > permutations->capacity)
+        shader_permutations_grow(permutations);
+
+    slot = shader_permutations_find(permutations, features);
+    slot->features = features;
+    slot->handle = handle;
+    slot->used = true;
+    permutations->count++;
+
+    return;
+}
+
+unsigned int shader_permutations_get(shader_permutations_t *permutations, unsigned int features)
+{
+    shader_permutation_t *slot = shader_permutations_find(permutations, features);
+    if (slot == NULL || !slot->used)
+    {
+        shader_permutations_prepare(permutations, features);
+        slot = shader_permutations_find(permutations, features);
+    }
+
+    return shader_batch_get(&permutations->batch, slot->handle);
+}
+
+void shader_permutations_free(shader_permutations_t *permutations)
+{
+    // the batch only deletes programs nobody has asked for yet
+    for (int i = 0; i < permutations->batch.count; i++)
+        if (permutations->batch.entries[i].resolved)
+            glDeleteProgram(permutations->batch.entries[i].program);
+
+    shader_batch_free(&permutations->batch);
+    free(permutations->table);
+    memset(permutations, 0, sizeof(*permutations));
+
+    return;
+}
+
+#ifdef __linux__
+    #include <poll.h>
+    #include <sys/inotify.h>
+#endif
+
+static const char *shader_watch_basename(const char *path)
+{
+    const char *name = path;
+    for (const char *c = path; *c; c++)
+        if (*c == '/' || *c == '\\')
+            name = c + 1;
+
+    return name;
+}
+
+static bool shader_watch_extension(const char *name, const char *path)
+{
+    const char *a = strrchr(name, '.');
+    const char *b = strrchr(shader_watch_basename(path), '.');
+
+    return a && b && strcmp(a, b) == 0;
+}
+
+static void shader_watch_read(shader_watch_t *watch)
+{
+    PROFILE_ZONE_BEGIN("shader reload");
+    // what changed is the loose file, never the copy a pack may hold
+    char *vshader_src = preprocess_shader_from(watch->vshader_path, NULL, true);
+    char *fshader_src = preprocess_shader_from(watch->fshader_path, NULL, true);
+
+    // a half written file fails to read or compile; the next save retries
+    if (vshader_src && fshader_src)
+    {
+        mutex_lock(&watch->lock);
+        free(watch->vshader_src);
+        free(watch->fshader_src);
+        watch->vshader_src = vshader_src;
+        watch->fshader_src = fshader_src;
+        mutex_unlock(&watch->lock);
+    } else
+    {
+        free(vshader_src);
+        free(fshader_src);
+    }
+    PROFILE_ZONE_END();
+
+    return;
+}
+
+#ifdef __linux__
+// Directories are watched rather than the files, since most editors save by
+// writing a new file and renaming it over the old one.
+static void *shader_watch_thread(void *arg)
+{
+    shader_watch_t *watch = (shader_watch_t *) arg;
+    PROFILE_THREAD_NAME("shader watch");
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+    {
+        fprintf(stderr, "%s::warning: cannot watch shaders, hot reload is off\n", __FILENAME__);
+        return NULL;
+    }
+
+    const char *paths[2] = { watch->vshader_path, watch->fshader_path };
+    for (int i = 0; i < 2; i++)
+    {
+        char directory[256];
+        int length = (int) (shader_watch_basename(paths[i]) - paths[i]);
+        if (length == 0)
+            strcpy(directory, ".");
+        else
+            sprintf(directory, "%.*s", length, paths[i]);
+
+        inotify_add_watch(fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO);
+    }
+
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd pfd = { fd, POLLIN, 0 };
+
+    while (atomic_load_i32(&watch->running))
+    {
+        // the timeout only bounds how long shader_watch_destroy() waits
+        if (poll(&pfd, 1, 100) <= 0)
+            continue;
+
+        bool changed = false;
+        ssize_t size;
+        while ((size = read(fd, events, sizeof(events))) > 0)
+        {
+            for (char *p = events; p < events + size; )
+            {
+                struct inotify_event *event = (struct inotify_event *) p;
+                // included files change too, so anything sharing an extension with the sources counts
+                if (event->len
+                    && (shader_watch_extension(event->name, watch->vshader_path)
+                        || shader_watch_extension(event->name, watch->fshader_path)))
+                    changed = true;
+
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+
+        if (changed)
+            shader_watch_read(watch);
+    }
+
+    close(fd);
+
+    return NULL;
+}
+#else
+// Whole seconds would miss a quick second save, so read the finer timestamps.
+static long long shader_watch_mtime(const char *path)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &info))
+        return 0;
+
+    return ((long long) info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime;
+#else
+    struct stat info;
+    if (stat(path, &info) != 0)
+        return 0;
+
+#ifdef __APPLE__
+    return (long long) info.st_mtimespec.tv_sec * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+    return (long long) info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+#endif
+}
+
+// Without inotify the sources are polled for a new modification time.
+static void *shader_watch_thread(void *arg)
+{
+    shader_watch_t *watch = (shader_watch_t *) arg;
+    PROFILE_THREAD_NAME("shader watch");
+
+    long long vshader_mtime = shader_watch_mtime(watch->vshader_path);
+    long long fshader_mtime = shader_watch_mtime(watch->fshader_path);
+
+    while (atomic_load_i32(&watch->running))
+    {
+#ifdef _WIN32
+        Sleep(100);
+#else
+        usleep(100000);
+#endif
+
+        long long vshader_now = shader_watch_mtime(watch->vshader_path);
+        long long fshader_now = shader_watch_mtime(watch->fshader_path);
+        if (vshader_now != vshader_mtime || fshader_now != fshader_mtime)
+        {
+            vshader_mtime = vshader_now;
+            fshader_mtime = fshader_now;
+            shader_watch_read(watch);
+        }
+    }
+
+    return NULL;
+}
+#endif
+
+void shader_watch_init(shader_watch_t *watch, const char *vshader_src_path, const char *fshader_src_path)
+{
+    memset(watch, 0, sizeof(*watch));
+
+    if (strlen(vshader_src_path) >= sizeof(watch->vshader_path) || strlen(fshader_src_path) >= sizeof(watch->fshader_path))
+    {
+        fprintf(stderr, "%s::error: shader path is too long to watch\n", __FILENAME__);
+        exit(EXIT_FAILURE);
+    }
+
+    strcpy(watch->vshader_path, vshader_src_path);
+    strcpy(watch->fshader_path, fshader_src_path);
+
+    // the first build has nothing to fall back to, so it fails like create_shader_program()
+    watch->program = (int) create_shader_program(vshader_src_path, fshader_src_path);
+    watch->pending = -1;
+
+    mutex_init(&watch->lock);
+    watch->running = 1;
+    if (!thread_create(&watch->thread, shader_watch_thread, watch))
+    {
+        fprintf(stderr, "%s::warning: cannot start shader watcher, hot reload is off\n", __FILENAME__);
+        watch->running = 0;
+    }
+
+    return;
+}
+
+// Call once per frame on the context thread. New sources go into a batch, so
+// with parallel compilation the old program keeps drawing until the new one
+// is linked. Returns true on the frame the program changes.
+bool shader_watch_update(shader_watch_t *watch)
+{
+    if (watch->pending < 0)
+    {
+        mutex_lock(&watch->lock);
+        char *vshader_src = watch->vshader_src;
+        char *fshader_src = watch->fshader_src;
+        watch->vshader_src = NULL;
+        watch->fshader_src = NULL;
+        mutex_unlock(&watch->lock);
+
+        if (vshader_src == NULL)
+            return false;
+
+        shader_batch_init(&watch->batch);
+        watch->pending = shader_batch_add_source(&watch->batch, vshader_src, fshader_src);
+
+        free(vshader_src);
+        free(fshader_src);
+    }
+
+    if (!shader_batch_ready(&watch->batch, watch->pending))
+        return false;
+
+    unsigned int program = shader_batch_resolve(&watch->batch, watch->pending);
+    shader_batch_free(&watch->batch);
+    watch->pending = -1;
+
+    if (program == 0)
+    {
+        fprintf(stderr, "%s::warning: keeping the previous \"%s\" program\n", __FILENAME__, watch->fshader_path);
+        return false;
+    }
+
+    unsigned int previous = (unsigned int) watch->program;
+    atomic_store_i32(&watch->program, (int) program);
+    glDeleteProgram(previous);
+
+    return true;
+}
+
+unsigned int shader_watch_program(shader_watch_t *watch)
+{
+    return (unsigned int) atomic_load_i32(&watch->program);
+}
+
+void shader_watch_destroy(shader_watch_t *watch)
+{
+    if (watch->running)
+    {
+        atomic_store_i32(&watch->running, 0);
+        thread_join(&watch->thread);
+    }
+
+    if (watch->pending >= 0)
+        shader_batch_free(&watch->batch);
+
+    free(watch->vshader_src);
+    free(watch->fshader_src);
+    mutex_destroy(&watch->lock);
+    glDeleteProgram((unsigned int) watch->program);
+
+    return;
+}
+
+void use_shader_program(unsigned int sp)
+{
+    glUseProgram(sp);
+
+    return;
+}
+
+// Images are decoded straight from a mapped view of the file instead of
+// through stdio, which saves a copy and a heap buffer per file.
+static int image_file_info(const char *image_path, int *width, int *height, int *channel)
+{
+    file_map_t file;
+    if (!file_map_open(&file, image_path))
+        return 0;
+
+    int ok = file.size <= INT_MAX && stbi_info_from_memory(file.data, (int) file.size, width, height, channel);
+    file_map_close(&file);
+
+    return ok;
+}
+
+static unsigned char *load_image_file(const char *image_path, int *width, int *height, int *channel, int req_channel, stbi_load_options *options)
+{
+    file_map_t file;
+    if (!file_map_open(&file, image_path))
+        return NULL;
+
+    unsigned char *image_data = NULL;
+    if (file.size <= INT_MAX)
+        image_data = stbi_load_from_memory_ex(file.data, (int) file.size, width, height, channel, req_channel, options);
+    file_map_close(&file);
+
+    return image_data;
+}
+
+texture_format_t choose_texture_format(int channel, bool srgb)
+{
+    texture_format_t format = { GL_RGBA8, GL_RGBA, 4, { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA } };
+
+    // core GL has no one or two channel sRGB format, so sRGB gray is expanded
+    if (srgb)
+        format.internal_format = GL_SRGB8_ALPHA8;
+    else if (channel == 1)
+        format = (texture_format_t) { GL_R8, GL_RED, 1, { GL_RED, GL_RED, GL_RED, GL_ONE } };
+    else if (channel == 2)
+        format = (texture_format_t) { GL_RG8, GL_RG, 2, { GL_RED, GL_RED, GL_RED, GL_GREEN } };
+
+    return format;
+}
+
+// stb_image rows are tightly packed; this is the largest alignment they
+// still satisfy, since some drivers take a slower path for an alignment of 1.
+static int unpack_alignment(int width, int channel)
+{
+    int row_size = width * channel;
+
+    return row_size % 8 == 0 ? 8 : row_size % 4 == 0 ? 4 : row_size % 2 == 0 ? 2 : 1;
+}
+
+static void upload_texture_image(int width, int height, const texture_format_t *format, const void *pixels)
+{
+    glPixelStorei(GL_UNPACK_ALIGNMENT, unpack_alignment(width, format->channel));
+    glTexImage2D(GL_TEXTURE_2D, 0, format->internal_format, width, height, 0, format->format, GL_UNSIGNED_BYTE, pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    return;
+}
+
+// The image is decoded straight into a mapped pixel unpack buffer, so the
+// pixels skip the heap copy on their way to the driver. If the buffer cannot
+// be mapped (or its contents are lost on unmap) it falls back to a normal load.
+static unsigned int load_texture_with_format(const char *image_path, int vflip, bool srgb)
+{
+    unsigned int tex = 0;
+
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    int image_width, image_height, channel;
+    if (!image_file_info(image_path, &image_width, &image_height, &channel))
+    {
+        fprintf(stderr, "%s::error: failed to load texture \"%s\"\n", __FILENAME__, image_path);
+        exit(EXIT_FAILURE);
+    }
+
+    texture_format_t format = choose_texture_format(channel, srgb);
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, format.swizzle);
+
+    size_t image_size = (size_t) image_width * image_height * format.channel;
+    unsigned int pbo = 0;
+
+    glGenBuffers(1, &pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr) image_size, NULL, GL_STREAM_DRAW);
+
+    // stb_image stores the rows flipped as it decodes, no global state involved
+    stbi_load_options options = { 0 };
+    options.flip_vertically = vflip ? 1 : -1;
+    options.buffer = (unsigned char *) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr) image_size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    options.buffer_size = image_size;
+
+    unsigned char *image_data = NULL;
+    if (options.buffer)
+    {
+        image_data = load_image_file(image_path, &image_width, &image_height, &channel, format.channel, &options);
+        if (!glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+            image_data = NULL;
+    }
+
+    if (image_data)
+    {
+        upload_texture_image(image_width, image_height, &format, (const void *) 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    } else
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        options.buffer = NULL;
+        options.buffer_size = 0;
+        image_data = load_image_file(image_path, &image_width, &image_height, &channel, format.channel, &options);
+        if (image_data == NULL)
+        {
+            fprintf(stderr, "%s::error: failed to load texture \"%s\"\n", __FILENAME__, image_path);
+            exit(EXIT_FAILURE);
+        }
+
+        upload_texture_image(image_width, image_height, &format, image_data);
+        stbi_image_free(image_data);
+    }
+
+    // the driver keeps the buffer alive until the upload has consumed it
+    glDeleteBuffers(1, &pbo);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    return tex;
+}
+
+unsigned int load_texture(const char *image_path, int vflip)
+{
+    return load_texture_with_format(image_path, vflip, false);
+}
+
+// For color maps authored in sRGB; sampling returns linear values.
+unsigned int load_texture_srgb(const char *image_path, int vflip)
+{
+    return load_texture_with_format(image_path, vflip, true);
+}
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+    #define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+    #define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+static bool compressed_format_supported(GLenum internal_format)
+{
+    int count = 0;
+    glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &count);
+    if (count <= 0)
+        return false;
+
+    int *formats = (int *) malloc(count * sizeof(int));
+    glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, formats);
+
+    bool supported = false;
+    for (int i = 0; i < count && !supported; i++)
+        supported = formats[i] == (int) internal_format;
+
+    free(formats);
+
+    return supported;
+}
+
+// Uploads every level of a BC1/BC3 texture. Drivers without S3TC get the
+// blocks decoded back to RGBA8 so baked assets still load.
+unsigned int upload_compressed_texture(const compressed_texture_t *tex)
+{
+    unsigned int handle = 0;
+    GLenum internal_format = tex->format == TEXCOMP_BC3 ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    bool native = compressed_format_supported(internal_format);
+    unsigned char *rgba = native ? NULL : (unsigned char *) malloc((size_t) tex->width * tex->height * 4);
+
+    glGenTextures(1, &handle);
+    glBindTexture(GL_TEXTURE_2D, handle);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, tex->level_count - 1);
+
+    int w = tex->width, h = tex->height;
+    for (int level = 0; level < tex->level_count; level++)
+    {
+        const unsigned char *blocks = tex->data + tex->level_offset[level];
+
+        if (native)
+        {
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, internal_format, w, h, 0, (GLsizei) tex->level_size[level], blocks);
+        } else
+        {
+            texcomp_decode(rgba, blocks, w, h, tex->format);
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+        }
+
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+
+    free(rgba);
+
+    return handle;
+}
+
+// Lets stb_image spread JPEG IDCT and color conversion over a thread_pool_t.
+static void image_decode_parallel_for(void *pool, int count, stbi_parallel_task *task, void *task_data)
+{
+    thread_pool_for((thread_pool_t *) pool, count, task, task_data);
+
+    return;
+}
+
+// Accepts either a DDS baked by tools/texbake.c (already flipped at bake
+// time, so vflip is ignored) or any image stb_image can read, which is then
+// compressed on load with the given preset.
+unsigned int load_compressed_texture(const char *image_path, int vflip, texcomp_format_t format, texcomp_quality_t quality, thread_pool_t *pool)
+{
+    compressed_texture_t tex;
+    const char *ext = strrchr(image_path, '.');
+
+    if (ext && (strcmp(ext, ".dds") == 0 || strcmp(ext, ".DDS") == 0))
+    {
+        if (!texcomp_load_dds(&tex, image_path))
+        {
+            fprintf(stderr, "%s::error: failed to load compressed texture \"%s\"\n", __FILENAME__, image_path);
+            exit(EXIT_FAILURE);
+        }
+    } else
+    {
+        stbi_load_options options = { .parallel_for = pool ? image_decode_parallel_for : NULL, .pool = pool };
+        options.flip_vertically = vflip ? 1 : -1;
+
+        int image_width, image_height, channel;
+        unsigned char *image_data = load_image_file(image_path, &image_width, &image_height, &channel, 4, &options);
+
+        if (image_data == NULL || !texcomp_compress_texture(&tex, image_data, image_width, image_height, format, quality, true, pool))
+        {
+            fprintf(stderr, "%s::error: failed to compress texture \"%s\"\n", __FILENAME__, image_path);
+            exit(EXIT_FAILURE);
+        }
+
+        stbi_image_free(image_data);
+    }
+
+    unsigned int handle = upload_compressed_texture(&tex);
+    texcomp_free(&tex);
+
+    return handle;
+}
+
+static int texture_stream_read(void *user, char *data, int size)
+{
+    texture_stream_t *stream = (texture_stream_t *) user;
+
+    if (stream->file)
+        return (int) fread(data, 1, size, stream->file);
+
+    // stb_image probes the formats within its first fill and can only rewind
+    // that far, so the first read waits for all of it; later ones take any
+    mutex_lock(&stream->lock);
+    size_t wanted = stream->feed_started ? 1 : (size_t) size;
+    while (stream->feed_size - stream->feed_read < wanted && !stream->feed_closed)
+        cond_wait(&stream->fed, &stream->lock);
+    stream->feed_started = true;
+
+    size_t count = stream->feed_size - stream->feed_read;
+    if (count > (size_t) size)
+        count = size;
+    memcpy(data, stream->feed + stream->feed_read, count);
+    stream->feed_read += count;
+    mutex_unlock(&stream->lock);
+
+    return (int) count;
+}
+
+static void texture_stream_skip(void *user, int n)
+{
+    texture_stream_t *stream = (texture_stream_t *) user;
+    char scratch[256];
+
+    if (stream->file)
+    {
+        fseek(stream->file, n, SEEK_CUR);
+        return;
+    }
+
+    while (n > 0)
+    {
+        int count = texture_stream_read(user, scratch, n < (int) sizeof(scratch) ? n : (int) sizeof(scratch));
+        if (count == 0)
+            break;
+        n -= count;
+    }
+
+    return;
+}
+
+static int texture_stream_eof(void *user)
+{
+    texture_stream_t *stream = (texture_stream_t *) user;
+
+    if (stream->file)
+        return feof(stream->file);
+
+    mutex_lock(&stream->lock);
+    int eof = stream->feed_closed && stream->feed_read == stream->feed_size;
+    mutex_unlock(&stream->lock);
+
+    return eof;
+}
+
+// Runs on the worker: copies each band into place, flipped images sending
+// theirs from the bottom up. Published rows are never written again, so the
+// GL thread uploads them without holding the lock.
+static void texture_stream_rows(void *user, const stbi_uc *rows, int width, int height, int channels, int y, int count)
+{
+    texture_stream_t *stream = (texture_stream_t *) user;
+    size_t stride = (size_t) width * channels;
+
+    mutex_lock(&stream->lock);
+    if (stream->pixels == NULL)
+    {
+        // zeroed, so rows that have not arrived yet upload as transparent black
+        stream->pixels = (unsigned char *) calloc(height, stride);
+        stream->width = width;
+        stream->height = height;
+    }
+
+    if (stream->pixels)
+    {
+        memcpy(stream->pixels + stride * y, rows, stride * count);
+        stream->rows_ready += count;
+    }
+    mutex_unlock(&stream->lock);
+
+    return;
+}
+
+static void *texture_stream_worker(void *arg)
+{
+    texture_stream_t *stream = (texture_stream_t *) arg;
+    stbi_io_callbacks io = { texture_stream_read, texture_stream_skip, texture_stream_eof };
+
+    stbi_load_options options = { 0 };
+    options.rows = texture_stream_rows;
+    options.rows_user = stream;
+    options.flip_vertically = stream->vflip ? 1 : -1;
+
+    // always RGBA: the channel count has to be fixed before the header is read
+    PROFILE_THREAD_NAME("texture stream");
+    PROFILE_ZONE_BEGIN("texture decode");
+    int image_width, image_height, channel;
+    unsigned char *image_data = stbi_load_from_callbacks_ex(&io, stream, &image_width, &image_height, &channel, 4, &options);
+    PROFILE_ZONE_END();
+
+    mutex_lock(&stream->lock);
+    stream->failed = image_data == NULL || stream->pixels == NULL;
+    stream->decoded = true;
+    mutex_unlock(&stream->lock);
+
+    if (image_data == NULL)
+        fprintf(stderr, "%s::error: failed to stream texture: %s\n", __FILENAME__, stbi_failure_reason());
+    else if (stream->pixels == NULL)
+        fprintf(stderr, "%s::error: out of memory while streaming texture\n", __FILENAME__);
+    stbi_image_free(image_data);
+
+    return NULL;
+}
+
+static void texture_stream_start(texture_stream_t *stream, FILE *file, int vflip)
+{
+    memset(stream, 0, sizeof(*stream));
+    stream->file = file;
+    stream->vflip = vflip;
+
+    mutex_init(&stream->lock);
+    cond_init(&stream->fed);
+
+    glGenTextures(1, &stream->texture);
+    glBindTexture(GL_TEXTURE_2D, stream->texture);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    if (!thread_create(&stream->worker, texture_stream_worker, stream))
+    {
+        fprintf(stderr, "%s::error: cannot start texture stream thread\n", __FILENAME__);
+        exit(EXIT_FAILURE);
+    }
+
+    return;
+}
+
+void texture_stream_open(texture_stream_t *stream, const char *image_path, int vflip)
+{
+    FILE *file = fopen(image_path, "rb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "%s::error: failed to load texture \"%s\"\n", __FILENAME__, image_path);
+        exit(EXIT_FAILURE);
+    }
+
+    texture_stream_start(stream, file, vflip);
+
+    return;
+}
+
+void texture_stream_begin(texture_stream_t *stream, int vflip)
+{
+    texture_stream_start(stream, NULL, vflip);
+
+    return;
+}
+
+void texture_stream_feed(texture_stream_t *stream, const void *data, size_t size)
+{
+    mutex_lock(&stream->lock);
+
+    // drop what the decoder has consumed before growing the buffer
+    if (stream->feed_read > 0)
+    {
+        memmove(stream->feed, stream->feed + stream->feed_read, stream->feed_size - stream->feed_read);
+        stream->feed_size -= stream->feed_read;
+        stream->feed_read = 0;
+    }
+
+    if (stream->feed_size + size > stream->feed_capacity)
+    {
+        size_t capacity = stream->feed_capacity ? stream->feed_capacity : 65536;
+        while (capacity < stream->feed_size + size)
+            capacity *= 2;
+
+        unsigned char *feed = (unsigned char *) realloc(stream->feed, capacity);
+        if (feed == NULL)
+        {
+            fprintf(stderr, "%s::error: out of memory while streaming texture\n", __FILENAME__);
+            exit(EXIT_FAILURE);
+        }
+        stream->feed = feed;
+        stream->feed_capacity = capacity;
+    }
+
+    memcpy(stream->feed + stream->feed_size, data, size);
+    stream->feed_size += size;
+
+    cond_signal(&stream->fed);
+    mutex_unlock(&stream->lock);
+
+    return;
+}
+
+void texture_stream_end_feed(texture_stream_t *stream)
+{
+    mutex_lock(&stream->lock);
+    stream->feed_closed = true;
+    cond_signal(&stream->fed);
+    mutex_unlock(&stream->lock);
+
+    return;
+}
+
+// Call once per frame on the GL thread. Uploads the rows decoded since the
+// last call and returns true once the whole texture (with mipmaps) is in.
+bool texture_stream_update(texture_stream_t *stream)
+{
+    if (stream->joined)
+        return true;
+
+    mutex_lock(&stream->lock);
+    int rows_ready = stream->rows_ready;
+    bool decoded = stream->decoded;
+    bool failed = stream->failed;
+
+    glBindTexture(GL_TEXTURE_2D, stream->texture);
+    if (!stream->allocated && stream->pixels)
+    {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, stream->width, stream->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, stream->pixels);
+        stream->allocated = true;
+        stream->rows_uploaded = rows_ready;
+    }
+    mutex_unlock(&stream->lock);
+
+    if (failed)
+        exit(EXIT_FAILURE);
+
+    if (rows_ready > stream->rows_uploaded)
+    {
+        size_t stride = (size_t) stream->width * 4;
+        int count = rows_ready - stream->rows_uploaded;
+        int first = stream->vflip ? stream->height - rows_ready : stream->rows_uploaded;
+
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first, stream->width, count, GL_RGBA, GL_UNSIGNED_BYTE, stream->pixels + stride * first);
+        stream->rows_uploaded = rows_ready;
+    }
+
+    if (!decoded)
+        return false;
+
+    glGenerateMipmap(GL_TEXTURE_2D);
+    thread_join(&stream->worker);
+    stream->joined = true;
+
+    free(stream->pixels);
+    stream->pixels = NULL;
+
+    return true;
+}
+
+// Waits for the decoder and releases everything but the texture, which
+// belongs to the caller like the result of load_texture().
+void texture_stream_close(texture_stream_t *stream)
+{
+    if (!stream->joined)
+    {
+        texture_stream_end_feed(stream);
+        thread_join(&stream->worker);
+        stream->joined = true;
+    }
+
+    if (stream->file)
+        fclose(stream->file);
+
+    free(stream->pixels);
+    free(stream->feed);
+    mutex_destroy(&stream->lock);
+    cond_destroy(&stream->fed);
+
+    memset(stream, 0, sizeof(*stream));
+
+    return;
+}
+
+void texture_manifest_init(texture_manifest_t *manifest, int max_size, size_t budget)
+{
+    memset(manifest, 0, sizeof(*manifest));
+    manifest->max_size = max_size;
+    manifest->budget = budget;
+
+    return;
+}
+
+void texture_manifest_add(texture_manifest_t *manifest, const char *image_path, int vflip, bool srgb)
+{
+    if (manifest->count == manifest->capacity)
+    {
+        int capacity = manifest->capacity ? manifest->capacity * 2 : 16;
+        texture_entry_t *entries = (texture_entry_t *) realloc(manifest->entries, capacity * sizeof(texture_entry_t));
+        if (entries == NULL)
+        {
+            fprintf(stderr, "%s::error: out of memory while adding \"%s\"\n", __FILENAME__, image_path);
+            exit(EXIT_FAILURE);
+        }
+        manifest->entries = entries;
+        manifest->capacity = capacity;
+    }
+
+    texture_entry_t *entry = &manifest->entries[manifest->count++];
+    memset(entry, 0, sizeof(*entry));
+
+    size_t length = strlen(image_path);
+    entry->path = (char *) malloc(length + 1);
+    if (entry->path == NULL)
+    {
+        fprintf(stderr, "%s::error: out of memory while adding \"%s\"\n", __FILENAME__, image_path);
+        exit(EXIT_FAILURE);
+    }
+    memcpy(entry->path, image_path, length + 1);
+    entry->vflip = vflip;
+    entry->srgb = srgb;
+
+    return;
+}
+
+// One texture per line: its path, optionally followed by "flip" and/or "srgb".
+// Blank lines and lines starting with '#' are skipped.
+void texture_manifest_read(texture_manifest_t *manifest, const char *manifest_path)
+{
+    FILE *fp = fopen(manifest_path, "r");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "%s::error: cannot find \"%s\"\n", __FILENAME__, manifest_path);
+        exit(EXIT_FAILURE);
+    }
+
+    char line[1024];
+    while (fgets(line, sizeof(line), fp))
+    {
+        char path[1024], option[16];
+        int offset = 0, consumed = 0;
+
+        if (sscanf(line, "%1023s%n", path, &offset) < 1 || path[0] == '#')
+            continue;
+
+        int vflip = 0;
+        bool srgb = false;
+        while (sscanf(line + offset, "%15s%n", option, &consumed) == 1)
+        {
+            offset += consumed;
+
+            if (strcmp(option, "flip") == 0)
+                vflip = 1;
+            else if (strcmp(option, "srgb") == 0)
+                srgb = true;
+            else
+            {
+                fprintf(stderr, "%s::error: unknown option \"%s\" for \"%s\" in \"%s\"\n", __FILENAME__, option, path, manifest_path);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        texture_manifest_add(manifest, path, vflip, srgb);
+    }
+
+    fclose(fp);
+
+    return;
+}
+
+static void texture_manifest_probe_task(void *data, int index)
+{
+    texture_entry_t *entry = &((texture_manifest_t *) data)->entries[index];
+    int channel = 0;
+
+    entry->probed = image_file_info(entry->path, &entry->width, &entry->height, &channel) != 0;
+    entry->format = choose_texture_format(channel, entry->srgb);
+    entry->levels = 1;
+    entry->size = 0;
+
+    if (!entry->probed)
+        return;
+
+    int w = entry->width, h = entry->height;
+    for (;;)
+    {
+        entry->size += (size_t) w * h * entry->format.channel;
+        if (w == 1 && h == 1)
+            break;
+
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+        entry->levels++;
+    }
+
+    return;
+}
+
+// Reads every header on the pool (NULL probes on the calling thread) and
+// rejects unreadable or oversized images, or a manifest over budget, before
+// anything is decoded. Needs a current GL context when max_size is 0.
+void texture_manifest_probe(texture_manifest_t *manifest, thread_pool_t *pool)
+{
+    thread_pool_for(pool, manifest->count, texture_manifest_probe_task, manifest);
+
+    int max_size = manifest->max_size;
+    if (max_size <= 0)
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+
+    bool rejected = false;
+    manifest->total_size = 0;
+
+    for (int i = 0; i < manifest->count; i++)
+    {
+        texture_entry_t *entry = &manifest->entries[i];
+
+        if (!entry->probed)
+        {
+            fprintf(stderr, "%s::error: failed to probe texture \"%s\"\n", __FILENAME__, entry->path);
+            rejected = true;
+        } else if (entry->width > max_size || entry->height > max_size)
+        {
+            fprintf(stderr, "%s::error: texture \"%s\" is %dx%d, larger than %d\n", __FILENAME__, entry->path, entry->width, entry->height, max_size);
+            rejected = true;
+        } else
+            manifest->total_size += entry->size;
+    }
+
+    if (!rejected && manifest->budget && manifest->total_size > manifest->budget)
+    {
+        fprintf(stderr, "%s::error: textures need %zu bytes, over the budget of %zu\n", __FILENAME__, manifest->total_size, manifest->budget);
+        rejected = true;
+    }
+
+    if (rejected)
+        exit(EXIT_FAILURE);
+
+    return;
+}
+
+#ifdef GL_ARB_texture_storage
+// Core only from GL 4.2, but 3.3 drivers nearly all have the extension.
+// Checked on first use only, on the thread that owns the context.
+static bool texture_storage_supported(void)
+{
+    static int supported = -1;
+    if (supported < 0)
+        supported = has_gl_extension("GL_ARB_texture_storage");
+
+    return supported > 0;
+}
+#endif
+
+// Creates every level of every probed texture as immutable storage, or
+// where the driver has none, defines the full mip chain once; either way it
+// is only ever written with glTexSubImage2D afterwards.
+void texture_manifest_allocate(texture_manifest_t *manifest)
+{
+    for (int i = 0; i < manifest->count; i++)
+    {
+        texture_entry_t *entry = &manifest->entries[i];
+
+        glGenTextures(1, &entry->texture);
+        glBindTexture(GL_TEXTURE_2D, entry->texture);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, entry->levels - 1);
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, entry->format.swizzle);
+
+#ifdef GL_ARB_texture_storage
+        if (texture_storage_supported())
+        {
+            glTexStorage2D(GL_TEXTURE_2D, entry->levels, entry->format.internal_format, entry->width, entry->height);
+            continue;
+        }
+#endif
+
+        int w = entry->width, h = entry->height;
+        for (int level = 0; level < entry->levels; level++)
+        {
+            glTexImage2D(GL_TEXTURE_2D, level, entry->format.internal_format, w, h, 0, entry->format.format, GL_UNSIGNED_BYTE, NULL);
+
+            w = w > 1 ? w / 2 : 1;
+            h = h > 1 ? h / 2 : 1;
+        }
+    }
+
+    return;
+}
+
+// Decodes the textures one after another into a single pixel unpack buffer
+// sized for the largest of them, then fills level 0 and the mip chain of the
+// storage made by texture_manifest_allocate(). The pool, if any, runs the
+// parallel part of JPEG decoding.
+void texture_manifest_load(texture_manifest_t *manifest, thread_pool_t *pool)
+{
+    size_t largest = 0;
+    for (int i = 0; i < manifest->count; i++)
+    {
+        const texture_entry_t *entry = &manifest->entries[i];
+        size_t image_size = (size_t) entry->width * entry->height * entry->format.channel;
+        if (image_size > largest)
+            largest = image_size;
+    }
+
+    unsigned int pbo = 0;
+    glGenBuffers(1, &pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr) largest, NULL, GL_STREAM_DRAW);
+
+    for (int i = 0; i < manifest->count; i++)
+    {
+        texture_entry_t *entry = &manifest->entries[i];
+        size_t image_size = (size_t) entry->width * entry->height * entry->format.channel;
+
+        stbi_load_options options = { .parallel_for = pool ? image_decode_parallel_for : NULL, .pool = pool };
+        options.buffer = (unsigned char *) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr) image_size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        options.buffer_size = image_size;
+        options.flip_vertically = entry->vflip ? 1 : -1;
+
+        int image_width = 0, image_height = 0, channel;
+        unsigned char *image_data = NULL;
+        if (options.buffer)
+        {
+            image_data = load_image_file(entry->path, &image_width, &image_height, &channel, entry->format.channel, &options);
+            if (!glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+                image_data = NULL;
+        }
+
+        const void *pixels = (const void *) 0;
+        unsigned char *fallback = NULL;
+        if (image_data == NULL)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            options.buffer = NULL;
+            options.buffer_size = 0;
+            fallback = load_image_file(entry->path, &image_width, &image_height, &channel, entry->format.channel, &options);
+            pixels = fallback;
+        }
+
+        // the file changed since it was probed, its storage no longer fits
+        if ((image_data == NULL && fallback == NULL) || image_width != entry->width || image_height != entry->height)
+        {
+            fprintf(stderr, "%s::error: failed to load texture \"%s\"\n", __FILENAME__, entry->path);
+            exit(EXIT_FAILURE);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, entry->texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, unpack_alignment(entry->width, entry->format.channel));
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, entry->width, entry->height, entry->format.format, GL_UNSIGNED_BYTE, pixels);
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        if (fallback)
+        {
+            stbi_image_free(fallback);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        }
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &pbo);
+
+    return;
+}
+
+// Releases the list; the textures belong to the caller.
+void texture_manifest_free(texture_manifest_t *manifest)
+{
+    for (int i = 0; i < manifest->count; i++)
+        free(manifest->entries[i].path);
+
+    free(manifest->entries);
+    memset(manifest, 0, sizeof(*manifest));
+
+    return;
 }
 
 #endif
\ No newline at end of file
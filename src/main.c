@@ -1,8 +1,55 @@
+// thread.h and pacing.h use clock_gettime() and nanosleep(), which are POSIX
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+    #define _POSIX_C_SOURCE 199309L
+#endif
+
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <limits.h>
 #include "glad/glad.h"
 #include "GLFW/glfw3.h"
 
+#define GLSTATS_IMPLEMENTATION
+#include "../include/glstats.h"
+
+#define THREAD_IMPLEMENTATION
+#include "../include/thread.h"
+
+// Bench builds define ALLOC_COUNT_ENABLED, and -bench then fails a run whose
+// steady frames touch the heap.
+#define ALLOC_IMPLEMENTATION
+#include "../include/alloc.h"
+
+#define JOB_IMPLEMENTATION
+#include "../include/job.h"
+
+#define TEXCOMP_IMPLEMENTATION
+#include "../include/texcomp.h"
+
+#define FILEMAP_IMPLEMENTATION
+#include "../include/filemap.h"
+
+#define PACK_IMPLEMENTATION
+#include "../include/pack.h"
+
+#define HEADLESS_IMPLEMENTATION
+#include "../include/headless.h"
+
+#define BENCH_IMPLEMENTATION
+#include "../include/bench.h"
+
+#define PROFILE_IMPLEMENTATION
+#include "../include/profile.h"
+
+#define RENDER_IMPLEMENTATION
+#include "../include/render.h"
+
+#define PACING_IMPLEMENTATION
+#include "../include/pacing.h"
+
 #define UTIL_IMPLEMENTATION
 #include "../include/util.h"
 
@@ -12,26 +59,337 @@
 #define WINDOW_WIDTH 800
 #define WINDOW_HEIGHT 600
 #define WINDOW_TITLE "Learning OpenGL"
+#define HEADLESS_FRAME_RATE 60.0
+
+#define SIM_RATE 60.0      // default simulation steps per second
+#define SIM_MAX_STEPS 5     // per frame, so a slow frame cannot snowball
+#define SIM_SPIN_RATE 50.0  // degrees per second
+#define FRAME_ARENA_SIZE (1024 * 1024)
+#define ALLOC_WARMUP_FRAMES 4  // frames before the heap must go quiet
+#define FRAME_COMMANDS 16      // state commands a frame records besides the cubes
+#define CUBE_COMMANDS 3        // model matrix, texture, draw
+
+// Lays the cubes out on a square grid in clip space; a single cube keeps the
+// original full size, centred transform.
+static mat4_t cube_model(double angle, int index, int grid)
+{
+    mat4_t model = mat4(IDENTITY);
+    mat4_rotate(&model, angle, (vec3_t) { 0.3f, 1.0f, 0.0f });
+
+    float scale = 1.0f / grid;
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            model.m[i * 4 + j] *= scale;
+
+    // GL reads the matrix column major, so the offset goes in elements 12 and 13
+    model.m[12] = ((index % grid) + 0.5f) * 2.0f / grid - 1.0f;
+    model.m[13] = ((index / grid) + 0.5f) * 2.0f / grid - 1.0f;
+
+    return model;
+}
+
+// The simulation advances in fixed steps and keeps the step before, so a
+// frame can blend the two. It is primed one step ahead at the start, which
+// puts the current step always at or past the time being drawn.
+typedef struct
+{
+    double *previous;   // angle per cube, in degrees
+    double *current;
+    double  step;       // seconds
+} sim_t;
+
+static void sim_step_cubes(void *data, int begin, int end)
+{
+    sim_t *sim = (sim_t *) data;
+
+    for (int i = begin; i < end; i++)
+        sim->current[i] = sim->previous[i] + SIM_SPIN_RATE * sim->step;
+
+    return;
+}
+
+static void sim_advance(sim_t *sim, job_system_t *jobs, int count)
+{
+    double *previous = sim->previous;
+    sim->previous = sim->current;
+    sim->current = previous;
+    job_parallel_for(jobs, count, 256, sim_step_cubes, sim);
+
+    return;
+}
+
+typedef struct
+{
+    mat4_t      *models;
+    const sim_t *sim;
+    double       alpha;   // how far the frame is from the previous step to the current
+    int          grid;
+} cube_batch_t;
+
+static void cube_batch_models(void *data, int begin, int end)
+{
+    cube_batch_t *batch = (cube_batch_t *) data;
+    const sim_t *sim = batch->sim;
+
+    for (int i = begin; i < end; i++)
+        batch->models[i] = cube_model(sim->previous[i] + (sim->current[i] - sim->previous[i]) * batch->alpha, i, batch->grid);
+
+    return;
+}
+
+static bool window_make_current(void *user, bool current)
+{
+    glfwMakeContextCurrent(current ? (GLFWwindow *) user : NULL);
+
+    return true;
+}
+
+static void window_present(void *user)
+{
+    glfwSwapBuffers((GLFWwindow *) user);
+
+    return;
+}
+
+static bool headless_context(void *user, bool current)
+{
+    return headless_make_current((headless_t *) user, current);
+}
+
+// What the cubes draw with. The records come out of a pool sized for the
+// scene, which has to hold all of them again by the end of the run.
+typedef struct
+{
+    unsigned int texture;
+    const char  *source;   // the image it was loaded from, NULL when generated
+} texture_record_t;
+
+// The profile scopes and everything else that has to run on the render
+// thread, where the context is, go into the command list as calls.
+
+// The render thread caches uniform locations, so they are looked up on the
+// first frames and again after a shader reload; from the frame after that
+// on, any lookup is a regression. Render thread only, like glstats.
+static long uniform_budget_frame = ALLOC_WARMUP_FRAMES;
+
+static void frame_begin(render_t *render, void *data)
+{
+    (void) render;
+    (void) data;
+
+    glstats_budget(GLSTATS_UNIFORM_LOOKUPS, glstats_current.index >= uniform_budget_frame ? 0 : GLSTATS_UNLIMITED);
+    profile_frame_begin();
+    profile_begin("frame");
+
+    return;
+}
+
+static void frame_end(render_t *render, void *data)
+{
+    (void) render;
+    (void) data;
+
+    profile_end();
+    profile_frame_end();
+    glstats_frame_end();
+
+    return;
+}
+
+static void scope_begin(render_t *render, void *name)
+{
+    (void) render;
+
+    profile_begin((const char *) name);
+
+    return;
+}
+
+static void scope_end(render_t *render, void *data)
+{
+    (void) render;
+    (void) data;
+
+    profile_end();
+
+    return;
+}
+
+static void update_shaders(render_t *render, void *data)
+{
+    shader_watch_t *watch = (shader_watch_t *) data;
+
+    profile_begin("shaders");
+    if (shader_watch_update(watch))
+    {
+        uniform_budget_frame = glstats_current.index + 1;
+        glstats_budget(GLSTATS_UNIFORM_LOOKUPS, GLSTATS_UNLIMITED);
+    }
+    render_use_program(render, shader_watch_program(watch));
+    profile_end();
+
+    return;
+}
 
-int main()
+// The profile summary is only safe to read on the render thread; the title
+// itself can only be set on the main thread.
+typedef struct
 {
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    mutex_t lock;
+    char    text[512];
+    bool    fresh;
+} title_t;
+
+static void title_update(render_t *render, void *data)
+{
+    title_t *title = (title_t *) data;
+    (void) render;
+
+    mutex_lock(&title->lock);
+    int length = snprintf(title->text, sizeof(title->text), "%s | ", WINDOW_TITLE);
+    profile_summary(title->text + length, sizeof(title->text) - length);
+    title->fresh = true;
+    mutex_unlock(&title->lock);
 
-    GLFWwindow *window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE, NULL, NULL);
+    return;
+}
 
-    if (window == NULL) 
+// When a frame's swap returned, for the main thread to pick up once the
+// render thread is done with the list the frame went out in.
+typedef struct
+{
+    double input;
+    double presented;
+    bool   pending;
+} present_t;
+
+static void present_done(render_t *render, void *data)
+{
+    (void) render;
+
+    ((present_t *) data)->presented = pacing_now();
+
+    return;
+}
+
+//   main [-headless] [-bench] [-frames N] [-width W] [-height H] [-cubes N] [-textures N]
+//        [-golden file.tga [-update-golden] [-tolerance N]] [-json file] [-trace file]
+//        [-fps N] [-swap-interval N] [-sim-rate N]
+//
+// -headless renders N frames (default 600) offscreen with no window and exits.
+// -bench does the same and reports frame time percentiles as JSON, checking
+// the last frame against the golden image when one is given; -update-golden
+// records it instead. Texture 0 is container.jpg, the rest are generated.
+// -trace writes the CPU and GPU timing scopes out as a Chrome trace; the
+// rolling averages show in the window title, or on stderr when headless.
+// The main thread simulates and records each frame into a command list that
+// the render thread, which owns the context, draws while the next is made.
+// -fps caps the frame rate (default none), -swap-interval sets vsync, with -1
+// for adaptive (default 1); frame time jitter and input to present latency
+// show next to the profile. The cubes are simulated at a fixed -sim-rate
+// (default 60 steps a second) apart from the frame rate and drawn between
+// the last two steps; headless runs step a fixed clock, so every run draws
+// the same images.
+int main(int argc, char **argv)
+{
+    bool headless_mode = false;
+    bool bench_mode = false;
+    bool update_golden = false;
+    const char *json_path = NULL;
+    const char *trace_path = NULL;
+    double fps = 0.0;
+    int swap_interval = 1;
+    double sim_rate = SIM_RATE;
+    bench_scene_t scene = { WINDOW_WIDTH, WINDOW_HEIGHT, 1, 1, 600 };
+    bench_golden_t golden = { 0 };
+    golden.tolerance = 2;
+    golden.max_differing_fraction = 0.001;
+
+    for (int i = 1; i < argc; i++)
     {
-        printf("error: cannot create GLFW window\n");
+        if (strcmp(argv[i], "-headless") == 0)
+            headless_mode = true;
+        else if (strcmp(argv[i], "-bench") == 0)
+            headless_mode = bench_mode = true;
+        else if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+            scene.frames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-width") == 0 && i + 1 < argc)
+            scene.width = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-height") == 0 && i + 1 < argc)
+            scene.height = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-cubes") == 0 && i + 1 < argc)
+            scene.cubes = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-textures") == 0 && i + 1 < argc)
+            scene.textures = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-golden") == 0 && i + 1 < argc)
+            golden.path = argv[++i];
+        else if (strcmp(argv[i], "-update-golden") == 0)
+            update_golden = true;
+        else if (strcmp(argv[i], "-tolerance") == 0 && i + 1 < argc)
+            golden.tolerance = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-json") == 0 && i + 1 < argc)
+            json_path = argv[++i];
+        else if (strcmp(argv[i], "-trace") == 0 && i + 1 < argc)
+            trace_path = argv[++i];
+        else if (strcmp(argv[i], "-fps") == 0 && i + 1 < argc)
+            fps = atof(argv[++i]);
+        else if (strcmp(argv[i], "-swap-interval") == 0 && i + 1 < argc)
+            swap_interval = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-sim-rate") == 0 && i + 1 < argc)
+            sim_rate = atof(argv[++i]);
+        else
+        {
+            fprintf(stderr, "usage: %s [-headless] [-bench] [-frames N] [-width W] [-height H] [-cubes N] [-textures N]\n"
+                            "       [-golden file.tga [-update-golden] [-tolerance N]] [-json file] [-trace file]\n"
+                            "       [-fps N] [-swap-interval N] [-sim-rate N]\n", argv[0]);
+            return(EXIT_FAILURE);
+        }
+    }
+
+    if (scene.width < 1 || scene.height < 1 || scene.cubes < 1 || scene.textures < 1 || scene.frames < 1 || sim_rate <= 0.0)
+    {
+        fprintf(stderr, "error: sizes and counts must be positive\n");
+        return(EXIT_FAILURE);
+    }
+
+    if (scene.cubes > (INT_MAX - FRAME_COMMANDS) / CUBE_COMMANDS)
+    {
+        fprintf(stderr, "error: at most %d cubes fit in a command list\n", (INT_MAX - FRAME_COMMANDS) / CUBE_COMMANDS);
         return(EXIT_FAILURE);
     }
+
+    GLFWwindow *window = NULL;
+    headless_t headless;
+
+    if (headless_mode)
+    {
+        if (!headless_init(&headless, scene.width, scene.height))
+            return(EXIT_FAILURE);
+    } else
+    {
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        window = glfwCreateWindow(scene.width, scene.height, WINDOW_TITLE, NULL, NULL);
+
+        if (window == NULL) 
+        {
+            printf("error: cannot create GLFW window\n");
+            return(EXIT_FAILURE);
+        }
    
-    glfwMakeContextCurrent(window);
+        glfwMakeContextCurrent(window);
     
-    glad_init();
-    glfwSetFramebufferSizeCallback(window, frame_buffer_size_callback);
+        glad_init();
+        swap_interval = pacing_swap_interval(swap_interval);
+    }
+
+    // tools/assetpack builds this; without it everything loads from loose files
+    pack_t pack;
+    if (pack_open(&pack, "assets.pak"))
+        pack_mount(&pack);
     
 #if 0
     float vertices[] =
@@ -121,7 +479,9 @@ int main()
     };
 #endif
 
-    unsigned int shader_program = create_shader_program("src/main_vert.glsl", "src/main_frag.glsl");
+    shader_cache_enable("shader_cache");
+    shader_watch_t shader_watch;
+    shader_watch_init(&shader_watch, "src/main_vert.glsl", "src/main_frag.glsl");
     
     unsigned int VBO = create_vbo(sizeof(vertices), vertices);
     unsigned int VAO = create_vao();
@@ -143,55 +503,341 @@ int main()
     glBindVertexArray(0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-    unsigned int texture = load_texture("container.jpg", 1);
+    pool_t texture_pool;
+    if (!pool_init(&texture_pool, sizeof(texture_record_t), scene.textures))
+        return(EXIT_FAILURE);
 
-    glfwSetKeyCallback(window, key_callback);
+    texture_record_t **textures = (texture_record_t **) malloc(scene.textures * sizeof(texture_record_t *));
+    if (textures == NULL)
+    {
+        fprintf(stderr, "error: out of memory for %d textures\n", scene.textures);
+        return(EXIT_FAILURE);
+    }
 
-    glEnable(GL_DEPTH_TEST);
-    while (!glfwWindowShouldClose(window)) 
+    for (int i = 0; i < scene.textures; i++)
     {
-        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        textures[i] = (texture_record_t *) pool_alloc(&texture_pool);
+        textures[i]->source = i == 0 ? "container.jpg" : NULL;
+        textures[i]->texture = textures[i]->source ? load_texture(textures[i]->source, 1) : bench_checker_texture(i);
+    }
+
+    job_system_t jobs;
+    job_system_init(&jobs, -1);
 
-        glBindTexture(GL_TEXTURE_2D, texture);
+    sim_t sim = { (double *) malloc(scene.cubes * sizeof(double)), (double *) malloc(scene.cubes * sizeof(double)), 1.0 / sim_rate };
+    if (sim.previous == NULL || sim.current == NULL)
+    {
+        fprintf(stderr, "error: out of memory for %d cubes\n", scene.cubes);
+        return(EXIT_FAILURE);
+    }
 
-        use_shader_program(shader_program);
+    for (int i = 0; i < scene.cubes; i++)
+        sim.current[i] = i * 15.0;
+    sim_advance(&sim, &jobs, scene.cubes);
+    double accumulator = 0.0;
 
+    // per frame data comes from here; it is reset at the top of every frame
+    arena_t frame_arena;
+    if (!arena_init(&frame_arena, FRAME_ARENA_SIZE))
+        return(EXIT_FAILURE);
+    arena_bind(&frame_arena);
+
+    cube_batch_t cubes = { NULL, &sim, 0.0, 1 };
+    while (cubes.grid * cubes.grid < scene.cubes)
+        cubes.grid++;
+
+    bench_t bench;
+    bench_init(&bench, scene.frames);
+
+    if (window)
+        glfwSetKeyCallback(window, key_callback);
+
+    glEnable(GL_DEPTH_TEST);
+    profile_init(trace_path);
+    PROFILE_THREAD_NAME("main");
+
+    render_t render;
+    if (!render_init(&render, FRAME_COMMANDS + scene.cubes * CUBE_COMMANDS, window ? window_make_current : headless_context, window ? window_present : NULL, window ? (void *) window : (void *) &headless))
+        return(EXIT_FAILURE);
+
+    title_t title = { 0 };
+    mutex_init(&title.lock);
+    int viewport_width = scene.width, viewport_height = scene.height;
+    bool wireframe = false;
+
+    pacing_t pacing;
+    pacing_init(&pacing, fps);
+    present_t presents[2] = { 0 };
+
+    double start = pacing_now();
+    double title_time = start;
+    double last_time = start;
+#ifdef ALLOC_COUNT_ENABLED
+    long long heap_start = 0;
+#endif
+    alloc_count_thread(true);
+
+    // headless frames advance a fixed clock, so every run draws the same images
+    for (int frame = 0; headless_mode ? frame < scene.frames : !glfwWindowShouldClose(window); frame++)
+    {
+        pacing_wait(&pacing);
+        arena_reset(&frame_arena);
+#ifdef ALLOC_COUNT_ENABLED
+        if (frame == ALLOC_WARMUP_FRAMES)
+            heap_start = alloc_heap_count();
+#endif
+
+        // input is read as late as possible, just before the frame uses it
+        if (window)
+            glfwPollEvents();
+        double input_time = pacing_now();
+
+        double frame_start = pacing_now();
+        double elapsed;
+        if (headless_mode)
+            elapsed = frame > 0 ? 1.0 / HEADLESS_FRAME_RATE : 0.0;
+        else
+        {
+            elapsed = frame_start - last_time;
+            last_time = frame_start;
+        }
+
+        if (window)
+        {
+            mutex_lock(&title.lock);
+            if (title.fresh)
+            {
+                char text[sizeof(title.text) + 128];
+                int length = snprintf(text, sizeof(text), "%s | ", title.text);
+                pacing_summary(&pacing, text + length, sizeof(text) - length);
+                glfwSetWindowTitle(window, text);
+            }
+            title.fresh = false;
+            mutex_unlock(&title.lock);
+        }
+
+        PROFILE_ZONE_BEGIN("simulate");
+        accumulator += elapsed;
+        for (int steps = 0; accumulator >= sim.step; steps++)
+        {
+            // too far behind to catch up; let the simulation run slow instead
+            if (steps == SIM_MAX_STEPS)
+            {
+                accumulator = fmod(accumulator, sim.step);
+                break;
+            }
+
+            sim_advance(&sim, &jobs, scene.cubes);
+            accumulator -= sim.step;
+        }
+        PROFILE_ZONE_END();
+
+        PROFILE_ZONE_BEGIN("transforms");
+        cubes.alpha = accumulator / sim.step;
+        cubes.models = ARENA_ARRAY(arena_frame(), mat4_t, scene.cubes);
+        job_parallel_for(&jobs, scene.cubes, 64, cube_batch_models, &cubes);
+        PROFILE_ZONE_END();
+
+        // waits only if the render thread is still on the frame before last
+        render_list_t *list = render_begin(&render);
+
+        // the frame that last went out in this list has been presented
+        present_t *present = &presents[render.recording];
+        if (present->pending)
+            pacing_presented(&pacing, present->input, present->presented);
+        present->input = input_time;
+        present->pending = true;
+
+        PROFILE_ZONE_BEGIN("record");
+        render_call(list, frame_begin, NULL);
+
+        if (window)
+        {
+            int width, height;
+            glfwGetFramebufferSize(window, &width, &height);
+            if (width != viewport_width || height != viewport_height)
+            {
+                render_viewport(list, 0, 0, width, height);
+                viewport_width = width;
+                viewport_height = height;
+            }
+        }
+
+        // the key callback only flips the flag, it has no context to draw with
+        if (wireframe != wireframe_mode)
+        {
+            wireframe = wireframe_mode;
+            render_polygon_mode(list, wireframe ? GL_LINE : GL_FILL);
+        }
+
+        render_call(list, scope_begin, "clear");
+        render_clear(list, 0.2f, 0.3f, 0.3f, 1.0f, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        render_call(list, scope_end, NULL);
+
+        render_call(list, update_shaders, &shader_watch);
+
+        render_call(list, scope_begin, "draw");
         //mat4_perspective(&projection, 90, (float) WINDOW_WIDTH / (float) WINDOW_HEIGHT, 0.1f, 100.0f);
         mat4_t projection = mat4(IDENTITY);
         mat4_t view = mat4(IDENTITY);
-        mat4_t model = mat4(IDENTITY);
 
-        mat4_rotate(&model, glfwGetTime() * 50, (vec3_t) { 0.3f, 1.0f, 0.0f });
-        mat4_scale(&model, (vec3_t) { 1.0f, 1.0f, 1.0f });
         mat4_translate(&view, (vec3_t) { 0.0f, 0.0f, 0.3f }); 
 
-        unsigned int texture_loc = glGetUniformLocation(shader_program, "_our_texture");
-        use_shader_program(shader_program);
-        glUniform1i(texture_loc, 0);
+        render_uniform_int(list, "_our_texture", 0);
+        render_uniform_mat4(list, "_projection", projection.m);
+        render_uniform_mat4(list, "_view", view.m);
+
+        render_bind_vertex_array(list, VAO);
+        for (int i = 0; i < scene.cubes; i++)
+        {
+            render_uniform_mat4(list, "_model", cubes.models[i].m);
+            render_bind_texture(list, GL_TEXTURE_2D, textures[i % scene.textures]->texture);
+            //glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+            render_draw_arrays(list, GL_TRIANGLES, 0, 36);
+        }
+        render_call(list, scope_end, NULL);
+
+        if (window)
+        {
+            render_call(list, scope_begin, "swap");
+            render_present(list);
+            render_call(list, scope_end, NULL);
+        }
+        render_call(list, present_done, present);
+
+        if (window && frame_start - title_time >= 0.5)
+        {
+            render_call(list, title_update, &title);
+            title_time = frame_start;
+        }
+
+        render_call(list, frame_end, NULL);
+        PROFILE_ZONE_END();
+        render_submit(&render);
+
+        bench_frame(&bench, (pacing_now() - frame_start) * 1000.0);
+    }
+
+    // draws the last frame and takes the context back for the readback
+    long long dropped_commands = render.dropped;
+    render_destroy(&render);
+    mutex_destroy(&title.lock);
+
+    for (int i = 0; i < 2; i++)
+        if (presents[i].pending)
+            pacing_presented(&pacing, presents[i].input, presents[i].presented);
+
+    alloc_count_thread(false);
+#ifdef ALLOC_COUNT_ENABLED
+    if (scene.frames > ALLOC_WARMUP_FRAMES)
+        bench.heap_allocs = alloc_heap_count() - heap_start;
+#endif
 
-        unsigned int model_loc = glGetUniformLocation(shader_program, "_model");
-        glUniformMatrix4fv(model_loc, 1, GL_FALSE, model.m);
+    int status = EXIT_SUCCESS;
 
-        unsigned int projection_loc = glGetUniformLocation(shader_program, "_projection");
-        glUniformMatrix4fv(projection_loc, 1, GL_FALSE, projection.m);
+    if (bench_mode)
+    {
+        // steady frames live off the arenas, pools and preallocated lists
+        if (bench.heap_allocs > 0)
+        {
+            fprintf(stderr, "error: %lld heap allocations after the first %d frames\n", bench.heap_allocs, ALLOC_WARMUP_FRAMES);
+            status = EXIT_FAILURE;
+        }
+
+        // a partial scene must not be timed or compared as if it were whole
+        if (dropped_commands > 0)
+        {
+            fprintf(stderr, "error: %lld render commands were dropped\n", dropped_commands);
+            status = EXIT_FAILURE;
+        }
+
+        glFinish();
+
+        if (golden.path && dropped_commands == 0)
+        {
+            unsigned char *pixels = (unsigned char *) malloc((size_t) scene.width * scene.height * 4);
+            headless_read_pixels(&headless, pixels);
+
+            if (update_golden)
+            {
+                golden.written = bench_write_golden(golden.path, pixels, scene.width, scene.height);
+                if (!golden.written)
+                {
+                    fprintf(stderr, "error: cannot write golden image \"%s\"\n", golden.path);
+                    status = EXIT_FAILURE;
+                }
+            } else if (!bench_compare_golden(&golden, pixels, scene.width, scene.height))
+                status = EXIT_FAILURE;
+
+            free(pixels);
+        }
+
+        FILE *json = json_path ? fopen(json_path, "w") : stdout;
+        if (json == NULL)
+        {
+            fprintf(stderr, "error: cannot open \"%s\"\n", json_path);
+            status = EXIT_FAILURE;
+        } else
+        {
+            bench_write_json(json, &scene, &bench, &golden);
+            if (json != stdout)
+                fclose(json);
+        }
+    } else if (headless_mode)
+    {
+        glFinish();
+        double elapsed = pacing_now() - start;
+        printf("headless: %d frames in %.1f ms, %.3f ms/frame\n", scene.frames, elapsed * 1000.0, elapsed * 1000.0 / scene.frames);
+    }
 
-        unsigned int view_loc = glGetUniformLocation(shader_program, "_view");
-        glUniformMatrix4fv(view_loc, 1, GL_FALSE, view.m);
+    if (headless_mode)
+    {
+        char summary[512];
+        profile_summary(summary, sizeof(summary));
+        fprintf(stderr, "profile: %s\n", summary);
+        pacing_summary(&pacing, summary, sizeof(summary));
+        fprintf(stderr, "pacing: %s\n", summary);
+#ifdef GLSTATS_ENABLED
+        glstats_summary(summary, sizeof(summary), glstats_last_frame());
+        fprintf(stderr, "glstats: %s\n", summary);
+#endif
+    }
 
-        glBindVertexArray(VAO);
-        //glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+    bench_free(&bench);
+    pacing_destroy(&pacing);
+    job_system_destroy(&jobs);
+    arena_destroy(&frame_arena);
+    free(sim.previous);
+    free(sim.current);
+    for (int i = 0; i < scene.textures; i++)
+    {
+        glDeleteTextures(1, &textures[i]->texture);
+        if (!pool_free(&texture_pool, textures[i]))
+            status = EXIT_FAILURE;
+    }
+    free(textures);
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+    if (texture_pool.used != 0)
+    {
+        fprintf(stderr, "error: %d texture records were never released\n", texture_pool.used);
+        status = EXIT_FAILURE;
     }
+    pool_destroy(&texture_pool);
 
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
-    
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    shader_watch_destroy(&shader_watch);
+    pack_close(&pack);
+    // after the watcher has stopped, since its zones go into the profile
+    profile_shutdown();
+
+    if (headless_mode)
+        headless_destroy(&headless);
+    else
+    {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
 
-    return(EXIT_SUCCESS);
+    return(status);
 }
\ No newline at end of file
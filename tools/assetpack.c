@@ -0,0 +1,394 @@
+// Packs assets into one archive for pack_mount().
+//
+//   assetpack [-z] <output.pak> <file>...
+//
+// Files keep the paths given on the command line, which are the paths the
+// loaders ask for, so run it from the directory the application runs in.
+// With -z each entry is deflated when that makes it smaller; already
+// compressed images usually stay stored. The pack is read back and checked
+// against the sources before the tool reports success.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../include/stb_image.h"
+
+#define FILEMAP_IMPLEMENTATION
+#include "../include/filemap.h"
+
+#define PACK_IMPLEMENTATION
+#include "../include/pack.h"
+
+#define DEFLATE_WINDOW     32768
+#define DEFLATE_HASH_BITS  15
+#define DEFLATE_MAX_CHAIN  64
+
+typedef struct
+{
+    const char         *path;
+    file_map_t          file;
+    unsigned char      *packed;     // deflated copy, NULL when stored
+    pack_entry_t        entry;
+} asset_t;
+
+typedef struct
+{
+    unsigned char *data;
+    size_t         size;
+    size_t         capacity;
+    unsigned int   bits;
+    int            count;
+} deflate_out_t;
+
+static const unsigned short length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char  length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short dist_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char  dist_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static void put_byte(deflate_out_t *out, unsigned char value)
+{
+    if (out->size == out->capacity)
+    {
+        out->capacity = out->capacity ? out->capacity * 2 : 4096;
+        out->data = (unsigned char *) realloc(out->data, out->capacity);
+        if (out->data == NULL)
+        {
+            fprintf(stderr, "assetpack::error: out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    out->data[out->size++] = value;
+
+    return;
+}
+
+// Deflate packs bits from the least significant end.
+static void put_bits(deflate_out_t *out, unsigned int value, int count)
+{
+    out->bits |= value << out->count;
+    out->count += count;
+
+    while (out->count >= 8)
+    {
+        put_byte(out, (unsigned char) out->bits);
+        out->bits >>= 8;
+        out->count -= 8;
+    }
+
+    return;
+}
+
+// Huffman codes go out most significant bit first.
+static void put_code(deflate_out_t *out, unsigned int code, int length)
+{
+    unsigned int reversed = 0;
+    for (int i = 0; i < length; i++)
+        reversed |= ((code >> i) & 1) << (length - 1 - i);
+
+    put_bits(out, reversed, length);
+
+    return;
+}
+
+// The fixed literal/length code from RFC 1951 3.2.6.
+static void put_symbol(deflate_out_t *out, int symbol)
+{
+    if (symbol < 144)
+        put_code(out, 0x30 + symbol, 8);
+    else if (symbol < 256)
+        put_code(out, 0x190 + symbol - 144, 9);
+    else if (symbol < 280)
+        put_code(out, symbol - 256, 7);
+    else
+        put_code(out, 0xc0 + symbol - 280, 8);
+
+    return;
+}
+
+static void put_match(deflate_out_t *out, int length, int distance)
+{
+    int i = 28;
+    while (length_base[i] > length)
+        i--;
+    put_symbol(out, 257 + i);
+    put_bits(out, length - length_base[i], length_extra[i]);
+
+    int j = 29;
+    while (dist_base[j] > distance)
+        j--;
+    put_code(out, j, 5);
+    put_bits(out, distance - dist_base[j], dist_extra[j]);
+
+    return;
+}
+
+static unsigned int deflate_hash(const unsigned char *p)
+{
+    return (((unsigned int) p[0] << 16 | (unsigned int) p[1] << 8 | p[2]) * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+}
+
+// A zlib stream of one fixed Huffman block with greedy hash chain matching.
+// Shaders and other text shrink well enough this way without a dynamic
+// Huffman pass, and it is all the packer needs.
+static unsigned char *zlib_compress(const unsigned char *data, size_t size, size_t *packed_size)
+{
+    deflate_out_t out = { 0 };
+    int *head = (int *) malloc(sizeof(int) << DEFLATE_HASH_BITS);
+    int *prev = (int *) malloc(sizeof(int) * DEFLATE_WINDOW);
+    if (head == NULL || prev == NULL)
+    {
+        fprintf(stderr, "assetpack::error: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(head, -1, sizeof(int) << DEFLATE_HASH_BITS);
+
+    put_byte(&out, 0x78);
+    put_byte(&out, 0x01);
+    put_bits(&out, 1, 1);   // final block
+    put_bits(&out, 1, 2);   // fixed Huffman
+
+    size_t i = 0;
+    while (i < size)
+    {
+        int best_length = 0, best_distance = 0;
+
+        if (i + 3 <= size)
+        {
+            unsigned int hash = deflate_hash(data + i);
+            size_t limit = size - i < 258 ? size - i : 258;
+
+            int candidate = head[hash];
+            for (int chain = 0; candidate >= 0 && i - candidate <= DEFLATE_WINDOW - 1 && chain < DEFLATE_MAX_CHAIN; chain++)
+            {
+                int length = 0;
+                while ((size_t) length < limit && data[candidate + length] == data[i + length])
+                    length++;
+
+                if (length > best_length)
+                {
+                    best_length = length;
+                    best_distance = (int) (i - candidate);
+                }
+
+                int next = prev[candidate % DEFLATE_WINDOW];
+                if (next >= candidate)
+                    break;
+                candidate = next;
+            }
+        }
+
+        int advance = best_length >= 3 ? best_length : 1;
+        if (best_length >= 3)
+            put_match(&out, best_length, best_distance);
+        else
+            put_symbol(&out, data[i]);
+
+        for (int k = 0; k < advance; k++, i++)
+        {
+            if (i + 3 <= size)
+            {
+                unsigned int hash = deflate_hash(data + i);
+                prev[i % DEFLATE_WINDOW] = head[hash];
+                head[hash] = (int) i;
+            }
+        }
+    }
+
+    put_symbol(&out, 256);
+    if (out.count > 0)
+        put_bits(&out, 0, 8 - out.count);
+
+    unsigned int a = 1, b = 0;
+    for (size_t k = 0; k < size; k++)
+    {
+        a = (a + data[k]) % 65521;
+        b = (b + a) % 65521;
+    }
+    unsigned int adler = b << 16 | a;
+    for (int shift = 24; shift >= 0; shift -= 8)
+        put_byte(&out, (unsigned char) (adler >> shift));
+
+    free(head);
+    free(prev);
+
+    *packed_size = out.size;
+
+    return out.data;
+}
+
+static int compare_assets(const void *a, const void *b)
+{
+    unsigned long long x = ((const asset_t *) a)->entry.hash;
+    unsigned long long y = ((const asset_t *) b)->entry.hash;
+
+    return (x > y) - (x < y);
+}
+
+static const char *stored_path(const char *path)
+{
+    while (path[0] == '.' && (path[1] == '/' || path[1] == '\\'))
+        path += 2;
+
+    return path;
+}
+
+static void write_padding(FILE *fp, unsigned long long from, unsigned long long to)
+{
+    static const unsigned char zeros[PACK_ALIGNMENT];
+    fwrite(zeros, 1, (size_t) (to - from), fp);
+
+    return;
+}
+
+int main(int argc, char **argv)
+{
+    bool compress = false;
+    int first = 1;
+
+    if (first < argc && strcmp(argv[first], "-z") == 0)
+    {
+        compress = true;
+        first++;
+    }
+
+    if (argc - first < 2)
+    {
+        fprintf(stderr, "usage: assetpack [-z] <output.pak> <file>...\n");
+        return(EXIT_FAILURE);
+    }
+
+    const char *output = argv[first++];
+    int count = argc - first;
+    asset_t *assets = (asset_t *) calloc(count, sizeof(asset_t));
+
+    unsigned long long paths_size = 0;
+    for (int i = 0; i < count; i++)
+    {
+        asset_t *asset = &assets[i];
+        asset->path = argv[first + i];
+
+        if (!file_map_open(&asset->file, asset->path))
+        {
+            fprintf(stderr, "assetpack::error: cannot read \"%s\"\n", asset->path);
+            return(EXIT_FAILURE);
+        }
+
+        asset->entry.hash = pack_hash_path(asset->path);
+        asset->entry.size = asset->file.size;
+        asset->entry.raw_size = asset->file.size;
+        asset->entry.compression = PACK_STORED;
+
+        if (compress && asset->file.size > 0 && asset->file.size <= 0x7fffffff)
+        {
+            size_t packed_size;
+            unsigned char *packed = zlib_compress(asset->file.data, asset->file.size, &packed_size);
+            if (packed_size < asset->file.size)
+            {
+                asset->packed = packed;
+                asset->entry.size = packed_size;
+                asset->entry.compression = PACK_ZLIB;
+            } else
+                free(packed);
+        }
+
+        paths_size += strlen(stored_path(asset->path)) + 1;
+    }
+
+    qsort(assets, count, sizeof(asset_t), compare_assets);
+
+    // layout: header, index, paths, then the entries on aligned offsets
+    pack_header_t header = { PACK_MAGIC, (unsigned int) count, 0, paths_size };
+    header.paths_offset = sizeof(pack_header_t) + (unsigned long long) count * sizeof(pack_entry_t);
+
+    unsigned long long path = 0;
+    unsigned long long offset = header.paths_offset + paths_size;
+    for (int i = 0; i < count; i++)
+    {
+        if (i > 0 && assets[i].entry.hash == assets[i - 1].entry.hash
+            && strcmp(stored_path(assets[i].path), stored_path(assets[i - 1].path)) == 0)
+        {
+            fprintf(stderr, "assetpack::error: \"%s\" is listed twice\n", assets[i].path);
+            return(EXIT_FAILURE);
+        }
+
+        offset = (offset + PACK_ALIGNMENT - 1) & ~(unsigned long long) (PACK_ALIGNMENT - 1);
+        assets[i].entry.offset = offset;
+        assets[i].entry.path = (unsigned int) path;
+
+        offset += assets[i].entry.size;
+        path += strlen(stored_path(assets[i].path)) + 1;
+    }
+
+    FILE *fp = fopen(output, "wb");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "assetpack::error: cannot write \"%s\"\n", output);
+        return(EXIT_FAILURE);
+    }
+
+    fwrite(&header, sizeof(header), 1, fp);
+    for (int i = 0; i < count; i++)
+        fwrite(&assets[i].entry, sizeof(pack_entry_t), 1, fp);
+    for (int i = 0; i < count; i++)
+    {
+        const char *name = stored_path(assets[i].path);
+        for (const char *c = name; *c; c++)
+            fputc(*c == '\\' ? '/' : *c, fp);
+        fputc('\0', fp);
+    }
+
+    unsigned long long position = header.paths_offset + paths_size;
+    for (int i = 0; i < count; i++)
+    {
+        write_padding(fp, position, assets[i].entry.offset);
+        fwrite(assets[i].packed ? assets[i].packed : assets[i].file.data, 1, (size_t) assets[i].entry.size, fp);
+        position = assets[i].entry.offset + assets[i].entry.size;
+    }
+
+    if (fclose(fp) != 0)
+    {
+        fprintf(stderr, "assetpack::error: cannot write \"%s\"\n", output);
+        return(EXIT_FAILURE);
+    }
+
+    pack_t pack;
+    if (!pack_open(&pack, output))
+        return(EXIT_FAILURE);
+
+    size_t raw_total = 0, packed_total = 0;
+    for (int i = 0; i < count; i++)
+    {
+        const pack_entry_t *entry = pack_find(&pack, assets[i].path);
+        file_map_t view;
+
+        if (entry == NULL || !pack_read(&pack, entry, &view))
+        {
+            fprintf(stderr, "assetpack::error: \"%s\" does not read back\n", assets[i].path);
+            return(EXIT_FAILURE);
+        }
+
+        bool same = view.size == assets[i].file.size && memcmp(view.data, assets[i].file.data, view.size) == 0;
+        file_map_close(&view);
+        if (!same)
+        {
+            fprintf(stderr, "assetpack::error: \"%s\" does not match its source\n", assets[i].path);
+            return(EXIT_FAILURE);
+        }
+
+        raw_total += assets[i].file.size;
+        packed_total += (size_t) assets[i].entry.size;
+
+        file_map_close(&assets[i].file);
+        free(assets[i].packed);
+    }
+
+    printf("%s: %d files, %zu -> %zu bytes of data, %llu bytes total\n", output, count, raw_total, packed_total, position);
+
+    pack_close(&pack);
+    free(assets);
+
+    return(EXIT_SUCCESS);
+}
@@ -0,0 +1,178 @@
+// Measures how the job system scales on the per-frame transform workload.
+//
+//   job_bench [-objects N] [-iterations N] [-grain N] [-threads N]
+//
+// Builds model and model-view-projection matrices for N objects (default
+// 100000) with job_parallel_for(), once per iteration (default 50), at every
+// thread count from 1 up to -threads (default: one per core), and reports the
+// best and mean time per pass against the single threaded run. Each run's
+// matrices are checked against the first, so a race shows up as a mismatch.
+
+// thread_now() uses clock_gettime(), which is POSIX rather than C11
+#ifndef _WIN32
+    #define _POSIX_C_SOURCE 199309L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define THREAD_IMPLEMENTATION
+#include "../include/thread.h"
+
+#define ALLOC_IMPLEMENTATION
+#include "../include/alloc.h"
+
+#define JOB_IMPLEMENTATION
+#include "../include/job.h"
+
+#define LGEBRA_IMPLEMENTATION
+#include "../include/lgebra.h"
+
+typedef struct
+{
+    vec3_t position;
+    vec3_t axis;
+    float  angle;
+    float  scale;
+} object_t;
+
+typedef struct
+{
+    const object_t *objects;
+    mat4_t         *models;
+    mat4_t         *mvps;
+    mat4_t          view_projection;
+    float           time;
+} transform_batch_t;
+
+static void transform_objects(void *data, int begin, int end)
+{
+    transform_batch_t *batch = (transform_batch_t *) data;
+
+    for (int i = begin; i < end; i++)
+    {
+        const object_t *object = &batch->objects[i];
+
+        mat4_t model = mat4(IDENTITY);
+        mat4_rotate(&model, object->angle + batch->time * 50, object->axis);
+        mat4_scale(&model, (vec3_t) { object->scale, object->scale, object->scale });
+        model.m[12] = object->position.x;
+        model.m[13] = object->position.y;
+        model.m[14] = object->position.z;
+
+        mat4_t mvp = mat4(EMPTY);
+        mat4_dot(&mvp, batch->view_projection, model);
+
+        batch->models[i] = model;
+        batch->mvps[i] = mvp;
+    }
+
+    return;
+}
+
+int main(int argc, char **argv)
+{
+    int object_count = 100000;
+    int iterations = 50;
+    int grain = 256;
+    int max_threads = thread_hardware_concurrency();
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-objects") == 0 && i + 1 < argc)
+            object_count = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-iterations") == 0 && i + 1 < argc)
+            iterations = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-grain") == 0 && i + 1 < argc)
+            grain = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+            max_threads = atoi(argv[++i]);
+        else
+        {
+            fprintf(stderr, "usage: job_bench [-objects N] [-iterations N] [-grain N] [-threads N]\n");
+            return(EXIT_FAILURE);
+        }
+    }
+
+    if (object_count < 1 || iterations < 1 || grain < 1 || max_threads < 1)
+    {
+        fprintf(stderr, "job_bench::error: counts must be positive\n");
+        return(EXIT_FAILURE);
+    }
+
+    object_t *objects = (object_t *) malloc(object_count * sizeof(object_t));
+    mat4_t *models = (mat4_t *) malloc(object_count * sizeof(mat4_t));
+    mat4_t *mvps = (mat4_t *) malloc(object_count * sizeof(mat4_t));
+    mat4_t *reference = (mat4_t *) malloc(object_count * sizeof(mat4_t));
+    if (objects == NULL || models == NULL || mvps == NULL || reference == NULL)
+    {
+        fprintf(stderr, "job_bench::error: out of memory for %d objects\n", object_count);
+        return(EXIT_FAILURE);
+    }
+
+    unsigned int seed = 1;
+    for (int i = 0; i < object_count; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        objects[i].position = (vec3_t) { (float) (seed % 2001) / 100.0f - 10.0f, (float) (seed % 1001) / 100.0f - 5.0f, (float) (seed % 3001) / 100.0f - 40.0f };
+        objects[i].axis = (vec3_t) { 0.0f, 1.0f, 0.0f };
+        objects[i].angle = (float) (seed % 360);
+        objects[i].scale = 0.5f + (float) (seed % 100) / 100.0f;
+    }
+
+    transform_batch_t batch = { objects, models, mvps, mat4(IDENTITY), 0.0f };
+    mat4_perspective(&batch.view_projection, 60.0f, 800.0f / 600.0f, 0.1f, 100.0f);
+
+    printf("%d objects, grain %d, %d iterations\n", object_count, grain, iterations);
+    printf("threads   best ms   mean ms   speedup   efficiency\n");
+
+    double single_best = 0.0;
+    bool mismatch = false;
+
+    for (int threads = 1; threads <= max_threads; threads++)
+    {
+        job_system_t jobs;
+        job_system_init(&jobs, threads - 1);
+
+        // one untimed pass warms the caches and wakes the workers
+        batch.time = 0.0f;
+        job_parallel_for(&jobs, object_count, grain, transform_objects, &batch);
+
+        double best = 1e30, sum = 0.0;
+        for (int i = 0; i < iterations; i++)
+        {
+            batch.time = (float) i / 60.0f;
+
+            double start = thread_now();
+            job_parallel_for(&jobs, object_count, grain, transform_objects, &batch);
+            double elapsed = thread_now() - start;
+
+            sum += elapsed;
+            if (elapsed < best)
+                best = elapsed;
+        }
+
+        job_system_destroy(&jobs);
+
+        if (threads == 1)
+        {
+            single_best = best;
+            memcpy(reference, mvps, object_count * sizeof(mat4_t));
+        } else if (memcmp(reference, mvps, object_count * sizeof(mat4_t)) != 0)
+        {
+            fprintf(stderr, "job_bench::error: %d threads produced different matrices\n", threads);
+            mismatch = true;
+        }
+
+        double speedup = single_best / best;
+        printf("%7d %9.3f %9.3f %9.2fx %11.0f%%\n", threads, best * 1e3, sum / iterations * 1e3, speedup, speedup / threads * 100.0);
+    }
+
+    free(objects);
+    free(models);
+    free(mvps);
+    free(reference);
+
+    return(mismatch ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,142 @@
+// Measures stb_image JPEG decode throughput.
+//
+//   jpeg_bench [-iterations N] [-threads N] [-components N] <file.jpg>...
+//
+// Every file is read into memory once and decoded N times (default 20). Build a
+// second copy with -DSTBI_NO_AVX2 or -DSTBI_NO_SIMD to compare kernel sets;
+// -threads 1 (the default) keeps the decode on the calling thread.
+
+// thread_now() uses clock_gettime(), which is POSIX rather than C11
+#ifndef _WIN32
+    #define _POSIX_C_SOURCE 199309L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../include/stb_image.h"
+
+#define THREAD_IMPLEMENTATION
+#include "../include/thread.h"
+
+static void bench_parallel_for(void *pool, int count, stbi_parallel_task *task, void *task_data)
+{
+    thread_pool_for((thread_pool_t *) pool, count, (task_fn_t) task, task_data);
+
+    return;
+}
+
+static unsigned char *read_file(const char *path, int *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    unsigned char *data = (unsigned char *) malloc(length > 0 ? length : 1);
+    if (data == NULL || fread(data, 1, length, file) != (size_t) length)
+    {
+        free(data);
+        fclose(file);
+        return NULL;
+    }
+
+    fclose(file);
+    *size = (int) length;
+
+    return data;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = 20;
+    int threads = 1;
+    int components = 0;
+    int first_file = argc;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-iterations") == 0 && i + 1 < argc)
+            iterations = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-components") == 0 && i + 1 < argc)
+            components = atoi(argv[++i]);
+        else if (argv[i][0] == '-')
+        {
+            fprintf(stderr, "jpeg_bench::error: unknown option \"%s\"\n", argv[i]);
+            return(EXIT_FAILURE);
+        }
+        else
+        {
+            first_file = i;
+            break;
+        }
+    }
+
+    if (first_file == argc || iterations < 1 || components < 0 || components > 4)
+    {
+        fprintf(stderr, "usage: jpeg_bench [-iterations N] [-threads N] [-components N] <file.jpg>...\n");
+        return(EXIT_FAILURE);
+    }
+
+    thread_pool_t pool;
+    thread_pool_init(&pool, threads > 0 ? threads - 1 : -1);
+
+    stbi_load_options options = { .parallel_for = bench_parallel_for, .pool = &pool };
+    stbi_load_options *use_options = pool.worker_count > 0 ? &options : NULL;
+
+    double total_pixels = 0.0;
+    double total_seconds = 0.0;
+
+    for (int f = first_file; f < argc; f++)
+    {
+        int size;
+        unsigned char *file = read_file(argv[f], &size);
+        if (file == NULL)
+        {
+            fprintf(stderr, "jpeg_bench::error: cannot read \"%s\"\n", argv[f]);
+            return(EXIT_FAILURE);
+        }
+
+        int width = 0, height = 0, channels = 0;
+        double best = 1e30, sum = 0.0;
+
+        for (int i = 0; i < iterations; i++)
+        {
+            double start = thread_now();
+            unsigned char *pixels = stbi_load_from_memory_ex(file, size, &width, &height, &channels, components, use_options);
+            double elapsed = thread_now() - start;
+
+            if (pixels == NULL)
+            {
+                fprintf(stderr, "jpeg_bench::error: cannot decode \"%s\": %s\n", argv[f], stbi_failure_reason());
+                return(EXIT_FAILURE);
+            }
+            stbi_image_free(pixels);
+
+            sum += elapsed;
+            if (elapsed < best)
+                best = elapsed;
+        }
+
+        double megapixels = (double) width * height / 1e6;
+        printf("%s: %dx%d, best %.2f ms, mean %.2f ms, %.1f MP/s\n",
+               argv[f], width, height, best * 1000.0, sum / iterations * 1000.0, megapixels / best);
+
+        total_pixels += megapixels * iterations;
+        total_seconds += sum;
+        free(file);
+    }
+
+    printf("total: %.1f MP/s on %d threads\n", total_pixels / total_seconds, pool.worker_count + 1);
+
+    thread_pool_destroy(&pool);
+
+    return(EXIT_SUCCESS);
+}
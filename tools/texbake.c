@@ -0,0 +1,101 @@
+// Bakes an image into a block compressed, mipmapped DDS for load_compressed_texture().
+//
+//   texbake <input> <output.dds> [bc1|bc3] [fast|normal|high] [-flip] [-threads N]
+//
+// The format defaults to bc1 for images without alpha and bc3 otherwise.
+
+// thread_now() uses clock_gettime(), which is POSIX rather than C11
+#ifndef _WIN32
+    #define _POSIX_C_SOURCE 199309L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../include/stb_image.h"
+
+#define THREAD_IMPLEMENTATION
+#include "../include/thread.h"
+
+#define TEXCOMP_IMPLEMENTATION
+#include "../include/texcomp.h"
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "usage: texbake <input> <output.dds> [bc1|bc3] [fast|normal|high] [-flip] [-threads N]\n");
+        return(EXIT_FAILURE);
+    }
+
+    int format = -1;
+    texcomp_quality_t quality = TEXCOMP_NORMAL;
+    int flip = 0;
+    int threads = -1;
+
+    for (int i = 3; i < argc; i++)
+    {
+        if (strcmp(argv[i], "bc1") == 0)
+            format = TEXCOMP_BC1;
+        else if (strcmp(argv[i], "bc3") == 0)
+            format = TEXCOMP_BC3;
+        else if (strcmp(argv[i], "fast") == 0)
+            quality = TEXCOMP_FAST;
+        else if (strcmp(argv[i], "normal") == 0)
+            quality = TEXCOMP_NORMAL;
+        else if (strcmp(argv[i], "high") == 0)
+            quality = TEXCOMP_HIGH;
+        else if (strcmp(argv[i], "-flip") == 0)
+            flip = 1;
+        else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]) - 1;
+        else
+        {
+            fprintf(stderr, "texbake::error: unknown option \"%s\"\n", argv[i]);
+            return(EXIT_FAILURE);
+        }
+    }
+
+    stbi_load_options options = { 0 };
+    options.flip_vertically = flip ? 1 : -1;
+
+    int width, height, channels;
+    unsigned char *rgba = stbi_load_ex(argv[1], &width, &height, &channels, 4, &options);
+    if (rgba == NULL)
+    {
+        fprintf(stderr, "texbake::error: cannot read \"%s\": %s\n", argv[1], stbi_failure_reason());
+        return(EXIT_FAILURE);
+    }
+
+    if (format < 0)
+        format = (channels == 2 || channels == 4) ? TEXCOMP_BC3 : TEXCOMP_BC1;
+
+    thread_pool_t pool;
+    thread_pool_init(&pool, threads);
+
+    compressed_texture_t tex;
+    double start = thread_now();
+    bool ok = texcomp_compress_texture(&tex, rgba, width, height, (texcomp_format_t) format, quality, true, &pool);
+    double elapsed = thread_now() - start;
+    int thread_total = pool.worker_count + 1;
+
+    thread_pool_destroy(&pool);
+
+    if (!ok || !texcomp_save_dds(&tex, argv[2]))
+    {
+        fprintf(stderr, "texbake::error: cannot write \"%s\"\n", argv[2]);
+        return(EXIT_FAILURE);
+    }
+
+    size_t raw_size = (size_t) width * height * 4;
+    printf("%s: %dx%d %s, %d levels, %zu -> %zu bytes (level 0: %.1fx), PSNR %.2f dB, %.1f ms on %d threads\n",
+           argv[2], width, height, format == TEXCOMP_BC3 ? "BC3" : "BC1", tex.level_count,
+           raw_size, tex.size, (double) raw_size / tex.level_size[0], tex.psnr, elapsed * 1000.0, thread_total);
+
+    texcomp_free(&tex);
+    stbi_image_free(rgba);
+
+    return(EXIT_SUCCESS);
+}